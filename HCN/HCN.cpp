@@ -66,46 +66,585 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <tchar.h>
+#include <mutex>
+
+// SIMD kernels for the zero-encoding. Only x86/x64 has them, everything else runs the scalar reference.
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define HCN_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define HCN_TARGET_AVX2							// MSVC lets us use AVX2 intrinsics without changing /arch
+#else
+#define HCN_TARGET_AVX2		__attribute__((target("avx2")))
+#endif
+#endif
+
+// A bundle being put together, per player. See hcn_bundle_add().
+struct HCN_bundle {
+	unsigned char data[HCN_MAX_PACKET_LENGTH];				// Un-encoded packet, preamble and all.
+	int length;								// In bytes.
+	int count;								// Messages in it.
+};
+
+// hcn_bundle_reset() - Start an empty bundle.
+static void hcn_bundle_reset(struct HCN_bundle *bundle) {
+	struct HCN_preamble preamble;
+
+	preamble.packet_type = HCN_PACKET_BUNDLE;
+	preamble.packet_length = 1;						// Placeholders, so the size estimate sees what the writer will.
+	preamble.encoded_length = 1;
+	memcpy(bundle->data, &preamble, sizeof(struct HCN_preamble));
+	bundle->data[sizeof(struct HCN_preamble)] = 0;				// Message count.
+	bundle->length = sizeof(struct HCN_preamble) + 1;
+	bundle->count = 0;
+}
+
+// Outbound queues, per player, for when the scheduler is on. See hcn_set_scheduler().
+struct HCN_queued {
+	unsigned char data[HCN_MAX_PACKET_LENGTH];				// Un-encoded packet, preamble and all, same as a bundle.
+	int length;								// In bytes.
+	int cost;								// Encoded length in bytes, including the terminator.
+	int key_id;								// Number it gives a key, 0 if none. See hcn_key_defined().
+	char key[HCN_KEYVALUE_LENGTH];
+};
+struct HCN_lane_queue {
+	struct HCN_queued entries[HCN_LANE_DEPTH];
+	int head;
+	int count;
+};
+struct HCN_outbound {
+	int player_number;							// Who these are for, as the application numbers them.
+	struct HCN_lane_queue lanes[HCN_LANE_VECTOR];				// Every lane but vectors.
+	struct HCN_subject_vector vectors[HCN_LANE_VECTORS];			// Vectors don't queue up, just the latest of each type and subject.
+	int vector_count;
+	struct HCN_send_stats stats;
+};
+
+static void hcn_outbound_drain(int pi, bool unlimited);
+static void hcn_outbound_reset(struct HCN_outbound *out);
+
+// Delta vector state, per player. The sender remembers what it sent of each vector, and which packet it went in, until
+//	the other side acks it. The receiver remembers what it got, so changes can be put back together.
+struct HCN_delta_sent {
+	unsigned int serial;							// Packet it went in. 0 if none.
+	unsigned short q[3];							// Quantized x/y/z.
+};
+struct HCN_delta_slot {
+	HCN_vector_type vector_type;
+	unsigned char subject;
+	unsigned int acked_serial;						// Newest packet with this vector the other side has, 0 if none,
+	unsigned short acked[3];						// and what was in it.
+	int until_keyframe;
+	struct HCN_delta_sent sent[HCN_DELTA_HISTORY];
+	int next;
+};
+struct HCN_delta_got {
+	unsigned char sequence;							// Packet it came in. 0 if none.
+	unsigned short q[3];
+};
+struct HCN_delta_recv_slot {
+	HCN_vector_type vector_type;
+	unsigned char subject;
+	struct HCN_delta_got got[HCN_DELTA_HISTORY];
+	int next;
+};
+struct HCN_delta {
+	int player_number;
+	unsigned int serial;							// Last packet sent. Goes out as a sequence number, see hcn_delta_sequence().
+	int slot_count;
+	struct HCN_delta_slot slots[HCN_DELTA_SLOTS];
+	int recv_count;
+	struct HCN_delta_recv_slot recv[HCN_DELTA_SLOTS];
+	unsigned char ack;							// Sequence number to ack on the next tick, 0 if none,
+	unsigned int ack_also;							// and which of the 32 before it we got too, bit 0 for the one just before.
+};
+
+static void hcn_delta_reset(struct HCN_delta *delta);
+static void hcn_delta_tick(int pi);
+
+// Dead reckoning state, per player. What we last sent of each vector, and what we last got, and when.
+struct HCN_dr_slot {
+	HCN_vector_type vector_type;
+	unsigned char subject;
+	struct HCN_vect3d vector;
+	unsigned int tick;
+};
+struct HCN_dead_reckoning {
+	int player_number;
+	int sent_count;
+	struct HCN_dr_slot sent[HCN_DR_SLOTS];
+	int got_count;
+	struct HCN_dr_slot got[HCN_DR_SLOTS];
+};
+
+static int hcn_dr_tick(int pi, struct HCN_subject_vector *vectors, int *player_number);
+static void hcn_dr_sent(int pi, const struct HCN_queued *entry, const struct HCN_subject_vector *vectors, int count);
+static bool hcn_deliver_subject_vectors(int player_number, struct HCN_subject_vector *vectors, int count);
+
+// Numbered keys, per player. See HCN_PACKET_KEY_DEFINE. A key table holds keys numbered 1 to count, one after another
+//	in keys, with their hcn_key_hash() to find them quickly.
+struct HCN_key_table {
+	int count;
+	unsigned int hash[HCN_KEY_IDS];
+	unsigned short offset[HCN_KEY_IDS];
+	int used;								// Bytes of keys used.
+	char keys[HCN_KEY_ID_SPACE];
+};
+struct HCN_keys {
+	struct HCN_key_table sent;						// Keys we've numbered for the other side.
+	struct HCN_key_table got;						// Keys the other side has numbered for us,
+	unsigned short got_entry[HCN_KEY_IDS];					// and which entry in the key list each is, plus one. 0 if not looked up yet.
+	unsigned int generation;						// The key list they were looked up in. See hcn_set_keyvalue_callback_list().
+};
+
+#define HCN_KEY_UNLISTED	0xFFFF						// got_entry for a key that isn't in the key list.
+
+static void hcn_keys_reset(struct HCN_keys *keys);
+static bool hcn_key_table_set(struct HCN_key_table *table, int id, const char *key, int length);
+static void hcn_pipeline_flush();
+static bool hcn_handle_chat(int player_number, int chat_type, wchar_t *our_packet);
+static bool hcn_deliver_encoded(int player_number, struct HCN_packet *encoded_packet, int length);
+
+// A bounded ring of chat-sized packets, for handing them between threads without a lock. Any number of threads can put
+//	packets in, one takes them out. Each slot's sequence number says whose turn it is: a producer can have it when
+//	it equals the position being claimed, the consumer when it's one past.
+struct HCN_ring_slot {
+	std::atomic<unsigned int> sequence;
+	int player_number;
+	int chat_type;
+	int length;								// 16-bit characters, including the terminator. 0 is skipped.
+	wchar_t chat[HCN_MAX_PACKET_LENGTH / 2];
+};
+struct HCN_ring {
+	struct HCN_ring_slot slots[HCN_RING_DEPTH];
+	std::atomic<unsigned int> head;						// Next position a producer claims.
+	std::atomic<unsigned int> tail;						// Next position the consumer takes. Only it writes this.
+	std::atomic<unsigned int> queued;
+	std::atomic<unsigned int> dropped;
+};
+
+static_assert((HCN_RING_DEPTH & (HCN_RING_DEPTH - 1)) == 0, "HCN_RING_DEPTH has to be a power of 2");
+
+// hcn_ring_reset() - Empty a ring. Nobody can be using it.
+static void hcn_ring_reset(struct HCN_ring *ring) {
+
+	for (unsigned int i = 0; i < HCN_RING_DEPTH; i++) ring->slots[i].sequence.store(i, std::memory_order_relaxed);
+	ring->head.store(0, std::memory_order_relaxed);
+	ring->tail.store(0, std::memory_order_relaxed);
+	ring->queued.store(0, std::memory_order_relaxed);
+	ring->dropped.store(0, std::memory_order_relaxed);
+}
+
+// hcn_ring_reserve() - Claim the next slot to fill in. NULL if the ring is full, which counts as a drop.
+static struct HCN_ring_slot *hcn_ring_reserve(struct HCN_ring *ring) {
+	struct HCN_ring_slot *slot;
+	unsigned int position = ring->head.load(std::memory_order_relaxed);
+	int turn;
+
+	for (;;) {
+		slot = &ring->slots[position & (HCN_RING_DEPTH - 1)];
+		turn = (int)(slot->sequence.load(std::memory_order_acquire) - position);
+		if (turn == 0) {						// Ours, if nobody beats us to it.
+			if (ring->head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) return slot;
+		}
+		else if (turn < 0) {						// The consumer hasn't gotten to it yet, so we're full.
+			ring->dropped.fetch_add(1, std::memory_order_relaxed);
+			return NULL;
+		}
+		else {
+			position = ring->head.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+// hcn_ring_commit() - A reserved slot is filled in, let the consumer have it.
+static void hcn_ring_commit(struct HCN_ring *ring, struct HCN_ring_slot *slot) {
+
+	ring->queued.fetch_add(1, std::memory_order_relaxed);
+	slot->sequence.store(slot->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// hcn_ring_peek() - The oldest filled in slot, or NULL if there isn't one. Consumer only.
+static struct HCN_ring_slot *hcn_ring_peek(struct HCN_ring *ring) {
+	unsigned int position = ring->tail.load(std::memory_order_relaxed);
+	struct HCN_ring_slot *slot = &ring->slots[position & (HCN_RING_DEPTH - 1)];
+
+	if (slot->sequence.load(std::memory_order_acquire) != position + 1) return NULL;
+	return slot;
+}
+
+// hcn_ring_release() - Done with the slot hcn_ring_peek() gave us, producers can have it again.
+static void hcn_ring_release(struct HCN_ring *ring, struct HCN_ring_slot *slot) {
+	unsigned int position = ring->tail.load(std::memory_order_relaxed);
+
+	slot->sequence.store(position + HCN_RING_DEPTH, std::memory_order_release);
+	ring->tail.store(position + 1, std::memory_order_release);
+}
+
+// hcn_ring_depth() - How many slots are claimed but not yet released. Only a snapshot, if other threads are at it.
+static inline int hcn_ring_depth(struct HCN_ring *ring) {
+
+	return (int)(ring->head.load(std::memory_order_relaxed) - ring->tail.load(std::memory_order_relaxed));
+}
+
+// hcn_classify_chat() counters, the same as HCN_chat_stats, but safe to count from more than one thread.
+struct HCN_chat_counters {
+	std::atomic<unsigned int> total;
+	std::atomic<unsigned int> not_hcn;
+	std::atomic<unsigned int> hcn;
+	std::atomic<unsigned int> malformed;
+};
+
+// A slot in the key hash table. entry is the index in the key list plus one, 0 if the slot is empty.
+struct HCN_key_slot {
+	unsigned int hash;
+	unsigned short entry;
+};
+
+// A handler and the context to give it. See HCN_context.
+struct HCN_datapoint_handler {
+	HCN_handler_datapoint handler;
+	void *context;
+};
+
+struct HCN_wide_datapoint_handler {
+	HCN_handler_wide_datapoint handler;
+	void *context;
+};
+
+struct HCN_vector_handler {
+	HCN_handler_vector handler;
+	void *context;
+};
+
+struct HCN_text_handler {
+	HCN_handler_text handler;
+	void *context;
+};
+
+// Everything HCN keeps track of, for one session. The free functions all work on the current context, which is
+//	hcn_default_context unless the thread picked another one with hcn_set_context().
+struct HCN_context {
+
+	// The current HCN state. Atomic, so hcn_running() can be asked from any thread without taking a lock.
+	std::atomic<HCN_state> state[HCN_MAX_PLAYERS];
+
+	// Everything else about a player is only touched with their lock held, so different players can be worked on
+	//	from different threads at once. See hcn_player_lock().
+	std::recursive_mutex player_lock[HCN_MAX_PLAYERS];
+
+	// A little bit of a state machine. Keep track of last state, compared to current state, so we can do certain things when the state changes.
+	//	For example, sending client id after the state goes to RUNNING
+	HCN_state last_state[HCN_MAX_PLAYERS];
+
+	// What we are, client or server. And what type.
+	HCN_OUR_SIDE our_side = HCN_WE_ARE_UNKNOWN;
+	HCN_SERVER_TYPE server_type = HCN_NOT_A_SERVER;
+	HCN_CLIENT_TYPE client_type[HCN_MAX_PLAYERS];
+
+	// Keep a copy of the other side's handshake packet. This can include version, and other pertinent info.
+	struct HCN_handshake other_side[HCN_MAX_PLAYERS];
+
+	// What we can do (HCN_CAP_*), and what both we and the other side can do, as found out in the handshake.
+	unsigned short our_capabilities = HCN_CAP_ALL;
+	std::atomic<unsigned short> peer_capabilities[HCN_MAX_PLAYERS];
+
+	// A bundle being put together, per player. See hcn_bundle_add().
+	struct HCN_bundle bundles[HCN_MAX_PLAYERS];
+
+	// Outbound queues, per player. Scheduler is off until the application turns it on, so everything goes out as soon as it's sent.
+	struct HCN_outbound outbound[HCN_MAX_PLAYERS];
+	bool scheduling = false;
+	int budget_bytes = 0;							// Per player, per tick. 0 is no limit.
+	int budget_packets = 0;
+
+	// Bounds for compact vectors, by vector type. Compact vectors aren't offered until the application has set them.
+	struct HCN_vector_bounds vector_bounds[256];
+	bool bounds_set = false;
+
+	// Delta vector and dead reckoning state, per player.
+	struct HCN_delta delta[HCN_MAX_PLAYERS];
+	struct HCN_dead_reckoning dr[HCN_MAX_PLAYERS];
+	bool dr_enabled = false;						// Off until the application turns it on.
+	float dr_threshold = 0.1f;
+	std::atomic<unsigned int> tick_count;					// hcn_on_tick() calls so far.
+
+	// What team each player is on, for hcn_team_mask(). HCN_NO_TEAM until the application says.
+	int player_team[HCN_MAX_PLAYERS];
+
+	// Optional callback for vectors that say whose they are. Without it, they go to the regular vector callbacks.
+	HCN_callback_subject_vector subject_vector_callback = NULL;
+
+	// Optional callback that gets vectors in bulk. It takes the place of both of the above.
+	HCN_callback_vector_block vector_block_callback = NULL;
+
+	// Store our version somewhere.
+	char our_version[HCN_VALUE_LENGTH] = { 0 };
+
+	// Logger callback function. The application provides this so we can output log information in whatever format the application wants.
+	HCN_logger_callback logger_callback = NULL;
+	int debug_level = HCN_LOG_INFO;
+
+	// Send packet function, provided by application.
+	HCN_application_sender application_sender = NULL;
+
+	// Or, reserve/commit functions, so we can encode straight into the application's chat buffer.
+	HCN_application_reserve application_reserve = NULL;
+	HCN_application_commit application_commit = NULL;
+
+	// Handlers for datapoint, vector and text updates, one for every possible type, so any type that comes in can be
+	//	looked up without checking it first. An empty one is a type the application doesn't know about. Callbacks
+	//	from the old style lists are kept here too, and the handler just calls them.
+	struct HCN_datapoint_handler datapoint_handlers[256];
+	struct HCN_wide_datapoint_handler wide_datapoint_handlers[256];		// For packed datapoints, before the ones above.
+	struct HCN_vector_handler vector_handlers[256];
+	struct HCN_text_handler text_handlers[256];
+	HCN_callback_datapoint datapoint_callbacks[256];
+	HCN_callback_vector vector_callbacks[256];
+	HCN_callback_text text_callbacks[256];
+
+	// Callbacks to the application for various key/value pairs. List is terminated by a NULL set. The first key_hashed
+	//	of them are in the hash table too, so they can be found without going through the list.
+	struct HCN_key_dispatch *key_dispatch_list = NULL;
+	struct HCN_key_slot key_slots[HCN_KEY_SLOTS];
+	int key_hashed = 0;
+	unsigned int key_generation = 1;					// Goes up every time the key list is set.
+
+	// Numbered keys, per player.
+	struct HCN_keys keys[HCN_MAX_PLAYERS];
+
+	// Optional callback that gets every decoded packet as a view, before the handlers above.
+	HCN_callback_packet packet_callback = NULL;
+
+	// Pipelined mode. The chat hook only copies HCN packets into the inbound ring, the application's worker thread
+	//	handles them, and everything we send goes through the outbound ring to hcn_on_tick(). See hcn_set_pipeline().
+	std::atomic<bool> pipelining;
+	struct HCN_ring inbound_ring;
+	struct HCN_ring outbound_ring;
+
+	// What hcn_classify_chat() has seen so far. Any thread can be classifying chat.
+	struct HCN_chat_counters chat_stats;
+
+	// How many threads have this context selected right now. hcn_context_destroy() won't free it out from under them.
+	std::atomic<int> selected;
+};
+
+// The context for applications that only ever run one session, and the one each thread is using right now.
+struct HCN_context hcn_default_context;
+static thread_local struct HCN_context *hcn_current = &hcn_default_context;
+
+// HCN_context_selection - What this thread has selected, kept apart from hcn_current so that stays a plain pointer.
+//	When the thread exits, it lets go of it, so hcn_context_destroy() isn't held up by a thread that's gone.
+struct HCN_context_selection {
+	struct HCN_context *context = NULL;
 
-// The current HCN state.
-HCN_state hcn_state[HCN_MAX_PLAYERS];
+	~HCN_context_selection() {
+		if (context != NULL && context != &hcn_default_context) context->selected--;
+	}
+};
+static thread_local struct HCN_context_selection hcn_selection;
+
+// hcn_context_create() - A new context, for another session in the same process. Call hcn_init() on it before using it,
+//	the same as the default one.
+struct HCN_context *hcn_context_create() {
+
+	return new struct HCN_context();
+}
+
+// hcn_context_destroy() - Done with a context. If the calling thread has it selected, it goes back to the default
+//	context first. Other threads can't be switched from here, so if one still has it selected, it isn't destroyed and
+//	this returns false; have them hcn_set_context() to something else, or exit, then try again. Nothing may select it
+//	once this has been called.
+bool hcn_context_destroy(struct HCN_context *context) {
+
+	if (context == NULL || context == &hcn_default_context) return false;
+	if (hcn_current == context) hcn_set_context(NULL);
+	if (context->selected.load() != 0) {
+		hcn_logger(HCN_LOG_ERROR, "hcn_context_destroy(): context still selected by %d other thread(s)", context->selected.load());
+		return false;
+	}
+	delete context;
+	return true;
+}
+
+// hcn_set_context() - Pick the context this thread works on. NULL is the default context. Returns the one it was using.
+struct HCN_context *hcn_set_context(struct HCN_context *context) {
+	struct HCN_context *previous = hcn_current;
+
+	hcn_current = (context == NULL) ? &hcn_default_context : context;
+	if (hcn_current != previous) {
+		if (previous != &hcn_default_context) previous->selected--;
+		if (hcn_current != &hcn_default_context) hcn_current->selected++;
+		hcn_selection.context = hcn_current;
+	}
+	return previous;
+}
+
+// hcn_get_context() - The context this thread is working on.
+struct HCN_context *hcn_get_context() {
+
+	return hcn_current;
+}
+
+// Where vectors for the block callback are being gathered on this thread, while something that handles a lot of
+//	packets at once is running. NULL the rest of the time, and each packet's vectors go as a block of their own.
+static thread_local struct HCN_vector_block *hcn_collecting = NULL;
+
+// How many vectors a batch chunk can keep track of, as a power of two. A chunk of full compact vector packets is about
+//	half of it.
+#define HCN_BATCH_VECTOR_BITS	12
+#define HCN_BATCH_VECTORS	(1 << HCN_BATCH_VECTOR_BITS)
+
+// The newest of each datapoint and vector in a batch chunk, so that older ones can be skipped. Each is the index of the
+//	last packet in the chunk that has it, plus one, or 0 if none do.
+struct HCN_batch_newest {
+	unsigned char datapoint[HCN_MAX_PLAYERS][256];
+	unsigned int vector_key[HCN_BATCH_VECTORS];				// Player, vector type and subject, plus one. 0 is an empty slot.
+	unsigned char vector[HCN_BATCH_VECTORS];
+	int current;								// Index of the packet being handled.
+};
+
+// The batch chunk being handled on this thread. NULL the rest of the time, and everything gets to the application.
+static thread_local struct HCN_batch_newest *hcn_newest = NULL;
+
+static int hcn_view_packed_datapoints(const struct HCN_packet_view *view, struct HCN_wide_datapoint *dps);
+
+// hcn_newest_vector() - Find a vector's slot in a batch chunk's table, or start one if add is set. -1 if it isn't
+//	there, or the table is full. Then it just doesn't replace anything.
+static int hcn_newest_vector(struct HCN_batch_newest *newest, int pi, HCN_vector_type vt, unsigned char subject, bool add) {
+	unsigned int key = ((pi << 16) | (vt << 8) | subject) + 1;
+	unsigned int h = (key * 2654435761u) >> (32 - HCN_BATCH_VECTOR_BITS);
+
+	for (int n = 0; n < HCN_BATCH_VECTORS; n++, h = (h + 1) % HCN_BATCH_VECTORS) {
+		if (newest->vector_key[h] == key) return h;
+		if (newest->vector_key[h] != 0) continue;
+		if (!add) return -1;
+		newest->vector_key[h] = key;
+		newest->vector[h] = 0;
+		return h;
+	}
+	return -1;
+}
+
+// hcn_replaced_datapoint() - Is there a datapoint of this type from this player further on in the batch being handled?
+//	Then this one never gets to the application.
+static inline bool hcn_replaced_datapoint(int player_number, HCN_datapoint_type dp_type) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+
+	return hcn_newest != NULL && hcn_newest->datapoint[pi][dp_type] > hcn_newest->current + 1;
+}
+
+// hcn_replaced_vector() - The same for a vector.
+static inline bool hcn_replaced_vector(int player_number, HCN_vector_type vt, unsigned char subject) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	int slot;
 
-// A little bit of a state machine. Keep track of last state, compared to current state, so we can do certain things when the state changes.
-//	For example, sending client id after the state goes to RUNNING
-HCN_state hcn_last_state[HCN_MAX_PLAYERS];
+	if (hcn_newest == NULL) return false;
+	slot = hcn_newest_vector(hcn_newest, pi, vt, subject, false);
+	return slot >= 0 && hcn_newest->vector[slot] > hcn_newest->current + 1;
+}
+
+// hcn_block_flush() - Hand the block callback what's in a block, and empty it.
+static void hcn_block_flush(struct HCN_vector_block *block) {
+
+	if (block->count > 0 && hcn_current->vector_block_callback != NULL) hcn_current->vector_block_callback(block);
+	block->count = 0;
+}
+
+// hcn_deliver_vector_block() - Hand vectors to the block callback, with whatever else is being gathered, or on their own.
+static void hcn_deliver_vector_block(int player_number, const struct HCN_subject_vector *vectors, int count) {
+	struct HCN_vector_block block;
+	struct HCN_vector_block *to = (hcn_collecting != NULL) ? hcn_collecting : &block;
+	int n;
+
+	block.count = 0;
+	for (int i = 0; i < count; i++) {
+		if (to->count == HCN_VECTOR_BLOCK) hcn_block_flush(to);
+		n = to->count++;
+		to->player_number[n] = player_number;
+		to->vector_type[n] = vectors[i].vector_type;
+		to->subject[n] = vectors[i].subject;
+		to->x[n] = vectors[i].vector.x;
+		to->y[n] = vectors[i].vector.y;
+		to->z[n] = vectors[i].vector.z;
+	}
+	if (to == &block) hcn_block_flush(&block);
+}
+
+// hcn_collect_vectors() - Start gathering vectors into block, so the block callback gets them all together when
+//	hcn_collect_done() is called. False if there's no block callback, or something further up is already gathering.
+static bool hcn_collect_vectors(struct HCN_vector_block *block) {
+
+	if (hcn_current->vector_block_callback == NULL || hcn_collecting != NULL) return false;
+	block->count = 0;
+	hcn_collecting = block;
+	return true;
+}
+
+// hcn_collect_done() - Stop gathering, and hand over what's left.
+static void hcn_collect_done(struct HCN_vector_block *block) {
+
+	hcn_collecting = NULL;
+	hcn_block_flush(block);
+}
+
+// hcn_vector_type_ok() - Can a vector of this type be handed to the application? The vector callback list has to have
+//	an entry for it, unless it's going to the block callback.
+static inline bool hcn_vector_type_ok(HCN_vector_type vt) {
+
+	return vt != 0 && (hcn_current->vector_block_callback != NULL || hcn_current->vector_handlers[vt].handler != NULL);
+}
+
+// hcn_handle_datapoint() - Hand a datapoint to its handler. The type has to have one.
+static inline bool hcn_handle_datapoint(int player_number, HCN_datapoint_type dp_type, const struct HCN_datapoint *dp) {
+	const struct HCN_datapoint_handler *h = &hcn_current->datapoint_handlers[dp_type];
+
+	return h->handler(h->context, player_number, dp_type, (struct HCN_datapoint *)dp);
+}
+
+// hcn_handle_vector() - Hand a vector to its handler.
+static inline bool hcn_handle_vector(int player_number, HCN_vector_type vt, const struct HCN_vect3d *vector) {
+	const struct HCN_vector_handler *h = &hcn_current->vector_handlers[vt];
+
+	return h->handler(h->context, player_number, vt, (struct HCN_vect3d *)vector);
+}
+
+// hcn_player_lock() - The lock for one player's share of the context. It's only held around that player's state, never
+//	while an application callback runs, so a callback can send to anyone without two threads waiting on each other.
+//	Recursive, because sending to a player can end up back in something else that takes the same lock.
+static inline std::recursive_mutex &hcn_player_lock(int player_number) {
 
-// What we are, client or server. And what type.
-HCN_OUR_SIDE hcn_our_side = HCN_WE_ARE_UNKNOWN;
-HCN_SERVER_TYPE hcn_server_type = HCN_NOT_A_SERVER;
-HCN_CLIENT_TYPE hcn_client_type[HCN_MAX_PLAYERS];
+	return hcn_current->player_lock[(player_number == 0) ? 0 : player_number - 1];
+}
+
+// Accessors behind the public names in HCN.h.
+const struct HCN_context_state hcn_state = {};
+
+std::atomic<HCN_state> &HCN_context_state::operator[](int pi) const {
+
+	return hcn_current->state[pi];
+}
 
-// Keep a copy of the other side's handshake packet. This can include version, and other pertinent info.
-struct HCN_handshake hcn_other_side[HCN_MAX_PLAYERS];
+char *hcn_context_our_version() {
 
-// Store our version somewhere.
-char hcn_our_version[HCN_VALUE_LENGTH] = { 0 };
+	return hcn_current->our_version;
+}
 
-// Logger callback function. The application provides this so we can output log information in whatever format the application wants.
-HCN_logger_callback hcn_logger_callback = NULL;
-int hcn_debug_level = HCN_LOG_INFO;
+HCN_OUR_SIDE *hcn_context_our_side() {
 
-// Send packet function, provided by application.
-HCN_application_sender hcn_application_sender = NULL;
+	return &hcn_current->our_side;
+}
 
-// Callbacks to the application for datapoint updates
-struct HCN_datapoint_dispatch *hcn_datapoint_dispatch_list = NULL;
-int hcn_datapoint_dispatch_list_entries = 0;
+HCN_SERVER_TYPE *hcn_context_server_type() {
 
-// Callbacks to the application for vector updates
-struct HCN_vector_dispatch *hcn_vector_dispatch_list = NULL;
-int hcn_vector_dispatch_list_entries = 0;
+	return &hcn_current->server_type;
+}
 
-// Callbacks to the application for various key/value pairs. List is terminated by a NULL set.
-struct HCN_key_dispatch *hcn_key_dispatch_list = NULL;
+HCN_CLIENT_TYPE *hcn_context_client_type() {
 
-// Text packet callbacks.
-struct HCN_text_dispatch *hcn_text_dispatch_list = NULL;
-int hcn_text_dispatch_list_entries = 0;
+	return hcn_current->client_type;
+}
 
 // State types.
 struct HCN_enum_to_string HCN_state_names[] = {
@@ -132,6 +671,36 @@ struct HCN_enum_to_string HCN_client_names[] = {
 	{ -1, NULL}
 };
 
+// Chat classes as enum/string pairs.
+struct HCN_enum_to_string HCN_chat_class_names[] = {
+	{ HCN_CHAT_NOT_HCN, "not HCN"},
+	{ HCN_CHAT_HCN, "HCN"},
+	{ HCN_CHAT_MALFORMED, "malformed"},
+	{ -1, NULL}
+};
+
+// Decode results as enum/string pairs.
+struct HCN_enum_to_string HCN_decode_status_names[] = {
+	{ HCN_DECODE_OK, "ok"},
+	{ HCN_DECODE_WRONG_CHAT_TYPE, "wrong chat type"},
+	{ HCN_DECODE_BAD_MAGIC, "bad magic"},
+	{ HCN_DECODE_TOO_SHORT, "too short"},
+	{ HCN_DECODE_BAD_TYPE, "unknown packet type"},
+	{ HCN_DECODE_BAD_ESCAPE, "bad escape sequence"},
+	{ HCN_DECODE_ENCODED_LENGTH, "encoded length mismatch"},
+	{ HCN_DECODE_LENGTH, "decoded length mismatch"},
+	{ -1, NULL}
+};
+
+// Codecs as enum/string pairs.
+struct HCN_enum_to_string HCN_codec_names[] = {
+	{ HCN_CODEC_AUTO, "auto"},
+	{ HCN_CODEC_SCALAR, "scalar"},
+	{ HCN_CODEC_SSE2, "SSE2"},
+	{ HCN_CODEC_AVX2, "AVX2"},
+	{ -1, NULL}
+};
+
 // Do an enum-to-string lookup.
 char *hcn_enum_to_string(int e_num, HCN_enum_to_string *enum_list) {
 	int i;
@@ -146,56 +715,197 @@ char *hcn_enum_to_string(int e_num, HCN_enum_to_string *enum_list) {
 
 // Set the HCN debug level.
 void hcn_set_debug_level(int level) {
-	hcn_debug_level = level;
+	hcn_current->debug_level = level;
 }
 
 // Get the HCN debug level.
 int hcn_get_debug_level() {
-	return hcn_debug_level;
+	return hcn_current->debug_level;
 }
 
 // Set the HCN logger callback
 void hcn_set_logger_callback(HCN_logger_callback callback) {
 
-	hcn_logger_callback = callback;
+	hcn_current->logger_callback = callback;
 	hcn_logger(HCN_LOG_DEBUG2, "Logger function set");
 }
 
 // Set the packet sender HCN will use.
 void hcn_set_packet_sender(HCN_application_sender application_sender) {
 
-	hcn_application_sender = application_sender;
+	hcn_current->application_sender = application_sender;
 	hcn_logger(HCN_LOG_DEBUG2, "Application packet sender function set");
 }
 
-// Set the datapoint callback list.
+// hcn_call_datapoint_callback() - The handler for callbacks from a datapoint callback list. context is the callback's
+//	slot in the context, so it always calls whatever is there now.
+static bool hcn_call_datapoint_callback(void *context, int player_number, HCN_datapoint_type dp_type, struct HCN_datapoint *dp) {
+
+	return (*(HCN_callback_datapoint *)context)(player_number, dp_type, dp);
+}
+
+// hcn_call_vector_callback() - The same for vector callback lists.
+static bool hcn_call_vector_callback(void *context, int player_number, HCN_vector_type vector_type, struct HCN_vect3d *vector) {
+
+	return (*(HCN_callback_vector *)context)(player_number, vector_type, vector);
+}
+
+// hcn_call_text_callback() - And for text callback lists.
+static bool hcn_call_text_callback(void *context, int player_number, HCN_text_type text_type, struct HCN_text_packet *packet) {
+
+	return (*(HCN_callback_text *)context)(player_number, text_type, packet);
+}
+
+// Set the handler for one datapoint type. context is handed back to it on every call. A NULL handler takes the type
+//	away. False if the type is HCN_DATAPOINT_NOT_DEFINED, that's never a real one.
+bool hcn_set_datapoint_handler(HCN_datapoint_type dp_type, HCN_handler_datapoint handler, void *context) {
+
+	if (dp_type == HCN_DATAPOINT_NOT_DEFINED) return false;
+	hcn_current->datapoint_handlers[dp_type].handler = handler;
+	hcn_current->datapoint_handlers[dp_type].context = context;
+	return true;
+}
+
+// Set the handler for packed datapoints of one type. It gets them all, whatever kind they are. Without one, packed
+//	datapoints that fit in an HCN_datapoint go to the regular handler, and 64-bit ones can't be handled. Datapoints
+//	in regular datapoint packets always go to the regular handler.
+bool hcn_set_wide_datapoint_handler(HCN_datapoint_type dp_type, HCN_handler_wide_datapoint handler, void *context) {
+
+	if (dp_type == HCN_DATAPOINT_NOT_DEFINED) return false;
+	hcn_current->wide_datapoint_handlers[dp_type].handler = handler;
+	hcn_current->wide_datapoint_handlers[dp_type].context = context;
+	return true;
+}
+
+// Set the handler for one vector type.
+bool hcn_set_vector_handler(HCN_vector_type vector_type, HCN_handler_vector handler, void *context) {
+
+	if (vector_type == HCN_VECTOR_NOT_DEFINED) return false;
+	hcn_current->vector_handlers[vector_type].handler = handler;
+	hcn_current->vector_handlers[vector_type].context = context;
+	return true;
+}
+
+// Set the handler for one text type.
+bool hcn_set_text_handler(HCN_text_type text_type, HCN_handler_text handler, void *context) {
+
+	if (text_type == HCN_TEXT_NOT_DEFINED) return false;
+	hcn_current->text_handlers[text_type].handler = handler;
+	hcn_current->text_handlers[text_type].context = context;
+	return true;
+}
+
+// Set the datapoint callback list. It replaces any handlers that were set before. The list goes up to entry
+//	datapoint_list_length, like it always has, but each callback goes with the type in its entry, so the list doesn't
+//	have to be in order, or have every type in it.
 void hcn_set_datapoint_callback_list(HCN_datapoint_dispatch *datapoint_list, int datapoint_list_length) {
+	HCN_datapoint_type dp_type;
 
-	hcn_datapoint_dispatch_list = datapoint_list;
-	hcn_datapoint_dispatch_list_entries = datapoint_list_length;
+	memset(hcn_current->datapoint_handlers, 0, sizeof(hcn_current->datapoint_handlers));
+	for (int i = 0; datapoint_list != NULL && i <= datapoint_list_length; i++) {
+		dp_type = datapoint_list[i].datapoint_type;
+		if (datapoint_list[i].callback == NULL) continue;
+
+		hcn_current->datapoint_callbacks[dp_type] = datapoint_list[i].callback;
+		hcn_set_datapoint_handler(dp_type, hcn_call_datapoint_callback, &hcn_current->datapoint_callbacks[dp_type]);
+	}
 
 }
 
-// Set the vector callback list.
+// Set the vector callback list. The same as the datapoint one.
 void hcn_set_vector_callback_list(HCN_vector_dispatch *vector_list, int vector_list_length) {
+	HCN_vector_type vt;
+
+	memset(hcn_current->vector_handlers, 0, sizeof(hcn_current->vector_handlers));
+	for (int i = 0; vector_list != NULL && i <= vector_list_length; i++) {
+		vt = vector_list[i].vector_type;
+		if (vector_list[i].callback == NULL) continue;
+
+		hcn_current->vector_callbacks[vt] = vector_list[i].callback;
+		hcn_set_vector_handler(vt, hcn_call_vector_callback, &hcn_current->vector_callbacks[vt]);
+	}
+
+}
+
+// hcn_key_hash() - Case insensitive hash of a key, FNV-1a with A-Z folded to a-z. It goes by length, not a null
+//	terminator, so it works on a key right in the packet.
+static inline unsigned int hcn_key_hash(const char *key, int length) {
+	unsigned int hash = 2166136261u;
+	unsigned char c;
+
+	for (int i = 0; i < length; i++) {
+		c = key[i];
+		if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+		hash = (hash ^ c) * 16777619u;
+	}
+	return hash;
+}
 
-	hcn_vector_dispatch_list = vector_list;
-	hcn_vector_dispatch_list_entries = vector_list_length;
+// hcn_key_equal() - Is a key from the key list the same as length characters of a key from a packet, ignoring case.
+static inline bool hcn_key_equal(const char *listed, const char *key, int length) {
 
+	return _strnicmp(listed, key, length) == 0 && listed[length] == 0;
 }
 
-// Set the key/value pair callback list.
+// hcn_key_lookup() - Find a key in the application's key list. NULL if it isn't there. There's always an empty slot
+//	to stop at, since the table is never more than half full.
+static struct HCN_key_dispatch *hcn_key_lookup(const char *key, int length) {
+	struct HCN_key_dispatch *list = hcn_current->key_dispatch_list;
+	unsigned int hash = hcn_key_hash(key, length);
+	const struct HCN_key_slot *slot;
+
+	for (unsigned int s = hash; ; s++) {
+		slot = &hcn_current->key_slots[s & (HCN_KEY_SLOTS - 1)];
+		if (slot->entry == 0) break;
+		if (slot->hash == hash && hcn_key_equal(list[slot->entry - 1].key, key, length)) return &list[slot->entry - 1];
+	}
+
+	for (int i = hcn_current->key_hashed; list[i].key != NULL; i++) {	// Any that didn't fit in the table.
+		if (hcn_key_equal(list[i].key, key, length)) return &list[i];
+	}
+	return NULL;
+}
+
+// Set the key/value pair callback list, and hash the keys. If a key is in the list more than once, the first one wins.
 void hcn_set_keyvalue_callback_list(HCN_key_dispatch *key_list) {
+	struct HCN_key_slot *slot;
+	unsigned int hash;
+	int i, length;
+
+	hcn_current->key_dispatch_list = key_list;
+	hcn_current->key_generation++;						// Numbered keys have to be looked up again.
+	memset(hcn_current->key_slots, 0, sizeof(hcn_current->key_slots));
+
+	for (i = 0; key_list != NULL && key_list[i].key != NULL && i < HCN_KEY_SLOTS / 2; i++) {
+		length = strlen(key_list[i].key);
+		hash = hcn_key_hash(key_list[i].key, length);
+		for (unsigned int s = hash; ; s++) {
+			slot = &hcn_current->key_slots[s & (HCN_KEY_SLOTS - 1)];
+			if (slot->entry == 0 || (slot->hash == hash && hcn_key_equal(key_list[slot->entry - 1].key, key_list[i].key, length))) break;
+		}
+		if (slot->entry != 0) continue;					// Already there.
+
+		slot->hash = hash;
+		slot->entry = i + 1;
+	}
+	hcn_current->key_hashed = i;
 
-	hcn_key_dispatch_list = key_list;
+	if (key_list != NULL && key_list[i].key != NULL) hcn_logger(HCN_LOG_DEBUG, "More than %d keys, the rest aren't hashed", HCN_KEY_SLOTS / 2);
 
 }
 
-// Set the text callback list.
+// Set the text callback list. The same as the datapoint one.
 void hcn_set_text_callback_list(HCN_text_dispatch *text_list, int text_list_length) {
+	HCN_text_type tt;
 
-	hcn_text_dispatch_list = text_list;
-	hcn_text_dispatch_list_entries = text_list_length;
+	memset(hcn_current->text_handlers, 0, sizeof(hcn_current->text_handlers));
+	for (int i = 0; text_list != NULL && i <= text_list_length; i++) {
+		tt = text_list[i].text_type;
+		if (text_list[i].callback == NULL) continue;
+
+		hcn_current->text_callbacks[tt] = text_list[i].callback;
+		hcn_set_text_handler(tt, hcn_call_text_callback, &hcn_current->text_callbacks[tt]);
+	}
 
 }
 
@@ -207,7 +917,7 @@ void hcn_logger(int level, const char *string, ...) {
 
 	va_start(ap, string);
 
-	if (level <= hcn_debug_level) {
+	if (level <= hcn_current->debug_level) {
 		bufptr += sprintf_s(buffer, "HCN: ");					// prepend everything with HCN. If caller wants to, it can interpret this and adjust accordingly (like HSE does).
 
 		// *** For some reason, vsprintf_s crashed HAC2, but not HSE. Further investigation warranted, See BUG id 315
@@ -218,8 +928,8 @@ void hcn_logger(int level, const char *string, ...) {
 			strcpy(buffer, "HCN: vsprintf_s failed");
 		}
 
-		if (hcn_logger_callback != NULL) {					// Don't bother if the callback is not set.
-			hcn_logger_callback(level, buffer);
+		if (hcn_current->logger_callback != NULL) {					// Don't bother if the callback is not set.
+			hcn_current->logger_callback(level, buffer);
 		}
 	}
 
@@ -234,56 +944,123 @@ void hcn_init(char *version) {
 	_CrtSetDebugFillThreshold(0);							// Turn off filling destination buffers with 0xFE for "safe" functions.
 
 	for (int i = 0; i < HCN_MAX_PLAYERS; i++) {
-		hcn_state[i] = HCN_STATE_NONE;
-		hcn_client_type[i] = HCN_NOT_A_CLIENT;
-		memset(&hcn_other_side[i], 0, sizeof(struct HCN_handshake));
+		hcn_current->state[i] = HCN_STATE_NONE;
+		hcn_current->client_type[i] = HCN_NOT_A_CLIENT;
+		memset(&hcn_current->other_side[i], 0, sizeof(struct HCN_handshake));
+		hcn_current->peer_capabilities[i] = 0;
+		hcn_bundle_reset(&hcn_current->bundles[i]);
+		hcn_outbound_reset(&hcn_current->outbound[i]);
+		memset(&hcn_current->outbound[i].stats, 0, sizeof(struct HCN_send_stats));
+		hcn_delta_reset(&hcn_current->delta[i]);
+		hcn_keys_reset(&hcn_current->keys[i]);
+		hcn_current->dr[i].sent_count = hcn_current->dr[i].got_count = 0;
+		hcn_current->player_team[i] = HCN_NO_TEAM;
+	}
+	for (int i = 0; i < 256; i++) {						// Default bounds cover any map. Velocities are per tick, so much smaller.
+		float bound = (i == HCN_VECTOR_BIPED_VELOCITY) ? 16.0f : 1024.0f;
+
+		hcn_current->vector_bounds[i].vector_type = (HCN_vector_type)i;
+		hcn_current->vector_bounds[i].min.x = hcn_current->vector_bounds[i].min.y = hcn_current->vector_bounds[i].min.z = -bound;
+		hcn_current->vector_bounds[i].max.x = hcn_current->vector_bounds[i].max.y = hcn_current->vector_bounds[i].max.z = bound;
 	}
-	strcpy_s(hcn_our_version, version);
-	hcn_logger(HCN_LOG_DEBUG, "HCN initialized, caller version = %s", hcn_our_version);
+	hcn_current->bounds_set = false;
+	hcn_current->pipelining = false;
+	hcn_ring_reset(&hcn_current->inbound_ring);
+	hcn_ring_reset(&hcn_current->outbound_ring);
+	strcpy_s(hcn_current->our_version, version);
+	hcn_set_codec(HCN_CODEC_AUTO);							// Use the fastest encode/decode this CPU can do.
+	hcn_logger(HCN_LOG_DEBUG, "HCN initialized, caller version = %s", hcn_current->our_version);
 		
 }
 
 // hcn_on_tick() - called every tick - doesn't HAVE to be every tick, but it's a prefect place to call it from.
 //	Anything "state machine"-like can be maintained here.
 void hcn_on_tick() {
+	struct HCN_vector_block block;
+	bool collecting = hcn_collect_vectors(&block);				// Everyone's dead reckoning guesses go in one block.
 
-	// for now, this does nothing. yet.
+	struct HCN_subject_vector guesses[HCN_DR_SLOTS];
+	int player_number, n;
 
+	for (int pi = 0; pi < HCN_MAX_PLAYERS; pi++) {				// One player at a time, so nobody waits on the whole tick.
+		{
+			std::lock_guard<std::recursive_mutex> guard(hcn_current->player_lock[pi]);
+
+			hcn_delta_tick(pi);					// Ack any delta vectors we got.
+			n = hcn_dr_tick(pi, guesses, &player_number);		// Guess where things are that we didn't get an update for.
+			if (hcn_current->scheduling) hcn_outbound_drain(pi, false);	// Send what their budget allows.
+		}
+		if (n > 0) hcn_deliver_subject_vectors(player_number, guesses, n);	// Without the lock, the application might send.
+	}
+	if (collecting) hcn_collect_done(&block);
+	if (hcn_current->pipelining) hcn_pipeline_flush();			// Hand the application what the worker sent.
+
+	hcn_current->tick_count++;
+
+}
+
+// Set what we tell the other side we can do in the handshake. Defaults to everything (HCN_CAP_ALL).
+void hcn_set_capabilities(unsigned short capabilities) {
+	hcn_current->our_capabilities = capabilities & HCN_CAP_ALL;
+}
+
+// hcn_advertised_capabilities() - What we can do right now. Some of it depends on what the application has turned on.
+static unsigned short hcn_advertised_capabilities() {
+	unsigned short capabilities = hcn_current->our_capabilities;
+
+	if (!hcn_current->dr_enabled) capabilities &= ~HCN_CAP_DEAD_RECKONING;
+	if (!hcn_current->bounds_set) capabilities &= ~(HCN_CAP_COMPACT_VECTOR | HCN_CAP_DELTA_VECTOR);	// Deltas are compact vectors too.
+	return capabilities;
+}
+
+// Get what both we and the other side can do. Zero until the handshake is done, or if the other side is an older version.
+unsigned short hcn_get_capabilities(int player_number) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+
+	return hcn_current->peer_capabilities[pi];
 }
 
 // hcn_running() - return true if we have an up-and-running HCN connection.
 bool hcn_running(int player_number) {
 	int pi = (player_number == 0) ? 0 : player_number - 1;
 
-	return hcn_state[pi] == HCN_STATE_RUNNING;
+	return hcn_current->state[pi].load(std::memory_order_acquire) == HCN_STATE_RUNNING;
 
 }
 
 // Clear a player's state on quit, or join.
 void hcn_clear_player(int player_number) {
 	int pi = (player_number == 0) ? 0 : player_number - 1;
+	std::lock_guard<std::recursive_mutex> guard(hcn_player_lock(player_number));
 
 	hcn_logger(HCN_LOG_DEBUG2, "Clearing player state player = %d", player_number);
-	hcn_state[pi] = HCN_STATE_NONE;
+	hcn_current->state[pi] = HCN_STATE_NONE;
+	hcn_current->peer_capabilities[pi] = 0;
+	hcn_bundle_reset(&hcn_current->bundles[pi]);
+	hcn_outbound_reset(&hcn_current->outbound[pi]);					// Nothing queued is any good to them now.
+	hcn_delta_reset(&hcn_current->delta[pi]);
+	hcn_keys_reset(&hcn_current->keys[pi]);
+	hcn_current->dr[pi].sent_count = hcn_current->dr[pi].got_count = 0;
+	hcn_current->player_team[pi] = HCN_NO_TEAM;
 
 }
 
 // Set what we are, server or client, and what type of server or client. Overloaded function.
 void hcn_what_we_are(HCN_OUR_SIDE our_side, HCN_CLIENT_TYPE client_type) {
-	hcn_our_side = our_side;
-	hcn_client_type[0] = client_type;					// Since we're a client, we only need to define the first entry in hcn_client_type
+	hcn_current->our_side = our_side;
+	hcn_current->client_type[0] = client_type;					// Since we're a client, we only need to define the first entry in hcn_client_type
 }
 
 void hcn_what_we_are(HCN_OUR_SIDE our_side, HCN_SERVER_TYPE server_type) {
-	hcn_our_side = our_side;
-	hcn_server_type = server_type;
+	hcn_current->our_side = our_side;
+	hcn_current->server_type = server_type;
 }
 
 // hsn_value_bool() - return boolean for key/value pair values.
 bool hcn_value_bool(char *value) {
 
 	// Support all three things - on/off, true/false, 0/1
-	if (_stricmp(value, "on") == 0 || _stricmp(value, "true") || _stricmp(value, "1")) {
+	if (_stricmp(value, "on") == 0 || _stricmp(value, "true") == 0 || _stricmp(value, "1") == 0) {
 		return true;
 	}
 
@@ -302,6 +1079,61 @@ bool hcn_valid_packet(struct HCN_packet *packet, unsigned int chat_type) {
 	return false;
 }
 
+// hcn_known_packet_type() - Is this a packet type we know how to handle?
+static inline bool hcn_known_packet_type(unsigned char packet_type) {
+	return packet_type >= HCN_PACKET_HANDSHAKE && packet_type <= HCN_PACKET_COMPRESSED;
+}
+
+// hcn_classify_chat() - Decide what a chat string is, looking only at the chat type and the raw preamble. Constant time,
+//	so ordinary chat costs next to nothing. HCN_CHAT_HCN doesn't mean the packet is good, only that it's worth decoding.
+HCN_chat_class hcn_classify_chat(int chat_type, const wchar_t *chat) {
+	const struct HCN_preamble *preamble = (const struct HCN_preamble *)chat;
+	HCN_chat_class chat_class = HCN_CHAT_HCN;
+
+	hcn_current->chat_stats.total.fetch_add(1, std::memory_order_relaxed);
+
+	if (chat_type != HCN_CHAT_TYPE || chat[0] != HCN_MAGIC) {
+		hcn_current->chat_stats.not_hcn.fetch_add(1, std::memory_order_relaxed);
+		return HCN_CHAT_NOT_HCN;
+	}
+
+	// Magic # is there, so now sanity check the rest of the preamble. None of it can be encoded, and if
+	//	the string ends inside it, we don't look any further.
+	if (chat[1] == 0 || chat[2] == 0) {
+		chat_class = HCN_CHAT_MALFORMED;
+	}
+	else if (!hcn_known_packet_type(preamble->packet_type & ~HCN_PACKET_ALTERNATE)) {
+		chat_class = HCN_CHAT_MALFORMED;
+	}
+	else if (preamble->encoded_length > HCN_MAX_PACKET_LENGTH / 2) {
+		chat_class = HCN_CHAT_MALFORMED;
+	}
+	else if (preamble->packet_length * 2 < sizeof(struct HCN_preamble) || preamble->packet_length >= preamble->encoded_length) {
+		chat_class = HCN_CHAT_MALFORMED;					// Decoding never makes a packet longer.
+	}
+
+	if (chat_class == HCN_CHAT_MALFORMED) hcn_current->chat_stats.malformed.fetch_add(1, std::memory_order_relaxed);
+	else hcn_current->chat_stats.hcn.fetch_add(1, std::memory_order_relaxed);
+
+	return chat_class;
+}
+
+// Get a copy of the chat classification counters.
+void hcn_get_chat_stats(struct HCN_chat_stats *stats) {
+	stats->total = hcn_current->chat_stats.total;
+	stats->not_hcn = hcn_current->chat_stats.not_hcn;
+	stats->hcn = hcn_current->chat_stats.hcn;
+	stats->malformed = hcn_current->chat_stats.malformed;
+}
+
+// Zero the chat classification counters.
+void hcn_reset_chat_stats() {
+	hcn_current->chat_stats.total = 0;
+	hcn_current->chat_stats.not_hcn = 0;
+	hcn_current->chat_stats.hcn = 0;
+	hcn_current->chat_stats.malformed = 0;
+}
+
 // Some key-value pair functions. Callers must adhere to HCN_KEY_LENGTH/HCN_VALUE_LENGTH limits.
 // ** NOTE - THIS FUNCTION IS DESTRUCTIVE. It will return a pointer to the value, and termnate
 //				the key by overwriting the = character with a zero
@@ -315,64 +1147,79 @@ char *hcn_key_value_parse(char *input) {
 	return p;								// Return a pointer to the value.
 }
 
-// hcn_encode() - Encode a packet, converting wchar_t zeroes to a special sequence. 
-//			NOTE - this function takes a byte packet_length, but returns a wchar_t length.
-//			ALSO - operate on 16-bit characters, with a 16-bit null termination.
-//					And includes that null in the length returned.
-int hcn_encode(struct HCN_packet *packet, struct HCN_packet *source, int packet_length) {
-	wchar_t *p = (wchar_t *)packet;
-	wchar_t *s = (wchar_t *)source;
-	int length = 0;
+// Limits for the zero-encoding, in 16-bit characters. The encoder always leaves room for the null terminator.
+#define HCN_ENCODED_MAX_UNITS	(HCN_MAX_PACKET_LENGTH / 2 - 1)
+#define HCN_DECODED_MAX_UNITS	(HCN_MAX_PACKET_LENGTH / 2)
+#define HCN_PLAIN_UNITS		3					// The first three characters of a packet never need encoding.
 
-	while (length < HCN_MAX_PACKET_LENGTH / 2 && length < ((packet_length / 2) + (packet_length % 2))) {
-		if (*s == 0) {							// If we find a 16-bit zero in the incoming packet,
-			*p++ = HCN_ENCODE_TAG;					// Translate that to a TAG and the ZERO tag.
-			*p++ = HCN_ENCODE_ZERO;
-			s++;
-			length += 2;
-		}
-		else if (*s == HCN_ENCODE_TAG) {				// If we find a 16-bit TAG in the incoming packet,
-			*p++ = HCN_ENCODE_TAG;					// Encode THAT as a special TAG.
-			*p++ = HCN_ENCODE_TAG;
-			s++;
-			length += 2;
-		}
-		else {
-			*p++ = *s++;						// Otherwise, just copy that 16-bit character.
-			length += 1;
-		}
+// Encode/decode kernels. Picked at runtime by hcn_set_codec(), the scalar versions are the reference.
+//	Encoders append to p[length], stop at limit, and return the new length. *consumed gets how much of s they got through.
+typedef int(*HCN_encode_kernel)(wchar_t *p, int length, int limit, const wchar_t *s, int units, int *consumed);
+typedef int(*HCN_decode_kernel)(wchar_t *p, const wchar_t *s, int *consumed);
+
+static int hcn_encode_kernel_scalar(wchar_t *p, int length, int limit, const wchar_t *s, int units, int *consumed);
+static int hcn_decode_kernel_scalar(wchar_t *p, const wchar_t *s, int *consumed);
+
+// Narrow/widen kernels for text, picked along with the others. Narrowing fails if any character isn't Latin-1.
+typedef bool(*HCN_narrow_kernel)(char *p, const wchar_t *s, int count);
+typedef void(*HCN_widen_kernel)(wchar_t *p, const char *s, int count);
+
+static bool hcn_narrow_kernel_scalar(char *p, const wchar_t *s, int count);
+static void hcn_widen_kernel_scalar(wchar_t *p, const char *s, int count);
+
+HCN_codec hcn_codec = HCN_CODEC_SCALAR;
+HCN_encode_kernel hcn_encode_kernel = hcn_encode_kernel_scalar;
+HCN_decode_kernel hcn_decode_kernel = hcn_decode_kernel_scalar;
+HCN_narrow_kernel hcn_narrow_kernel = hcn_narrow_kernel_scalar;
+HCN_widen_kernel hcn_widen_kernel = hcn_widen_kernel_scalar;
+
+// hcn_encode_unit() - Encode a single 16-bit character at p[length]. Returns the new length, or -1 if it doesn't fit.
+static inline int hcn_encode_unit(wchar_t *p, int length, int limit, wchar_t c) {
+
+	if (c == 0 || c == HCN_ENCODE_TAG) {					// Zeroes and tags take two characters,
+		if (length + 2 > limit) return -1;
+		p[length++] = HCN_ENCODE_TAG;
+		p[length++] = (c == 0) ? HCN_ENCODE_ZERO : HCN_ENCODE_TAG;
 	}
-	
-	*p++ = 0;								// Null terminate the output string.
+	else {									// everything else is copied as-is.
+		if (length + 1 > limit) return -1;
+		p[length++] = c;
+	}
+	return length;
+}
+
+// hcn_encode_kernel_scalar() - Reference encoder. One 16-bit character at a time.
+static int hcn_encode_kernel_scalar(wchar_t *p, int length, int limit, const wchar_t *s, int units, int *consumed) {
+	int i, next;
 
-	return p - (wchar_t *)packet;						// This should return the 16-bit character length of the resulting packet
+	for (i = 0; i < units; i++) {
+		if ((next = hcn_encode_unit(p, length, limit, s[i])) < 0) break;	// Out of room.
+		length = next;
+	}
 
+	*consumed = i;
+	return length;
 }
 
-// hcn_decode() - Decode a packet, converting special sequences to normalized 16-bit wchar_t.
-//			NOTE - this function returns a 16-bit byte packet_length
-//			ALSO - takes a string of 16-bit characters, with a 16-bit null termination.
-//					
-int hcn_decode(struct HCN_packet *packet, struct HCN_packet *source) {
-	wchar_t *op = (wchar_t *)packet;
-	wchar_t *p = (wchar_t *)packet;
-	wchar_t *s = (wchar_t *)source;
+// hcn_decode_kernel_scalar() - Reference decoder. One 16-bit character at a time, stops at the null terminator.
+//	Safe to run in place (p == s), the output never gets ahead of the input.
+//	Returns the decoded length, or -1 on a bad escape. *consumed gets the number of encoded characters read.
+static int hcn_decode_kernel_scalar(wchar_t *p, const wchar_t *s, int *consumed) {
+	const wchar_t *start = s;
 	int length = 0;
-	int packet_length = wcslen(s);						// length of encoded packet
 
-	while (length < HCN_MAX_PACKET_LENGTH / 2 && length < packet_length) {
+	while (length < HCN_DECODED_MAX_UNITS && *s != 0) {
 		if (*s == HCN_ENCODE_TAG) {					// If we find the tag for a special sequence in the incoming packet,
 			s++;
 			if (*s == HCN_ENCODE_ZERO) {				// And it's a zero tag,
 				*p++ = 0;					// store a 16-bit zero.
-				packet_length--;				// need to reduce the input source packet length for each encoding.
 			}
 			else if (*s == HCN_ENCODE_TAG) {			// if it's a double sequence tag,
 				*p++ = HCN_ENCODE_TAG;				// store a single sequence tag.
-				packet_length--;				// need to reduce the input source packet length for each encoding.
 			}
 			else {
-				return 0;					// This decode failed. There was garbage in the packet.
+				*consumed = (int)(s - start);
+				return -1;					// This decode failed. There was garbage in the packet.
 			}
 			s++;							// If we got here, it means it was a valid ENCODE 
 		}
@@ -382,399 +1229,4374 @@ int hcn_decode(struct HCN_packet *packet, struct HCN_packet *source) {
 		length++;							// processed a 16-bit character.
 	}
 
+	*consumed = (int)(s - start);
 	return length;
+}
+
+// hcn_narrow_kernel_scalar() - Reference narrower. One character at a time.
+static bool hcn_narrow_kernel_scalar(char *p, const wchar_t *s, int count) {
 
+	for (int i = 0; i < count; i++) {
+		if (s[i] > 0xFF) return false;
+		p[i] = (char)s[i];
+	}
+	return true;
 }
 
-// hcn_packet_sender() - Called to send a packet that has not been encoded yet. We take care of the lengths, encoding, etc.
-//	Supplied length is BYTE
-void hcn_packet_sender(int player_number, HCN_packet *packet, int packet_length) {
-	HCN_preamble *preamble = (HCN_preamble *)packet;			// Get a preamble pointer.
-	HCN_packet encoded_packet;						// We need a place to encode the packet to.
-	HCN_preamble *preamble_encoded = (HCN_preamble *)&encoded_packet;
+// hcn_widen_kernel_scalar() - Reference widener.
+static void hcn_widen_kernel_scalar(wchar_t *p, const char *s, int count) {
 
+	for (int i = 0; i < count; i++) p[i] = (unsigned char)s[i];
+}
+
+#ifdef HCN_SIMD_X86
+
+// Index of the lowest set bit. Only called with a non-zero mask.
+static inline int hcn_ctz(unsigned int mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
 
-	preamble->packet_length = ((packet_length / 2) + (packet_length % 2));	// First, store the unencoded packet length in 8-bit bytes, but on an even boundary.
+// The decoder doesn't know the length up front, so it may only read ahead within the same 4K page.
+static inline bool hcn_can_read_ahead(const wchar_t *s, int bytes) {
+	return ((size_t)s & 4095) <= (size_t)(4096 - bytes);
+}
 
-	preamble_encoded->encoded_length = hcn_encode(&encoded_packet, packet, packet_length);	// Encoded packet length is wchar_t (16-bit bytes).
-	hcn_application_sender(player_number, &encoded_packet);			// Send the packet using the supplied packet sender.
+// hcn_encode_kernel_sse2() - Compare 8 characters at a time against zero and the tag, and bulk copy clean spans.
+static int hcn_encode_kernel_sse2(wchar_t *p, int length, int limit, const wchar_t *s, int units, int *consumed) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i tag = _mm_set1_epi16((short)HCN_ENCODE_TAG);
+	int i = 0, next, clean;
+
+	while (i < units) {
+		if (i + 8 <= units && length + 8 <= limit) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+			unsigned int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi16(v, zero), _mm_cmpeq_epi16(v, tag)));
+
+			if (mask == 0) {					// Nothing to escape, copy all 8.
+				_mm_storeu_si128((__m128i *)(p + length), v);
+				i += 8;
+				length += 8;
+				continue;
+			}
+			for (clean = hcn_ctz(mask) >> 1; clean > 0; clean--) {	// Copy up to the first character that needs escaping.
+				p[length++] = s[i++];
+			}
+		}
+		if ((next = hcn_encode_unit(p, length, limit, s[i])) < 0) break;	// And let the scalar code deal with that one.
+		length = next;
+		i++;
+	}
 
+	*consumed = i;
+	return length;
 }
 
-// hcn_client_start() - Start the handshake from the client-side. Client implies player index 0.
-void hcn_client_start() {
-	struct HCN_handshake handshake;
-	struct HCN_packet *packet = (struct HCN_packet *)&handshake;
-	struct HCN_packet enc_packet;
+// hcn_decode_kernel_sse2() - Find the next tag or terminator 8 characters at a time.
+static int hcn_decode_kernel_sse2(wchar_t *p, const wchar_t *s, int *consumed) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i tag = _mm_set1_epi16((short)HCN_ENCODE_TAG);
+	const wchar_t *start = s;
 	int length = 0;
+	int clean;
+
+	for (;;) {
+		if (length + 8 <= HCN_DECODED_MAX_UNITS && hcn_can_read_ahead(s, 16)) {
+			__m128i v = _mm_loadu_si128((const __m128i *)s);
+			unsigned int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi16(v, zero), _mm_cmpeq_epi16(v, tag)));
+
+			if (mask == 0) {
+				_mm_storeu_si128((__m128i *)(p + length), v);
+				s += 8;
+				length += 8;
+				continue;
+			}
+			for (clean = hcn_ctz(mask) >> 1; clean > 0; clean--) {
+				p[length++] = *s++;
+			}
+		}
 
-	if (hcn_application_sender == NULL) {
-		hcn_logger(HCN_LOG_WARN, "HCN packet sender not set when hcn_client_start() called!");
-		return;
+		if (length >= HCN_DECODED_MAX_UNITS || *s == 0) break;	// Full, or hit the null terminator.
+		if (*s == HCN_ENCODE_TAG) {
+			if (s[1] == HCN_ENCODE_ZERO) p[length] = 0;
+			else if (s[1] == HCN_ENCODE_TAG) p[length] = HCN_ENCODE_TAG;
+			else {
+				*consumed = (int)(s - start);
+				return -1;					// Garbage in the packet.
+			}
+			s += 2;
+		}
+		else {
+			p[length] = *s++;
+		}
+		length++;
 	}
 
-	strcpy_s(handshake.version, sizeof(handshake), hcn_our_version);	// First, copy our version string in.
-	handshake.version[strlen(hcn_our_version) + 1] = 0;			// Double-null terminate that string.
-	length = handshake.size();						// get the length of the base packet without the version string.
-	length += strlen(hcn_our_version);					// Make sure we include the length of the version string.
-	handshake.preamble.packet_type = HCN_PACKET_HANDSHAKE;			// make sure they know it's a handshake.
-	handshake.preamble.packet_length = length;				// Set the packet length.
+	*consumed = (int)(s - start);
+	return length;
+}
+
+// hcn_encode_kernel_avx2() - Same as the SSE2 version, 16 characters at a time.
+HCN_TARGET_AVX2 static int hcn_encode_kernel_avx2(wchar_t *p, int length, int limit, const wchar_t *s, int units, int *consumed) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i tag = _mm256_set1_epi16((short)HCN_ENCODE_TAG);
+	int i = 0, next, clean;
+
+	while (i < units) {
+		if (i + 16 <= units && length + 16 <= limit) {
+			__m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+			unsigned int mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi16(v, zero), _mm256_cmpeq_epi16(v, tag)));
+
+			if (mask == 0) {
+				_mm256_storeu_si256((__m256i *)(p + length), v);
+				i += 16;
+				length += 16;
+				continue;
+			}
+			for (clean = hcn_ctz(mask) >> 1; clean > 0; clean--) {
+				p[length++] = s[i++];
+			}
+		}
+		if ((next = hcn_encode_unit(p, length, limit, s[i])) < 0) break;
+		length = next;
+		i++;
+	}
 
-	handshake.hcn_type = hcn_client_type[0];				// We are whatever we were set to.
-	handshake.hcn_state = HCN_STATE_HANDSHAKE_C2S;				// And this is client-to-server.
+	*consumed = i;
+	return length;
+}
 
-	hcn_packet_sender(0, packet, length);					// Send the packet, encoding it on the fly.
+// hcn_decode_kernel_avx2() - Same as the SSE2 version, 16 characters at a time.
+HCN_TARGET_AVX2 static int hcn_decode_kernel_avx2(wchar_t *p, const wchar_t *s, int *consumed) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i tag = _mm256_set1_epi16((short)HCN_ENCODE_TAG);
+	const wchar_t *start = s;
+	int length = 0;
+	int clean;
+
+	for (;;) {
+		if (length + 16 <= HCN_DECODED_MAX_UNITS && hcn_can_read_ahead(s, 32)) {
+			__m256i v = _mm256_loadu_si256((const __m256i *)s);
+			unsigned int mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi16(v, zero), _mm256_cmpeq_epi16(v, tag)));
+
+			if (mask == 0) {
+				_mm256_storeu_si256((__m256i *)(p + length), v);
+				s += 16;
+				length += 16;
+				continue;
+			}
+			for (clean = hcn_ctz(mask) >> 1; clean > 0; clean--) {
+				p[length++] = *s++;
+			}
+		}
 
-	hcn_other_side[0].hcn_state = HCN_STATE_HANDSHAKE_C2S;			// Record that the other side was sent a Client->Server handshake packet.
+		if (length >= HCN_DECODED_MAX_UNITS || *s == 0) break;
+		if (*s == HCN_ENCODE_TAG) {
+			if (s[1] == HCN_ENCODE_ZERO) p[length] = 0;
+			else if (s[1] == HCN_ENCODE_TAG) p[length] = HCN_ENCODE_TAG;
+			else {
+				*consumed = (int)(s - start);
+				return -1;
+			}
+			s += 2;
+		}
+		else {
+			p[length] = *s++;
+		}
+		length++;
+	}
 
+	*consumed = (int)(s - start);
+	return length;
 }
 
-// hsn_process_chat() - actually process an incoming packet. If return is true, we did work.
-//		*** Assume the chat text (our_packet) is null-terminated because Halo supplies
-//			a typical wchar_t string.
-bool hcn_process_chat(int player_number, int chat_type, wchar_t *our_packet) {
+// hcn_narrow_kernel_sse2() - Check 16 characters at a time for anything above 0xFF, and pack them down to bytes.
+static bool hcn_narrow_kernel_sse2(char *p, const wchar_t *s, int count) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i high = _mm_set1_epi16((short)0xFF00);
 	int i;
-	int pi = (player_number == 0) ? 0 : player_number - 1;
-	char key[HCN_KEYVALUE_LENGTH];
-	char *value;
-	int length, encoded_length;
-	struct HCN_packet packet;
-	struct HCN_packet reply_packet;
-	struct HCN_preamble *encoded_preamble = (struct HCN_preamble *)our_packet;
-	struct HCN_preamble *preamble = (struct HCN_preamble *)&packet;
-	struct HCN_handshake *handshake = (struct HCN_handshake *)&packet;	// get a handshake packet pointer.
-	struct HCN_keyvalue_packet *keyvalue_packet = (HCN_keyvalue_packet *)&packet;// get a keyvalue packet pointer.
-	struct HCN_keyvalue_packet keyvalue;
 
-	encoded_length = wcslen(our_packet);
-	if (encoded_preamble->encoded_length != encoded_length + 1) {		// The preamble is setup specifically so that we can look at it's contents without decoding first.
-		hcn_logger(HCN_LOG_DEBUG, "hcn_process_chat(): length of encoded packet doesn't match - %d vs. %d", encoded_length, encoded_preamble->encoded_length);
+	for (i = 0; i + 16 <= count; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(s + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(s + i + 8));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(_mm_or_si128(a, b), high), zero)) != 0xFFFF) return false;
+		_mm_storeu_si128((__m128i *)(p + i), _mm_packus_epi16(a, b));	// Nothing's over 0xFF, so nothing saturates.
 	}
+	return hcn_narrow_kernel_scalar(p + i, s + i, count - i);
+}
+
+// hcn_widen_kernel_sse2() - Zero extend 16 bytes at a time.
+static void hcn_widen_kernel_sse2(wchar_t *p, const char *s, int count) {
+	const __m128i zero = _mm_setzero_si128();
+	int i;
 
-	length = hcn_decode(&packet, (struct HCN_packet *)our_packet);		// Now, hcn_decode it.
+	for (i = 0; i + 16 <= count; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
 
-	if (length != preamble->packet_length) {
-		hcn_logger(HCN_LOG_DEBUG, "hcn_process_chat(): length of decoded packet doesn't match - %d vs. %d", length, preamble->packet_length);
-		return false;
+		_mm_storeu_si128((__m128i *)(p + i), _mm_unpacklo_epi8(v, zero));
+		_mm_storeu_si128((__m128i *)(p + i + 8), _mm_unpackhi_epi8(v, zero));
 	}
+	hcn_widen_kernel_scalar(p + i, s + i, count - i);
+}
 
-	if (!hcn_valid_packet(&packet, chat_type)) {
-		hcn_logger(HCN_LOG_DEBUG, "hcn_process_chat(): Invalid packet received");
-		return false;
+// hcn_narrow_kernel_avx2() - Same as the SSE2 version, 32 characters at a time.
+HCN_TARGET_AVX2 static bool hcn_narrow_kernel_avx2(char *p, const wchar_t *s, int count) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i high = _mm256_set1_epi16((short)0xFF00);
+	int i;
+
+	for (i = 0; i + 32 <= count; i += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(s + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(s + i + 16));
+
+		if ((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_and_si256(_mm256_or_si256(a, b), high), zero)) != 0xFFFFFFFF) return false;
+		_mm256_storeu_si256((__m256i *)(p + i), _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8));	// Packing is per 128-bit lane, put them back in order.
 	}
+	return hcn_narrow_kernel_sse2(p + i, s + i, count - i);
+}
 
-	hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): got a valid packet");
+// hcn_widen_kernel_avx2() - Zero extend 16 bytes at a time, in one go.
+HCN_TARGET_AVX2 static void hcn_widen_kernel_avx2(wchar_t *p, const char *s, int count) {
+	int i;
 
-	// Decode packet type
-	switch (preamble->packet_type) {
-		
-	// Handle handshake packets
-	case HCN_PACKET_HANDSHAKE:
-		hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a handshake packet");
+	for (i = 0; i + 16 <= count; i += 16) {
+		_mm256_storeu_si256((__m256i *)(p + i), _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(s + i))));
+	}
+	hcn_widen_kernel_scalar(p + i, s + i, count - i);
+}
 
-		switch (hcn_our_side) {						// Server or client, we need to make decisions.
-		case HCN_SERVER:						// We are a server.
-			hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): We are a SERVER and got a packet from a client");
-			if (handshake->hcn_state == HCN_STATE_HANDSHAKE_C2S) {	// This is a client talking to us, who wants to go to state RUNNING
-				hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a client calling in, player_number %d", player_number);
-				hcn_state[pi] = HCN_STATE_RUNNING;		// Set the current state of this client to running.
-				//hcn_other_side[pi] = *handshake;		// And keep a copy of the handshake packet.
-				memcpy(&hcn_other_side[pi], handshake, handshake->size() + strlen(handshake->version) + 1); // copy out just the part we need.
+// CPU feature checks for the kernels above.
+static bool hcn_cpu_has_sse2() {
+#if defined(_M_X64) || defined(__x86_64__)
+	return true;								// Always there on x64.
+#elif defined(_MSC_VER)
+	int regs[4];
+
+	__cpuid(regs, 1);
+	return (regs[3] & (1 << 26)) != 0;
+#else
+	return __builtin_cpu_supports("sse2");
+#endif
+}
 
-				// Setup our reply.
-				handshake->hcn_state = HCN_STATE_HANDSHAKE_S2C;	// tell the client that our state is Server->Client
-				handshake->hcn_type = hcn_server_type;		// make sure we tell the client what we are.
-				
-				strcpy(handshake->version, hcn_our_version);
-				hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Sending back a handshake with state %d", handshake->hcn_state);
+static bool hcn_cpu_has_avx2() {
+#ifdef _MSC_VER
+	int regs[4];
+
+	__cpuid(regs, 0);
+	if (regs[0] < 7) return false;
+	__cpuid(regs, 1);
+	if ((regs[2] & (1 << 27)) == 0 || (regs[2] & (1 << 28)) == 0) return false; // Need OSXSAVE and AVX,
+	if ((_xgetbv(0) & 6) != 6) return false;				// and the OS has to save the YMM registers.
+	__cpuidex(regs, 7, 0);
+	return (regs[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
 
-				hcn_logger(HCN_LOG_DEBUG, "Client version %s %s", hcn_enum_to_string(hcn_other_side[pi].hcn_type, HCN_client_names), hcn_other_side[pi].version);
+#endif // HCN_SIMD_X86
 
-				length = handshake->size() + strlen(handshake->version) + 1; // Compute the un-encoded length in 8-bit bytes.
+// hcn_set_codec() - Pick the encode/decode kernels. HCN_CODEC_AUTO picks the best the CPU supports, and asking
+//	for something the CPU can't do falls back the same way. Returns what was actually selected.
+HCN_codec hcn_set_codec(HCN_codec codec) {
+	HCN_codec best = HCN_CODEC_SCALAR;
 
-				hcn_packet_sender(player_number, &packet, length); // Send it.
+#ifdef HCN_SIMD_X86
+	if (hcn_cpu_has_avx2()) best = HCN_CODEC_AVX2;
+	else if (hcn_cpu_has_sse2()) best = HCN_CODEC_SSE2;
+#endif
 
-				return true;					// and tell the caller we did something.
-			}
-			else {
-				hcn_logger(HCN_LOG_DEBUG, "hcn_process_chat(): SERVER got an unknown state %d - going idle", handshake->hcn_state);
-				hcn_state[pi] = HCN_STATE_NONE;			// MISSION ABORT! We got something unexpected from the client.
-			}
-			break;;
-		case HCN_CLIENT:
-			hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): We are a CLIENT and got a packet from a server");
+	if (codec == HCN_CODEC_AUTO || codec > best) codec = best;
 
-			if (handshake->hcn_state == HCN_STATE_HANDSHAKE_S2C && hcn_other_side[0].hcn_state==HCN_STATE_HANDSHAKE_C2S) { // This is from a server, so check the "other side's" state.
-				hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a server calling in");
-				hcn_state[0] = HCN_STATE_RUNNING;		// we got back a handshake from the server, so we're running.
-				hcn_other_side[0] = *handshake;			// And keep a copy of the handshake packet.
-				hcn_other_side[0].hcn_state = HCN_STATE_RUNNING;// Set our copy of the handshake for this server, to state=RUNNING.
+	switch (codec) {
+#ifdef HCN_SIMD_X86
+	case HCN_CODEC_AVX2:
+		hcn_encode_kernel = hcn_encode_kernel_avx2;
+		hcn_decode_kernel = hcn_decode_kernel_avx2;
+		hcn_narrow_kernel = hcn_narrow_kernel_avx2;
+		hcn_widen_kernel = hcn_widen_kernel_avx2;
+		break;;
+	case HCN_CODEC_SSE2:
+		hcn_encode_kernel = hcn_encode_kernel_sse2;
+		hcn_decode_kernel = hcn_decode_kernel_sse2;
+		hcn_narrow_kernel = hcn_narrow_kernel_sse2;
+		hcn_widen_kernel = hcn_widen_kernel_sse2;
+		break;;
+#endif
+	default:
+		codec = HCN_CODEC_SCALAR;
+		hcn_encode_kernel = hcn_encode_kernel_scalar;
+		hcn_decode_kernel = hcn_decode_kernel_scalar;
+		hcn_narrow_kernel = hcn_narrow_kernel_scalar;
+		hcn_widen_kernel = hcn_widen_kernel_scalar;
+		break;;
+	}
 
-				hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got handshake from server");
+	hcn_codec = codec;
+	hcn_logger(HCN_LOG_DEBUG2, "Codec set to %s", hcn_enum_to_string(codec, HCN_codec_names));
+	return codec;
+}
 
-				hcn_logger(HCN_LOG_DEBUG, "Server version %s %s", hcn_enum_to_string(hcn_other_side[pi].hcn_type, HCN_server_names), hcn_other_side[pi].version);
+// Get the codec currently in use.
+HCN_codec hcn_get_codec() {
+	return hcn_codec;
+}
 
-				return true;					// we did something, YAY!
-			}
-			else {
-				hcn_logger(HCN_LOG_DEBUG, "hcn_process_chat(): CLIENT got an unknown state %d - going idle", handshake->hcn_state);
-				hcn_state[0] = HCN_STATE_NONE;			// MISSION ABORT! We got something unexpected from the server
-				return false;
-			}
-			break;;
+// hcn_encode() - Encode a packet, converting wchar_t zeroes to a special sequence. 
+//			NOTE - this function takes a byte packet_length, but returns a wchar_t length.
+//			ALSO - operate on 16-bit characters, with a 16-bit null termination.
+//					And includes that null in the length returned.
+//			If the encoded packet won't fit in HCN_MAX_PACKET_LENGTH, it's truncated.
+int hcn_encode(struct HCN_packet *packet, struct HCN_packet *source, int packet_length) {
+	wchar_t *p = (wchar_t *)packet;
+	int consumed;
+	int length = hcn_encode_kernel(p, 0, HCN_ENCODED_MAX_UNITS, (const wchar_t *)source, (packet_length / 2) + (packet_length % 2), &consumed);
 
-		}
-		break;;
+	p[length++] = 0;							// Null terminate the output string.
+	return length;
+}
 
-	// Datapoints.
-	case HCN_PACKET_DATAPOINT:
-		hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a list of datapoint values");
-		return hcn_datapoint_packet_handler(player_number, &packet);
-		break;;
+// hcn_decode() - Decode a packet, converting special sequences to normalized 16-bit wchar_t.
+//			NOTE - this function returns a 16-bit byte packet_length
+//			ALSO - takes a string of 16-bit characters, with a 16-bit null termination.
+//					
+int hcn_decode(struct HCN_packet *packet, struct HCN_packet *source) {
+	int consumed;
+	int length = hcn_decode_kernel((wchar_t *)packet, (const wchar_t *)source, &consumed);
 
-	// Vector updates.
-	case HCN_PACKET_VECTOR:
-		hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a list of vector values");
-		return hcn_vector_packet_handler(player_number, &packet);
-		break;;
+	return (length < 0) ? 0 : length;
+}
 
+// Scalar reference versions of hcn_encode()/hcn_decode(), regardless of the codec selected.
+int hcn_encode_scalar(struct HCN_packet *packet, struct HCN_packet *source, int packet_length) {
+	wchar_t *p = (wchar_t *)packet;
+	int consumed;
+	int length = hcn_encode_kernel_scalar(p, 0, HCN_ENCODED_MAX_UNITS, (const wchar_t *)source, (packet_length / 2) + (packet_length % 2), &consumed);
 
-	// Keyvalue pair.
-	case HCN_PACKET_KEYVALUE:
-		hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a keyvalue packet");
+	p[length++] = 0;
+	return length;
+}
 
-		if (keyvalue_packet->keyvalue_length == strlen(keyvalue_packet->keyvalue) + 1) {
+int hcn_decode_scalar(struct HCN_packet *packet, struct HCN_packet *source) {
+	int consumed;
+	int length = hcn_decode_kernel_scalar((wchar_t *)packet, (const wchar_t *)source, &consumed);
 
-			hcn_logger(HCN_LOG_DEBUG2, "keyvalue = %s for player %d", keyvalue_packet->keyvalue, player_number);
+	return (length < 0) ? 0 : length;
+}
 
-			// See if we have a callback for this key/value pair.
-			if (hcn_key_dispatch_list != NULL) {
-				
-				memcpy(&keyvalue, keyvalue_packet, sizeof(struct HCN_preamble) + keyvalue_packet->keyvalue_length + 1); // copy out just the part we need.
+// hcn_narrow() - Narrow count UTF-16 characters to 8 bits, the way narrowed text goes out. False if any of them isn't
+//	Latin-1, and then narrow is left half done.
+bool hcn_narrow(char *narrow, const wchar_t *text, int count) {
 
-				value = hcn_key_value_parse(keyvalue.keyvalue);	// Break the key/value in two.
-				for (i = 0; hcn_key_dispatch_list[i].key != NULL; i++) {
-					if (stricmp(hcn_key_dispatch_list[i].key, keyvalue.keyvalue) == 0) {
-						hcn_key_dispatch_list[i].callback(player_number, keyvalue.keyvalue, value);
-						return true;
-					}
-				}
-			}
-			else {
-				hcn_logger(HCN_LOG_WARN, "HCN got a keyvalue but the application hasn't defined a list of keyvalues");
-				return false;
-			}
+	return hcn_narrow_kernel(narrow, text, count);
+}
 
-		}
-		else {
-			hcn_logger(HCN_LOG_DEBUG, "keyvalue length did not match actual length - sent=%d, keyvalue=%d", keyvalue.keyvalue_length, strlen(keyvalue.keyvalue));
-			return false;
-		}
-		break;;
+// hcn_widen() - Widen count 8-bit characters back to UTF-16.
+void hcn_widen(wchar_t *text, const char *narrow, int count) {
 
-	// Text packet
-	case HCN_PACKET_TEXT:
-		hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a text packet");
-		return hcn_text_packet_handler(player_number, &packet);
-		break;;
+	hcn_widen_kernel(text, narrow, count);
+}
 
-	}
+// Scalar reference versions of hcn_narrow()/hcn_widen(), regardless of the codec selected.
+bool hcn_narrow_scalar(char *narrow, const wchar_t *text, int count) {
 
-	return false;
+	return hcn_narrow_kernel_scalar(narrow, text, count);
 }
 
-// hcn_datapoint_packet_handler() - Decode a datapoint packet. Assume the packet has already been decoded and verified.
-bool hcn_datapoint_packet_handler(int player_number, HCN_packet *packet) {
-	int i;
-	HCN_datapoint_type dp_type;
-	HCN_datapoint_packet *dps = (HCN_datapoint_packet *)packet;
+void hcn_widen_scalar(wchar_t *text, const char *narrow, int count) {
 
-	for (i = 0; i < HCN_MAX_DATAPOINTS && i < dps->dp_count; i++) {
-		dp_type = dps->dps[i].dp_type;
-		if (dp_type == 0 || dp_type > hcn_datapoint_dispatch_list_entries) {
-			hcn_logger(HCN_LOG_DEBUG, "Invalid datapoint type %d", dp_type);
-			return false;						// ABORT if the datapoint type is unknown. Chances are the rest of the packet is bad anyway.
-		}
-		hcn_datapoint_dispatch_list[dp_type].callback(player_number, dp_type, &dps->dps[i]); // Call the application's handler for this vector type.
+	hcn_widen_kernel_scalar(text, narrow, count);
+}
+
+// hcn_decode_packet() - Decode and validate a chat string in a single pass. The chat type, magic # and packet type
+//	are checked from the raw preamble before anything is decoded, then the decoder stops at the null terminator,
+//	and both lengths are checked against the preamble. On failure, status says why and the lengths are whatever
+//	was seen, so the caller can log them without looking at the data again.
+HCN_decode_result hcn_decode_packet(struct HCN_packet *packet, const wchar_t *source, int chat_type) {
+	HCN_decode_result result = { HCN_DECODE_OK, 0, 0 };
+	struct HCN_preamble *preamble = (struct HCN_preamble *)packet;
+	const struct HCN_preamble *encoded_preamble = (const struct HCN_preamble *)source;
+	int consumed;
+
+	if (chat_type != HCN_CHAT_TYPE) {
+		result.status = HCN_DECODE_WRONG_CHAT_TYPE;
+		return result;
 	}
-	return true;
 
-}
+	// The first three 16-bit characters of the preamble can never need encoding, so they're good as-is.
+	if (source[0] != HCN_MAGIC) {
+		result.status = HCN_DECODE_BAD_MAGIC;
+		return result;
+	}
+	if (source[1] == 0 || source[2] == 0) {
+		result.status = HCN_DECODE_TOO_SHORT;
+		return result;
+	}
+	if (!hcn_known_packet_type(encoded_preamble->packet_type & ~HCN_PACKET_ALTERNATE)) {
+		result.status = HCN_DECODE_BAD_TYPE;
+		return result;
+	}
 
-// hcn_vector_packet_handler() - Decode a vector packet. Assume the packet has already been decoded and verified.
-bool hcn_vector_packet_handler(int player_number, HCN_packet *packet) {
-	int i;
-	HCN_vector_type vt;
-	HCN_vector_packet *vectors = (HCN_vector_packet *)packet;
+	result.length = hcn_decode_kernel((wchar_t *)packet, source, &consumed);
+	result.encoded_length = consumed + 1;					// Count the null terminator, same as the sender.
 
-	for (i = 0; i < HCN_MAX_VECTORS && i < vectors->vector_count; i++) {
-		vt = vectors->vectors[i].vector_type;
-		if (vt == 0 || vt > hcn_vector_dispatch_list_entries) {
-			hcn_logger(HCN_LOG_DEBUG, "Invalid vector type %d", vt);
-			return false;						// ABORT if the vector type is unknown. Chances are the rest of the packet is bad anyway.
-		}
-		hcn_vector_dispatch_list[vt].callback(player_number, vt, &vectors->vectors[i].vector); // Call the application's handler for this vector type.
+	if (result.length < 0) {
+		result.status = HCN_DECODE_BAD_ESCAPE;
+		result.length = 0;
+	}
+	else if (result.encoded_length != preamble->encoded_length) {
+		result.status = HCN_DECODE_ENCODED_LENGTH;
+	}
+	else if (result.length != preamble->packet_length) {
+		result.status = HCN_DECODE_LENGTH;
+	}
+	else if (preamble->packet_type & HCN_PACKET_ALTERNATE) {		// Undo the XOR, past the part that's never encoded.
+		wchar_t *p = (wchar_t *)packet;
+
+		for (int i = HCN_PLAIN_UNITS; i < result.length; i++) p[i] ^= HCN_ENCODE_XOR;
+		preamble->packet_type &= ~HCN_PACKET_ALTERNATE;
 	}
-	return true;
 
+	return result;
 }
 
-// hcn_text_packet_handler() - Deal with text packets.
-bool hcn_text_packet_handler(int player_number, HCN_packet *packet) {
-	int i;
-	HCN_text_type tt;
-	HCN_text_packet *tp = (HCN_text_packet *)packet;
+// HCN_writer - Serializes packet fields and zero-encodes them on the fly, straight into the outbound chat buffer.
+//	Fields don't have to line up with 16-bit characters, an odd byte is held until the next one shows up. If the other
+//	side takes HCN_PACKET_ALTERNATE, the packet is held back instead, and what each encoding would cost is counted as
+//	it goes. hcn_writer_end() encodes it once, whichever way is shorter.
+struct HCN_writer {
+	wchar_t *out;								// Where the encoded packet goes.
+	int limit;								// Max encoded length, not counting the null terminator.
+	int length;								// Encoded 16-bit characters so far.
+	int bytes;								// Un-encoded bytes so far.
+	int packet_length;							// Un-encoded bytes we were told to expect.
+	unsigned char odd;							// First half of a 16-bit character, when bytes is odd.
+	bool overflow;								// Ran out of room.
+	bool alternate;								// The other side takes HCN_PACKET_ALTERNATE, use it if it's shorter.
+	int alternate_length;							// Encoded length so far with HCN_PACKET_ALTERNATE, when alternate.
+	int units;								// 16-bit characters held in plain, when alternate.
+	wchar_t plain[HCN_DECODED_MAX_UNITS];
+	struct HCN_ring_slot *slot;						// Outbound ring slot it's in, when pipelining.
+};
 
-	tt = tp->text_type;
-	if (tt == 0 || tt > hcn_text_dispatch_list_entries) {
-		hcn_logger(HCN_LOG_DEBUG, "Invalid text type %d", tt);
-		return false;						// ABORT if the vector type is unknown. Chances are the rest of the packet is bad anyway.
+// hcn_writer_hold() - Hold on to 16-bit characters for the alternate encoding, and count what each encoding would take.
+//	Zeroes and tags take two characters. With HCN_PACKET_ALTERNATE, that's whatever XORs to one, past the preamble.
+static void hcn_writer_hold(struct HCN_writer *w, const wchar_t *s, int units) {
+	wchar_t c, x;
+
+	if (w->units + units > HCN_DECODED_MAX_UNITS) {
+		w->overflow = true;
+		return;
 	}
-	hcn_text_dispatch_list[tt].callback(player_number, tt, tp);	// Call the application's handler for this text type.
-	return true;
+	memcpy(w->plain + w->units, s, units * sizeof(wchar_t));
 
+	for (int i = 0; i < units; i++, w->units++) {
+		c = s[i];
+		x = (w->units < HCN_PLAIN_UNITS) ? c : (wchar_t)(c ^ HCN_ENCODE_XOR);
+		w->length += (c == 0 || c == HCN_ENCODE_TAG) ? 2 : 1;
+		w->alternate_length += (x == 0 || x == HCN_ENCODE_TAG) ? 2 : 1;
+	}
 }
-// hcn_send_datapoints() - allow an application to provide a list of datapoints, and send them to the other side.
-bool hcn_send_datapoints(int player_number, struct HCN_datapoint *dps, int dp_count) {
-	int i, length;
-	struct HCN_datapoint_packet dp_packet;
-	struct HCN_packet *packet = (HCN_packet *)&dp_packet;
 
-	if (dp_count > HCN_MAX_DATAPOINTS) return false;			// make sure we're not asked to send too many.
+// hcn_writer_unit() - Encode one 16-bit character.
+static void hcn_writer_unit(struct HCN_writer *w, wchar_t c) {
+	int next;
 
-	// Find the length of the datapoint packet without any datapoints in it. This allows us to have a variable-length packet
-	//	dependent on how many datapoints we're supplied.
-	length = sizeof(struct HCN_datapoint_packet) - (sizeof(HCN_datapoint) * HCN_MAX_DATAPOINTS);
+	if (w->overflow) return;
+	if (w->alternate) hcn_writer_hold(w, &c, 1);
+	else if ((next = hcn_encode_unit(w->out, w->length, w->limit, c)) < 0) w->overflow = true;
+	else w->length = next;
+}
+
+// hcn_writer_put() - Add some bytes to the packet. Whole 16-bit characters go through the encode kernel.
+static void hcn_writer_put(struct HCN_writer *w, const void *data, int bytes) {
+	const unsigned char *d = (const unsigned char *)data;
+	int units, consumed;
 
-	dp_packet.preamble.packet_type = HCN_PACKET_DATAPOINT;			// Set the packet type.
+	if (bytes <= 0) return;
 
-	for (i = 0; i < HCN_MAX_DATAPOINTS && i < dp_count; i++) {		// Loop through the vectors provided to us.
-		dp_packet.dps[i] = dps[i];					// Copy out the datapoint.
-		length += sizeof(HCN_datapoint);				// Keep track of the length.
+	if (w->bytes & 1) {							// Finish off a half-written character first.
+		hcn_writer_unit(w, (wchar_t)(w->odd | (d[0] << 8)));
+		d++;
+		bytes--;
+		w->bytes++;
 	}
 
-	dp_packet.dp_count = dp_count;						// Set the datapoint count.
+	units = bytes / 2;
+	if (units > 0 && !w->overflow && w->alternate) {
+		hcn_writer_hold(w, (const wchar_t *)d, units);
+	}
+	else if (units > 0 && !w->overflow) {
+		w->length = hcn_encode_kernel(w->out, w->length, w->limit, (const wchar_t *)d, units, &consumed);
+		if (consumed < units) w->overflow = true;
+	}
+	d += units * 2;
+	w->bytes += units * 2;
 
-	hcn_packet_sender(player_number, packet, length);			// Send it.
+	if (bytes & 1) {							// Hang on to a trailing odd byte.
+		w->odd = *d;
+		w->bytes++;
+	}
+}
 
-	return true;
+static inline void hcn_writer_put_byte(struct HCN_writer *w, unsigned char c) {
+	hcn_writer_put(w, &c, 1);
+}
 
+// hcn_writer_begin() - Start a packet, writing the preamble. packet_length is the un-encoded length in bytes. If
+//	alternate is set, the other side takes HCN_PACKET_ALTERNATE.
+static void hcn_writer_begin(struct HCN_writer *w, wchar_t *out, int limit, HCN_packet_type type, int packet_length, bool alternate) {
+	struct HCN_preamble preamble;
+
+	w->out = out;
+	w->limit = limit;
+	w->length = 0;
+	w->bytes = 0;
+	w->packet_length = packet_length;
+	w->odd = 0;
+	w->overflow = false;
+	w->alternate = alternate;
+	w->alternate_length = 0;
+	w->units = 0;
+	w->slot = NULL;
+
+	preamble.packet_type = type;
+	preamble.packet_length = (packet_length / 2) + (packet_length % 2);	// In 16-bit characters.
+	preamble.encoded_length = 1;						// Placeholder until we know. Non-zero, so that part of the preamble never gets encoded.
+	hcn_writer_put(w, &preamble, sizeof(struct HCN_preamble));
 }
 
-// hcn_send_vectors() - allow an application to provide a list of vectors, and send them to the other side.
-bool hcn_send_vectors(int player_number, struct HCN_vector *vectors, int vector_count) {
-	int i, length;
-	struct HCN_vector_packet vp;
-	struct HCN_packet *packet = (HCN_packet *)&vp;
+// hcn_writer_encode() - Encode a packet that was held back for the alternate encoding, whichever way is shorter.
+//	Returns the encoded length, or -1 if neither fits.
+static int hcn_writer_encode(struct HCN_writer *w) {
+	bool alternate = w->alternate_length < w->length;
+	int length, consumed;
 
-	if (vector_count > HCN_MAX_VECTORS) return false;			// make sure we're not asked to send too many.
+	if ((alternate ? w->alternate_length : w->length) > w->limit) return -1;
 
-	// Find the length of the vector packet without any vectors in it. This allows us to have a variable-length packet
-	//	dependent on how many vectors we're supplied.
-	length = sizeof(struct HCN_vector_packet) - (sizeof(HCN_vector) * HCN_MAX_VECTORS);
+	if (alternate) {
+		for (int i = HCN_PLAIN_UNITS; i < w->units; i++) w->plain[i] ^= HCN_ENCODE_XOR;
+	}
+	length = hcn_encode_kernel(w->out, 0, w->limit, w->plain, w->units, &consumed);
+	if (alternate) ((struct HCN_preamble *)w->out)->packet_type |= HCN_PACKET_ALTERNATE;
+	return length;
+}
 
-	vp.preamble.packet_type = HCN_PACKET_VECTOR;				// Set the packet type.
+// hcn_writer_end() - Finish the packet. Returns the encoded length including the null terminator, or 0 if it didn't fit.
+static int hcn_writer_end(struct HCN_writer *w) {
 
-	for (i = 0; i < HCN_MAX_VECTORS && i < vector_count; i++) {		// Loop through the vectors provided to us.
-		vp.vectors[i] = vectors[i];					// Copy out the vector.
-		length += sizeof(HCN_vector);					// Keep track of the length.
+	if (w->bytes & 1) {							// Pad out the last character.
+		hcn_writer_unit(w, w->odd);
+		w->bytes++;
 	}
 
-	vp.vector_count = vector_count;						// make sure we have a vector count.
+	if (w->overflow || w->bytes != w->packet_length + (w->packet_length % 2)) return 0;
+	if (w->alternate && (w->length = hcn_writer_encode(w)) < 0) return 0;
 
-	hcn_packet_sender(player_number, packet, length);			// Send the raw packet.
+	w->out[w->length++] = 0;						// Null terminate,
+	((struct HCN_preamble *)w->out)->encoded_length = w->length;		// and fill in the real encoded length. That part of the preamble is never encoded.
+	return w->length;
+}
 
-	return true;
+// Every fixed-size packet has to fit, even if every 16-bit character needs encoding. Text can't promise that, so
+//	hcn_send_text() fails if a long string with a lot of encoding doesn't fit.
+static_assert(HCN_HANDSHAKE_MAX_ENCODED <= HCN_MAX_PACKET_LENGTH / 2, "Handshake packet can encode too long");
+static_assert(HCN_DATAPOINT_MAX_ENCODED <= HCN_MAX_PACKET_LENGTH / 2, "Datapoint packet can encode too long");
+static_assert(HCN_VECTOR_MAX_ENCODED <= HCN_MAX_PACKET_LENGTH / 2, "Vector packet can encode too long");
+static_assert(HCN_KEYVALUE_MAX_ENCODED <= HCN_MAX_PACKET_LENGTH / 2, "Keyvalue packet can encode too long");
+static_assert(HCN_COMPACT_VECTOR_MAX_ENCODED <= HCN_MAX_PACKET_LENGTH / 2, "Compact vector packet can encode too long");
+static_assert(HCN_KEY_ID_MAX_ENCODED <= HCN_MAX_PACKET_LENGTH / 2, "Key number packet can encode too long");
+static_assert(HCN_TYPED_KEYVALUE_MAX_ENCODED <= HCN_MAX_PACKET_LENGTH / 2, "Typed keyvalue packet can encode too long");
+static_assert(HCN_PACKED_DATAPOINT_MAX_ENCODED <= HCN_MAX_PACKET_LENGTH / 2, "Packed datapoint packet can encode too long");
+static_assert(HCN_MAX_PACKED_DATAPOINTS <= 255, "Packed datapoint count has to fit in a byte");
+static_assert(HCN_COMPRESSED_MAX_ENCODED <= HCN_MAX_PACKET_LENGTH / 2, "Compressed packet can encode too long");
+static_assert(HCN_KEY_IDS <= 255 && HCN_KEY_ID_SPACE <= 0xFFFF, "Key numbers have to fit in a byte, offsets in a short");
+static_assert((sizeof(struct HCN_preamble) + 1) % 2 == 0 && sizeof(struct HCN_compact_vector) % 2 == 0, "Compact vectors have to be 16-bit aligned");
+
+// The schemas have to describe the packet structs the application sees.
+static_assert(HCN_handshake_schema::max_length() == sizeof(struct HCN_handshake) + sizeof(unsigned short), "Handshake schema doesn't match HCN_handshake");
+static_assert(HCN_datapoint_schema::max_length() == sizeof(struct HCN_datapoint_packet), "Datapoint schema doesn't match HCN_datapoint_packet");
+static_assert(HCN_vector_schema::max_length() == sizeof(struct HCN_vector_packet), "Vector schema doesn't match HCN_vector_packet");
+static_assert(HCN_compact_vector_schema::max_length() == sizeof(struct HCN_compact_vector_packet), "Compact vector schema doesn't match HCN_compact_vector_packet");
+static_assert(HCN_keyvalue_schema::max_length() == sizeof(struct HCN_keyvalue_packet), "Keyvalue schema doesn't match HCN_keyvalue_packet");
+static_assert(HCN_text_schema::max_length() == sizeof(struct HCN_text_packet), "Text schema doesn't match HCN_text_packet");
+static_assert(HCN_MAX_DATAPOINTS <= 255 && HCN_MAX_VECTORS <= 255 && HCN_MAX_COMPACT_VECTORS <= 255, "Counts have to fit in their one byte head");
+
+// hcn_send_begin() - Get somewhere to encode an outbound packet to. If the application gave us reserve/commit, that's
+//	its own chat buffer, otherwise it's buffer, which goes to the plain packet sender. max_encoded is the worst case
+//	encoded length for this type of packet (see HCN_ENCODED_SIZE) and is capped at HCN_MAX_PACKET_LENGTH.
+static bool hcn_send_begin(struct HCN_writer *w, int player_number, struct HCN_packet *buffer, HCN_packet_type type, int packet_length, int max_encoded) {
+	struct HCN_ring_slot *slot = NULL;
+	wchar_t *out;
+	bool alternate;
+
+	if (max_encoded > HCN_MAX_PACKET_LENGTH / 2) max_encoded = HCN_MAX_PACKET_LENGTH / 2;
+
+	if (hcn_current->pipelining) {						// Straight into the outbound ring, hcn_on_tick() hands it over.
+		if ((slot = hcn_ring_reserve(&hcn_current->outbound_ring)) == NULL) {
+			hcn_logger(HCN_LOG_DEBUG, "Outbound ring is full, dropping packet for player %d", player_number);
+			return false;
+		}
+		out = slot->chat;
+	}
+	else if (hcn_current->application_reserve != NULL) {
+		if ((out = hcn_current->application_reserve(player_number, max_encoded)) == NULL) {
+			hcn_logger(HCN_LOG_DEBUG, "Application couldn't reserve %d characters for player %d", max_encoded, player_number);
+			return false;
+		}
+	}
+	else if (hcn_current->application_sender != NULL) {
+		out = (wchar_t *)buffer;
+	}
+	else {
+		hcn_logger(HCN_LOG_WARN, "HCN packet sender not set!");
+		return false;
+	}
 
+	// Handshakes always go plain, anyone can read them.
+	alternate = type != HCN_PACKET_HANDSHAKE && (hcn_current->peer_capabilities[(player_number == 0) ? 0 : player_number - 1] & HCN_CAP_ALTERNATE_ENCODING) != 0;
+	hcn_writer_begin(w, out, max_encoded - 1, type, packet_length, alternate);
+	w->slot = slot;
+	return true;
 }
 
-// hcn_send_keyvalue() - send a key-value pair to the other side.
-bool hcn_send_keyvalue(int player_number, char *keyvalue) {
-	int pi = (player_number == 0) ? 0 : player_number - 1;
-	int length;
-	struct HCN_keyvalue_packet kv_packet;
-	struct HCN_packet *packet = (struct HCN_packet *)&kv_packet;
+// hcn_send_end() - Finish encoding an outbound packet, and hand it to the application.
+static bool hcn_send_end(struct HCN_writer *w, int player_number) {
+	int length = hcn_writer_end(w);
 
-	if (hcn_application_sender == NULL) {
-		hcn_logger(HCN_LOG_WARN, "hcn_send_keyvalue(): Application packet sender not set!");
-		return false;
+	if (length == 0) {
+		hcn_logger(HCN_LOG_DEBUG, "Packet for player %d doesn't fit in %d characters once encoded", player_number, w->limit + 1);
 	}
 
-	if (hcn_state[pi] == HCN_STATE_RUNNING) {				// if the state is "RUNNING" we can go ahead and send it.
-		hcn_logger(HCN_LOG_DEBUG2, "HCN sending keyvalue '%s' to player %d", keyvalue, player_number);
-		kv_packet.preamble.packet_type = HCN_PACKET_KEYVALUE;		// Packet type
-		kv_packet.keyvalue_length = strlen(keyvalue) + 1;		// make sure we have a char* length plus the null terminator.
-		strcpy_s(kv_packet.keyvalue, HCN_KEYVALUE_LENGTH, keyvalue);	// Copy the keyvalue pair in.
-		length = kv_packet.size() + kv_packet.keyvalue_length;		// Get the un-encoded length.
-		hcn_packet_sender(player_number, packet, length);		// and send the actual packet.
-		return true;
+	if (w->slot != NULL) {
+		w->slot->player_number = player_number;
+		w->slot->length = length;					// A zero length gets skipped in hcn_pipeline_flush().
+		hcn_ring_commit(&hcn_current->outbound_ring, w->slot);
 	}
-	else {
-		hcn_logger(HCN_LOG_DEBUG, "Other side status is not RUNNING, state = %d, pi = %d", hcn_state[pi], pi);
+	else if (hcn_current->application_reserve != NULL) {
+		hcn_current->application_commit(player_number, w->out, length);		// A zero length tells the application to drop it.
+	}
+	else if (length > 0) {
+		hcn_current->application_sender(player_number, (struct HCN_packet *)w->out);
 	}
 
-	return false;								// indicate we failed.
+	return length > 0;
+}
+
+// Set the reserve/commit pair HCN will use instead of the packet sender. Packets get encoded straight into the
+//	buffer reserve returns.
+void hcn_set_packet_reserve_commit(HCN_application_reserve reserve, HCN_application_commit commit) {
 
+	if (reserve == NULL || commit == NULL) reserve = NULL, commit = NULL;	// It's both or neither.
+	hcn_current->application_reserve = reserve;
+	hcn_current->application_commit = commit;
+	hcn_logger(HCN_LOG_DEBUG2, "Application packet reserve/commit functions set");
 }
 
-// Send a text packet to a client or server
-bool hcn_send_text(int player_number, HCN_text_type type, HCN_text_color color, wchar_t *text) {
-	int pi = (player_number == 0) ? 0 : player_number - 1;
-	int length;
-	struct HCN_text_packet text_packet;
-	struct HCN_packet *packet = (struct HCN_packet *)&text_packet;
+// hcn_packet_sender() - Called to send a packet that has not been encoded yet. We take care of the lengths, encoding, etc.
+//	Supplied length is BYTE
+void hcn_packet_sender(int player_number, HCN_packet *packet, int packet_length) {
+	HCN_preamble *preamble = (HCN_preamble *)packet;			// Get a preamble pointer.
+	HCN_packet encoded_packet;						// We need a place to encode the packet to, if the application doesn't give us one.
+	struct HCN_writer w;
 
-	if (hcn_application_sender == NULL) {
-		hcn_logger(HCN_LOG_WARN, "hcn_send_keyvalue(): Application packet sender not set!");
-		return false;
-	}
+	if (!hcn_send_begin(&w, player_number, &encoded_packet, (HCN_packet_type)preamble->packet_type, packet_length, HCN_ENCODED_SIZE(packet_length))) return;
 
-	if (hcn_state[pi] == HCN_STATE_RUNNING) {				// if the state is "RUNNING" we can go ahead and send it.
-		hcn_logger(HCN_LOG_DEBUG2, "HCN sending text to player %d - '%S'", player_number, text);
-		text_packet.preamble.packet_type = HCN_PACKET_TEXT;		// Packet type
-		text_packet.text_type = type;					// Set the text type.
-		text_packet.color = color;					// and the color
-		text_packet.text_length = wcslen(text) + 1;			// make sure we have a null terminator.
-		wcscpy_s(text_packet.text, HCN_TEXT_LENGTH, text);		// Copy the text into the packet.
-		length = text_packet.size() + text_packet.text_length * 2;	// Get the un-encoded length in bytes.
-		hcn_packet_sender(player_number, packet, length);		// and send the actual packet.
-		return true;
-	}
-	else {
-		hcn_logger(HCN_LOG_DEBUG, "Other side status is not RUNNING, state = %d, pi = %d", hcn_state[pi], pi);
-	}
+	hcn_writer_put(&w, packet->data + sizeof(struct HCN_preamble), packet_length - sizeof(struct HCN_preamble));
+	hcn_send_end(&w, player_number);
 
-	return false;								// indicate we failed.
+}
+
+// hcn_send_body_now() - Send a packet whose body is a fixed head plus a variable-length data part, both encoded straight
+//	from the caller's memory.
+static bool hcn_send_body_now(int player_number, HCN_packet_type type, const void *head, int head_length, const void *data, int data_length, int max_encoded) {
+	HCN_packet encoded_packet;
+	struct HCN_writer w;
+
+	if (!hcn_send_begin(&w, player_number, &encoded_packet, type, sizeof(struct HCN_preamble) + head_length + data_length, max_encoded)) return false;
 
+	hcn_writer_put(&w, head, head_length);
+	hcn_writer_put(&w, data, data_length);
+	return hcn_send_end(&w, player_number);
 }
 
-// Overloaded version of hcn_send_text() for 8-bit character strings. Be careful to use this only for console output.
-bool hcn_send_text(int player_number, HCN_text_type type, HCN_text_color color, char *text) {
-	int pi = (player_number == 0) ? 0 : player_number - 1;
-	int length;
-	struct HCN_text_packet text_packet;
-	struct HCN_packet *packet = (struct HCN_packet *)&text_packet;
+// hcn_encoded_size() - Exact encoded length of some un-encoded packet bytes, including the null terminator.
+static int hcn_encoded_size(const unsigned char *data, int bytes) {
+	int units = (bytes / 2) + (bytes % 2);
+	int length = units + 1;
+	int i;
+	wchar_t c;
 
-	if (hcn_application_sender == NULL) {
-		hcn_logger(HCN_LOG_WARN, "hcn_send_keyvalue(): Application packet sender not set!");
-		return false;
+	for (i = 0; i < units; i++) {
+		c = (wchar_t)(data[i * 2] | ((i * 2 + 1 < bytes) ? data[i * 2 + 1] << 8 : 0));
+		if (c == 0 || c == HCN_ENCODE_TAG) length++;			// This one will need two characters.
 	}
+	return length;
+}
 
-	if (hcn_state[pi] == HCN_STATE_RUNNING) {				// if the state is "RUNNING" we can go ahead and send it.
-		hcn_logger(HCN_LOG_DEBUG2, "HCN sending text8 to player %d - '%s'", player_number, text);
-		text_packet.preamble.packet_type = HCN_PACKET_TEXT;		// Packet type
-		text_packet.text_type = type;					// Set the text type.
-		text_packet.color = color;					// and the color
-		text_packet.text_length = strlen(text) + 1;			// make sure we have a null terminator.
-		strcpy_s(text_packet.text8, HCN_TEXT_LENGTH, text);		// Copy the text into the packet.
-		length = text_packet.size() + text_packet.text_length;		// Get the un-encoded length.
-		hcn_packet_sender(player_number, packet, length);		// and send the actual packet.
-		return true;
-	}
-	else {
-		hcn_logger(HCN_LOG_DEBUG, "Other side status is not RUNNING, state = %d, pi = %d", hcn_state[pi], pi);
-	}
+// hcn_quantize() - Squeeze a float into 16 bits inside some bounds. Out of bounds values are clamped.
+static unsigned short hcn_quantize(float value, float min, float max) {
+	float scaled;
 
-	return false;								// indicate we failed.
+	if (!(max > min)) return 1;
+	scaled = (value - min) / (max - min) * HCN_QUANTIZE_STEPS;
+	if (!(scaled > 0.0f)) return 1;						// Also catches NaN.
+	if (scaled >= HCN_QUANTIZE_STEPS) return HCN_QUANTIZE_STEPS + 1;
+	return (unsigned short)(scaled + 0.5f) + 1;
+}
+
+// hcn_dequantize() - And back again.
+static float hcn_dequantize(unsigned short value, float min, float max) {
+
+	if (value < 1) value = 1;
+	if (value > HCN_QUANTIZE_STEPS + 1) value = HCN_QUANTIZE_STEPS + 1;
+	return min + (value - 1) * ((max - min) / HCN_QUANTIZE_STEPS);
+}
+
+// hcn_vector_chunk() - How many vectors of count go in the next packet.
+static inline int hcn_vector_chunk(int count, bool compact) {
+	int max = compact ? HCN_MAX_COMPACT_VECTORS : HCN_MAX_VECTORS;
 
-}
\ No newline at end of file
+	return (count < max) ? count : max;
+}
+
+// hcn_vector_body() - Build the body of a vector packet, compact or not, from a list of vectors. Returns the length.
+//	Regular vector packets don't have a subject, so it's left out.
+static int hcn_vector_body(unsigned char *body, const struct HCN_subject_vector *vectors, int count, bool compact) {
+	struct HCN_compact_vector *cv = (struct HCN_compact_vector *)(body + 1);
+	struct HCN_vector *v = (struct HCN_vector *)(body + 1);
+	const struct HCN_vector_bounds *bounds;
+
+	body[0] = count;
+	for (int i = 0; i < count; i++) {
+		if (compact) {
+			bounds = &hcn_current->vector_bounds[vectors[i].vector_type];
+			cv[i].vector_type = vectors[i].vector_type;
+			cv[i].subject = vectors[i].subject;
+			cv[i].x = hcn_quantize(vectors[i].vector.x, bounds->min.x, bounds->max.x);
+			cv[i].y = hcn_quantize(vectors[i].vector.y, bounds->min.y, bounds->max.y);
+			cv[i].z = hcn_quantize(vectors[i].vector.z, bounds->min.z, bounds->max.z);
+		}
+		else {
+			v[i].vector_type = vectors[i].vector_type;
+			v[i].vector = vectors[i].vector;
+		}
+	}
+	return compact ? HCN_compact_vector_schema::body_length(count) : HCN_vector_schema::body_length(count);
+}
+
+// hcn_queued_begin() - Start an un-encoded packet with a placeholder preamble, so hcn_encoded_size() sees what the
+//	writer will.
+static void hcn_queued_begin(struct HCN_queued *entry, HCN_packet_type type) {
+	struct HCN_preamble preamble;
+
+	preamble.packet_type = type;
+	preamble.packet_length = 1;
+	preamble.encoded_length = 1;
+	memcpy(entry->data, &preamble, sizeof(struct HCN_preamble));
+	entry->length = sizeof(struct HCN_preamble);
+	entry->key_id = 0;
+}
+
+// hcn_delta_sequence() - The sequence number a packet serial goes out as. Never 0, that means a keyframe.
+static inline unsigned char hcn_delta_sequence(unsigned int serial) {
+
+	return (unsigned char)(serial % 255 + 1);
+}
+
+// hcn_delta_reset() - Forget everything about a player's delta vectors, both ways. Everything starts over with keyframes.
+static void hcn_delta_reset(struct HCN_delta *delta) {
+
+	delta->serial = 0;
+	delta->slot_count = 0;
+	delta->recv_count = 0;
+	delta->ack = 0;
+	delta->ack_also = 0;
+}
+
+// hcn_delta_got() - Add a delta vector packet we got to what gets acked on the next tick.
+static void hcn_delta_got(struct HCN_delta *delta, unsigned char sequence) {
+	int ahead;
+
+	if (delta->ack == 0) {
+		delta->ack = sequence;
+		delta->ack_also = 0;
+		return;
+	}
+
+	ahead = (sequence - delta->ack + 255) % 255;
+	if (ahead == 0) return;							// Same one again.
+	if (ahead < 128) {							// Newer, the one we had moves back.
+		if (ahead < 32) delta->ack_also = (delta->ack_also << ahead) | (1u << (ahead - 1));
+		else delta->ack_also = (ahead == 32) ? 0x80000000u : 0;
+		delta->ack = sequence;
+	}
+	else if (255 - ahead <= 32) {						// Older, it came in out of order.
+		delta->ack_also |= 1u << (255 - ahead - 1);
+	}
+}
+
+// hcn_delta_find() - Find the sender's slot for a vector without starting one. NULL if there isn't one yet.
+static struct HCN_delta_slot *hcn_delta_find(struct HCN_delta *delta, HCN_vector_type vector_type, unsigned char subject) {
+
+	for (int i = 0; i < delta->slot_count; i++) {
+		if (delta->slots[i].vector_type == vector_type && delta->slots[i].subject == subject) return &delta->slots[i];
+	}
+	return NULL;
+}
+
+// hcn_delta_slot() - Find the sender's slot for a vector, or start one. NULL if they're all used.
+static struct HCN_delta_slot *hcn_delta_slot(struct HCN_delta *delta, HCN_vector_type vector_type, unsigned char subject) {
+	struct HCN_delta_slot *slot = hcn_delta_find(delta, vector_type, subject);
+
+	if (slot != NULL) return slot;
+	if (delta->slot_count == HCN_DELTA_SLOTS) return NULL;
+
+	slot = &delta->slots[delta->slot_count++];
+	memset(slot, 0, sizeof(struct HCN_delta_slot));
+	slot->vector_type = vector_type;
+	slot->subject = subject;
+	return slot;
+}
+
+// hcn_delta_recv_slot() - Same for the receiver.
+static struct HCN_delta_recv_slot *hcn_delta_recv_slot(struct HCN_delta *delta, HCN_vector_type vector_type, unsigned char subject) {
+	struct HCN_delta_recv_slot *slot;
+
+	for (int i = 0; i < delta->recv_count; i++) {
+		if (delta->recv[i].vector_type == vector_type && delta->recv[i].subject == subject) return &delta->recv[i];
+	}
+	if (delta->recv_count == HCN_DELTA_SLOTS) return NULL;
+
+	slot = &delta->recv[delta->recv_count++];
+	memset(slot, 0, sizeof(struct HCN_delta_recv_slot));
+	slot->vector_type = vector_type;
+	slot->subject = subject;
+	return slot;
+}
+
+// hcn_delta_quantize() - Quantize a vector inside the bounds for its type.
+static void hcn_delta_quantize(const struct HCN_subject_vector *vector, unsigned short q[3]) {
+	const struct HCN_vector_bounds *bounds = &hcn_current->vector_bounds[vector->vector_type];
+
+	q[0] = hcn_quantize(vector->vector.x, bounds->min.x, bounds->max.x);
+	q[1] = hcn_quantize(vector->vector.y, bounds->min.y, bounds->max.y);
+	q[2] = hcn_quantize(vector->vector.z, bounds->min.z, bounds->max.z);
+}
+
+// hcn_delta_keyframe() - Does this vector have to go as a keyframe in packet serial? It does if the other side hasn't
+//	acked one yet, it's been too long, or it's moved too far.
+static bool hcn_delta_keyframe(const struct HCN_delta_slot *slot, const unsigned short q[3], unsigned int serial) {
+
+	if (slot == NULL || slot->acked_serial == 0 || slot->until_keyframe <= 0) return true;
+	if (serial - slot->acked_serial >= 255) return true;			// Sequence number would be ambiguous.
+	for (int k = 0; k < 3; k++) {
+		if (q[k] - slot->acked[k] < -127 || q[k] - slot->acked[k] > 127) return true;
+	}
+	return false;
+}
+
+// hcn_delta_unchanged() - Does the other side already have exactly this, with nothing different on the way? Then it
+//	doesn't need sending at all.
+static bool hcn_delta_unchanged(const struct HCN_delta_slot *slot, const unsigned short q[3]) {
+	const struct HCN_delta_sent *last;
+
+	if (slot == NULL || slot->acked_serial == 0 || memcmp(slot->acked, q, sizeof(slot->acked)) != 0) return false;
+	last = &slot->sent[(slot->next + HCN_DELTA_HISTORY - 1) % HCN_DELTA_HISTORY];
+	return memcmp(last->q, q, sizeof(last->q)) == 0;
+}
+
+// hcn_delta_build() - Build a delta vector packet from as many of vectors as will fit. Returns how many were used,
+//	including any that didn't need sending. Slots are only looked at here, never started; nothing is remembered
+//	until hcn_delta_sent() is called, so it can be built and thrown away.
+static int hcn_delta_build(int pi, struct HCN_queued *entry, const struct HCN_subject_vector *vectors, int count) {
+	struct HCN_delta *delta = &hcn_current->delta[pi];
+	struct HCN_delta_slot *slot;
+	unsigned int serial = delta->serial + 1;
+	unsigned short q[3];
+	unsigned char *p;
+	int i, k, start, n = 0;
+
+	hcn_queued_begin(entry, HCN_PACKET_DELTA_VECTOR);
+	entry->data[entry->length++] = 0;					// Count, filled in below.
+	entry->data[entry->length++] = hcn_delta_sequence(serial);
+
+	for (i = 0; i < count && n < HCN_MAX_COMPACT_VECTORS; i++) {
+		slot = hcn_delta_find(delta, vectors[i].vector_type, vectors[i].subject);
+		hcn_delta_quantize(&vectors[i], q);
+		if (hcn_delta_unchanged(slot, q)) continue;
+
+		start = entry->length;
+		p = entry->data + start;
+		p[0] = vectors[i].vector_type;
+		p[1] = vectors[i].subject;
+		if (hcn_delta_keyframe(slot, q, serial)) {
+			p[2] = 0;
+			memcpy(p + 3, q, sizeof(q));
+			entry->length += 3 + sizeof(q);
+		}
+		else {
+			p[2] = hcn_delta_sequence(slot->acked_serial);
+			for (k = 0; k < 3; k++) p[3 + k] = (unsigned char)(q[k] - slot->acked[k] + 128);
+			entry->length += 6;
+		}
+
+		// Only check the real encoded length once the worst case could be too long.
+		if (HCN_ENCODED_SIZE(entry->length) > HCN_MAX_PACKET_LENGTH / 2 && hcn_encoded_size(entry->data, entry->length) > HCN_MAX_PACKET_LENGTH / 2) {
+			entry->length = start;
+			break;
+		}
+		n++;
+	}
+
+	entry->data[sizeof(struct HCN_preamble)] = n;
+	entry->cost = hcn_encoded_size(entry->data, entry->length) * sizeof(wchar_t);
+	return i;
+}
+
+// hcn_delta_sent() - A delta vector packet built from vectors went out, remember what was in it. This is where slots
+//	get started, for vectors that just went as their first keyframe.
+static void hcn_delta_sent(int pi, const struct HCN_subject_vector *vectors, int count) {
+	struct HCN_delta *delta = &hcn_current->delta[pi];
+	struct HCN_delta_slot *slot;
+	unsigned int serial = delta->serial + 1;
+	unsigned short q[3];
+
+	for (int i = 0; i < count; i++) {
+		slot = hcn_delta_slot(delta, vectors[i].vector_type, vectors[i].subject);
+		if (slot == NULL) continue;					// All used, so it went as a keyframe. Nothing to remember.
+		hcn_delta_quantize(&vectors[i], q);
+		if (hcn_delta_unchanged(slot, q)) continue;			// Didn't go at all.
+
+		slot->until_keyframe = hcn_delta_keyframe(slot, q, serial) ? HCN_DELTA_KEYFRAME : slot->until_keyframe - 1;
+		slot->sent[slot->next].serial = serial;
+		memcpy(slot->sent[slot->next].q, q, sizeof(q));
+		slot->next = (slot->next + 1) % HCN_DELTA_HISTORY;
+	}
+	delta->serial = serial;
+}
+
+// hcn_vector_packet() - Build the next vector packet for a player from the front of a list of vectors, in the best
+//	format the other side can take. Returns how many of the vectors went in. Call hcn_vector_packet_sent() once it's sent.
+static int hcn_vector_packet(int pi, struct HCN_queued *entry, const struct HCN_subject_vector *vectors, int count) {
+	unsigned short caps = hcn_current->peer_capabilities[pi];
+	bool compact = (caps & HCN_CAP_COMPACT_VECTOR) != 0;
+
+	if (compact && (caps & HCN_CAP_DELTA_VECTOR)) return hcn_delta_build(pi, entry, vectors, count);
+
+	count = hcn_vector_chunk(count, compact);
+	hcn_queued_begin(entry, compact ? HCN_PACKET_COMPACT_VECTOR : HCN_PACKET_VECTOR);
+	entry->length += hcn_vector_body(entry->data + entry->length, vectors, count, compact);
+	entry->cost = hcn_encoded_size(entry->data, entry->length) * sizeof(wchar_t);
+	return count;
+}
+
+// hcn_vector_packet_sent() - A packet from hcn_vector_packet() went out.
+static void hcn_vector_packet_sent(int pi, const struct HCN_queued *entry, const struct HCN_subject_vector *vectors, int count) {
+	HCN_preamble *preamble = (HCN_preamble *)entry->data;
+
+	hcn_dr_sent(pi, entry, vectors, count);				// Before hcn_delta_sent(), it needs to see what the delta slots had.
+	if (preamble->packet_type == HCN_PACKET_DELTA_VECTOR) hcn_delta_sent(pi, vectors, count);
+}
+
+// hcn_lane_for() - Which outbound lane a packet type goes in.
+static HCN_lane hcn_lane_for(HCN_packet_type type) {
+
+	switch (type) {
+	case HCN_PACKET_HANDSHAKE:
+	case HCN_PACKET_KEYVALUE:
+	case HCN_PACKET_DELTA_ACK:
+	case HCN_PACKET_KEY_DEFINE:
+	case HCN_PACKET_KEY_ID:
+	case HCN_PACKET_TYPED_KEYVALUE:
+		return HCN_LANE_CONTROL;
+		break;;
+	case HCN_PACKET_TEXT:
+		return HCN_LANE_TEXT;
+		break;;
+	case HCN_PACKET_VECTOR:
+		return HCN_LANE_VECTOR;
+		break;;
+	}
+
+	return HCN_LANE_DATAPOINT;						// Datapoints, and bundles.
+}
+
+// hcn_outbound_reset() - Throw away everything queued for a player.
+static void hcn_outbound_reset(struct HCN_outbound *out) {
+
+	for (int l = 0; l < HCN_LANE_VECTOR; l++) {
+		out->lanes[l].head = 0;
+		out->lanes[l].count = 0;
+	}
+	out->vector_count = 0;
+}
+
+// hcn_queue_vectors() - Queue vectors. A vector replaces any queued one of the same type and subject, it's out of
+//	date anyway.
+static bool hcn_queue_vectors(struct HCN_outbound *out, const struct HCN_subject_vector *vectors, int count) {
+	bool queued = true;
+	int i, j;
+
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < out->vector_count; j++) {
+			if (out->vectors[j].vector_type == vectors[i].vector_type && out->vectors[j].subject == vectors[i].subject) break;
+		}
+		if (j < out->vector_count) {
+			out->stats.superseded++;
+		}
+		else if (out->vector_count == HCN_LANE_VECTORS) {
+			out->stats.dropped++;
+			queued = false;
+			continue;
+		}
+		else {
+			out->vector_count++;
+		}
+		memcpy(&out->vectors[j], &vectors[i], sizeof(struct HCN_subject_vector));
+		out->stats.queued++;
+	}
+	return queued;
+}
+
+// hcn_queue_body() - Queue a packet in its lane, same arguments as hcn_send_body_now(). Vectors get pulled out of the
+//	packet and queued one by one.
+static bool hcn_queue_body(int player_number, HCN_packet_type type, const void *head, int head_length, const void *data, int data_length) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	struct HCN_outbound *out = &hcn_current->outbound[pi];
+	HCN_lane l = hcn_lane_for((type == HCN_PACKET_COMPRESSED) ? (HCN_packet_type)((const unsigned char *)head)[0] : type);	// Compressed ones go with what they hold.
+	struct HCN_lane_queue *lane;
+	struct HCN_queued *entry;
+	struct HCN_queued vector_entry;
+	const unsigned char *body;
+	int body_length = head_length + data_length;
+
+	if (sizeof(struct HCN_preamble) + body_length > HCN_MAX_PACKET_LENGTH) return false;
+	out->player_number = player_number;
+
+	if (l == HCN_LANE_VECTOR) {
+		entry = &vector_entry;
+	}
+	else {
+		lane = &out->lanes[l];
+		if (lane->count == HCN_LANE_DEPTH) {				// Full up, the caller is sending faster than the budget allows.
+			out->stats.dropped++;
+			hcn_logger(HCN_LOG_DEBUG, "Outbound lane %d full for player %d, dropping a packet of type %d", l, player_number, type);
+			return false;
+		}
+		entry = &lane->entries[(lane->head + lane->count) % HCN_LANE_DEPTH];
+	}
+
+	hcn_queued_begin(entry, type);
+	memcpy(entry->data + entry->length, head, head_length);
+	if (data_length > 0) memcpy(entry->data + entry->length + head_length, data, data_length);
+	entry->length += body_length;
+
+	if (l == HCN_LANE_VECTOR) {
+		struct HCN_subject_vector vectors[255];
+		const struct HCN_vector *vector;
+
+		body = entry->data + sizeof(struct HCN_preamble);
+		if (body_length < 1 || HCN_vector_schema::body_length(body[0]) > body_length) return false;
+		for (int i = 0; i < body[0]; i++) {
+			vector = (const struct HCN_vector *)(body + 1) + i;
+			vectors[i].vector_type = vector->vector_type;
+			vectors[i].subject = 0;
+			vectors[i].vector = vector->vector;
+		}
+		return hcn_queue_vectors(out, vectors, body[0]);
+	}
+
+	entry->cost = hcn_encoded_size(entry->data, entry->length) * sizeof(wchar_t);
+	lane->count++;
+	out->stats.queued++;
+	return true;
+}
+
+// hcn_budget_allows() - Is there room in this tick's budget for another packet? The first one always goes, or a
+//	packet bigger than the byte budget would never go.
+static bool hcn_budget_allows(int bytes, int packets, int cost) {
+
+	if (packets == 0) return true;
+	if (hcn_current->budget_packets > 0 && packets >= hcn_current->budget_packets) return false;
+	if (hcn_current->budget_bytes > 0 && bytes + cost > hcn_current->budget_bytes) return false;
+	return true;
+}
+
+// hcn_send_queued() - Send a packet that was put together un-encoded, like the ones that get queued.
+static bool hcn_send_queued(int player_number, const struct HCN_queued *entry) {
+	HCN_preamble *preamble = (HCN_preamble *)entry->data;
+
+	return hcn_send_body_now(player_number, (HCN_packet_type)preamble->packet_type, entry->data + sizeof(struct HCN_preamble),
+		entry->length - sizeof(struct HCN_preamble), NULL, 0, entry->cost / sizeof(wchar_t));
+}
+
+// hcn_outbound_send() - Send a queued packet. If it can't go, it's counted as dropped.
+static bool hcn_outbound_send(struct HCN_outbound *out, struct HCN_queued *entry) {
+
+	if (!hcn_send_queued(out->player_number, entry)) {
+		out->stats.dropped++;
+		hcn_logger(HCN_LOG_DEBUG, "Couldn't send a queued packet to player %d, dropping it", out->player_number);
+		return false;
+	}
+	out->stats.sent++;
+	out->stats.bytes += entry->cost;
+	if (entry->key_id != 0) {						// Now the other side has the number.
+		hcn_key_table_set(&hcn_current->keys[(out->player_number == 0) ? 0 : out->player_number - 1].sent, entry->key_id, entry->key, strlen(entry->key));
+	}
+	return true;
+}
+
+// hcn_outbound_drain() - Send what a player's budget allows this tick, highest priority lane first. Vectors go last,
+//	as many to a packet as will fit. If unlimited, everything goes.
+static void hcn_outbound_drain(int pi, bool unlimited) {
+	struct HCN_outbound *out = &hcn_current->outbound[pi];
+	struct HCN_lane_queue *lane;
+	struct HCN_queued *entry;
+	struct HCN_queued vector_entry;
+	int l, count;
+	int bytes = 0, packets = 0;
+
+	for (l = HCN_LANE_CONTROL; l < HCN_LANE_VECTOR; l++) {
+		lane = &out->lanes[l];
+		while (lane->count > 0) {
+			entry = &lane->entries[lane->head];
+			if (!unlimited && !hcn_budget_allows(bytes, packets, entry->cost)) return;
+
+			if (hcn_outbound_send(out, entry)) {			// Only what went counts against the budget.
+				bytes += entry->cost;
+				packets++;
+			}
+			lane->head = (lane->head + 1) % HCN_LANE_DEPTH;
+			lane->count--;
+		}
+	}
+
+	while (out->vector_count > 0) {
+		count = hcn_vector_packet(pi, &vector_entry, out->vectors, out->vector_count);
+		if (vector_entry.data[sizeof(struct HCN_preamble)] > 0) {	// Unless nothing in it needed sending.
+			if (!unlimited && !hcn_budget_allows(bytes, packets, vector_entry.cost)) return;
+
+			if (hcn_outbound_send(out, &vector_entry)) {
+				hcn_vector_packet_sent(pi, &vector_entry, out->vectors, count);
+				bytes += vector_entry.cost;
+				packets++;
+			}
+		}
+
+		out->vector_count -= count;
+		memmove(out->vectors, out->vectors + count, out->vector_count * sizeof(struct HCN_subject_vector));
+	}
+}
+
+// hcn_send_body() - Send a packet whose body is a fixed head plus a variable-length data part. If the scheduler is on,
+//	it's queued for hcn_on_tick() instead.
+static bool hcn_send_body(int player_number, HCN_packet_type type, const void *head, int head_length, const void *data, int data_length, int max_encoded) {
+
+	if (hcn_current->scheduling) return hcn_queue_body(player_number, type, head, head_length, data, data_length);
+	return hcn_send_body_now(player_number, type, head, head_length, data, data_length, max_encoded);
+}
+
+// hcn_send_entries() - Send one of the counted packet types, straight out of the caller's array, through Send
+//	(hcn_send_body() or hcn_bundle_add()). Everything but the count check is worked out from the schema.
+typedef bool(*HCN_body_sender)(int player_number, HCN_packet_type type, const void *head, int head_length, const void *data, int data_length, int max_encoded);
+
+template <typename Schema, HCN_body_sender Send>
+static inline bool hcn_send_entries(int player_number, const typename Schema::entry_type *entries, int count) {
+	static_assert(Schema::head_length == 1, "Only counted packet types are sent as entries");
+	unsigned char head = count;
+
+	if (count < 0 || count > Schema::max_count) return false;		// make sure we're not asked to send too many.
+	return Send(player_number, Schema::packet_type, &head, 1, entries, Schema::body_length(count) - 1, Schema::max_encoded());
+}
+
+// hcn_delta_tick() - Ack the delta vector packets we got from a player since the last tick.
+static void hcn_delta_tick(int pi) {
+	struct HCN_delta *delta = &hcn_current->delta[pi];
+	unsigned char body[1 + sizeof(delta->ack_also)];
+
+	if (delta->ack == 0) return;
+	body[0] = delta->ack;
+	memcpy(body + 1, &delta->ack_also, sizeof(delta->ack_also));
+	delta->ack = 0;
+	delta->ack_also = 0;
+	if (hcn_current->state[pi] == HCN_STATE_RUNNING) hcn_send_body(delta->player_number, HCN_PACKET_DELTA_ACK, body, sizeof(body), NULL, 0, HCN_ENCODED_SIZE(sizeof(struct HCN_preamble) + sizeof(body)));
+}
+
+// Turn the outbound scheduler on or off. When on, sends are queued per player and hcn_on_tick() sends what the budget
+//	allows. Turning it off sends anything still queued.
+void hcn_set_scheduler(bool enabled) {
+
+	if (hcn_current->scheduling && !enabled) {
+		hcn_current->scheduling = false;
+		for (int i = 0; i < HCN_MAX_PLAYERS; i++) {
+			std::lock_guard<std::recursive_mutex> guard(hcn_current->player_lock[i]);
+
+			hcn_outbound_drain(i, true);
+		}
+	}
+	hcn_current->scheduling = enabled;
+	hcn_logger(HCN_LOG_DEBUG2, "Outbound scheduler %s", enabled ? "on" : "off");
+}
+
+// Set how much each player gets sent per tick when the scheduler is on. Zero is no limit.
+void hcn_set_send_budget(int bytes_per_tick, int packets_per_tick) {
+
+	hcn_current->budget_bytes = (bytes_per_tick > 0) ? bytes_per_tick : 0;
+	hcn_current->budget_packets = (packets_per_tick > 0) ? packets_per_tick : 0;
+}
+
+// Get a player's outbound counters, and how much is still queued.
+void hcn_get_send_stats(int player_number, struct HCN_send_stats *stats) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	std::lock_guard<std::recursive_mutex> guard(hcn_player_lock(player_number));
+	struct HCN_outbound *out = &hcn_current->outbound[pi];
+
+	memcpy(stats, &out->stats, sizeof(struct HCN_send_stats));
+	stats->depth = out->vector_count;
+	for (int l = 0; l < HCN_LANE_VECTOR; l++) stats->depth += out->lanes[l].count;
+}
+
+// Zero everyone's outbound counters.
+void hcn_reset_send_stats() {
+
+	for (int i = 0; i < HCN_MAX_PLAYERS; i++) memset(&hcn_current->outbound[i].stats, 0, sizeof(struct HCN_send_stats));
+}
+
+// hcn_dr_located() - Is this a vector type dead reckoning guesses at?
+static inline bool hcn_dr_located(HCN_vector_type vector_type) {
+
+	return vector_type == HCN_VECTOR_BIPED_LOCATION || vector_type == HCN_VECTOR_RED_FLAG || vector_type == HCN_VECTOR_BLUE_FLAG;
+}
+
+// hcn_dr_find() - Find the slot for a vector in a list, or start one if create is set. NULL if there isn't one.
+static struct HCN_dr_slot *hcn_dr_find(struct HCN_dr_slot *slots, int *count, HCN_vector_type vector_type, unsigned char subject, bool create) {
+	struct HCN_dr_slot *slot;
+
+	for (int i = 0; i < *count; i++) {
+		if (slots[i].vector_type == vector_type && slots[i].subject == subject) return &slots[i];
+	}
+	if (!create || *count == HCN_DR_SLOTS) return NULL;
+
+	slot = &slots[(*count)++];
+	memset(slot, 0, sizeof(struct HCN_dr_slot));
+	slot->vector_type = vector_type;
+	slot->subject = subject;
+	return slot;
+}
+
+// hcn_dr_predict() - Where a located vector should be now, going by the velocity for its subject. Both sides do the
+//	same thing with what was sent, so they come up with the same answer.
+static void hcn_dr_predict(struct HCN_dr_slot *slots, int *count, const struct HCN_dr_slot *slot, unsigned int now, struct HCN_vect3d *vector) {
+	struct HCN_dr_slot *velocity = NULL;
+	float ticks = (float)(now - slot->tick);
+
+	if (slot->vector_type == HCN_VECTOR_BIPED_LOCATION || slot->subject != 0) {
+		velocity = hcn_dr_find(slots, count, HCN_VECTOR_BIPED_VELOCITY, slot->subject, false);
+	}
+
+	*vector = slot->vector;
+	if (velocity != NULL) {
+		vector->x += velocity->vector.x * ticks;
+		vector->y += velocity->vector.y * ticks;
+		vector->z += velocity->vector.z * ticks;
+	}
+}
+
+// hcn_dr_filter() - Take out the located vectors the other side can guess well enough, and the velocities that go
+//	with them. Returns how many vectors are left in out. What we sent isn't remembered until hcn_dr_sent(), since
+//	what's left might still be queued, or dropped.
+static int hcn_dr_filter(int pi, const struct HCN_subject_vector *vectors, int count, struct HCN_subject_vector *out) {
+	struct HCN_dead_reckoning *dr = &hcn_current->dr[pi];
+	struct HCN_dr_slot *slot;
+	struct HCN_vect3d guess;
+	bool send[HCN_MAX_COMPACT_VECTORS];
+	float dx, dy, dz;
+	int i, j, n = 0;
+
+	for (i = 0; i < count; i++) {						// Locations first, with the velocities the other side has now.
+		send[i] = true;
+		if (!hcn_dr_located(vectors[i].vector_type)) continue;
+
+		slot = hcn_dr_find(dr->sent, &dr->sent_count, vectors[i].vector_type, vectors[i].subject, false);
+		if (slot != NULL) {
+			hcn_dr_predict(dr->sent, &dr->sent_count, slot, hcn_current->tick_count + 1, &guess);
+			dx = guess.x - vectors[i].vector.x;
+			dy = guess.y - vectors[i].vector.y;
+			dz = guess.z - vectors[i].vector.z;
+			send[i] = dx * dx + dy * dy + dz * dz > hcn_current->dr_threshold * hcn_current->dr_threshold;
+		}
+	}
+
+	for (i = 0; i < count; i++) {						// A velocity stays only if its subject's location went, or wasn't there.
+		if (vectors[i].vector_type != HCN_VECTOR_BIPED_VELOCITY) continue;
+		for (j = 0; j < count; j++) {
+			if (vectors[j].vector_type == HCN_VECTOR_BIPED_LOCATION && vectors[j].subject == vectors[i].subject && !send[j]) send[i] = false;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		if (send[i]) out[n++] = vectors[i];
+	}
+	return n;
+}
+
+// hcn_dr_sent() - A vector packet built from vectors went out, so now the other side is guessing from what was in it.
+//	Vectors a delta packet left out because the other side already had them didn't go, so they don't count.
+static void hcn_dr_sent(int pi, const struct HCN_queued *entry, const struct HCN_subject_vector *vectors, int count) {
+	struct HCN_dead_reckoning *dr = &hcn_current->dr[pi];
+	HCN_preamble *preamble = (HCN_preamble *)entry->data;
+	struct HCN_dr_slot *slot;
+	unsigned short q[3];
+
+	if (!hcn_current->dr_enabled || !(hcn_current->peer_capabilities[pi] & HCN_CAP_DEAD_RECKONING)) return;
+
+	for (int i = 0; i < count; i++) {
+		if (!hcn_dr_located(vectors[i].vector_type) && vectors[i].vector_type != HCN_VECTOR_BIPED_VELOCITY) continue;
+		if (preamble->packet_type == HCN_PACKET_DELTA_VECTOR) {
+			hcn_delta_quantize(&vectors[i], q);
+			if (hcn_delta_unchanged(hcn_delta_find(&hcn_current->delta[pi], vectors[i].vector_type, vectors[i].subject), q)) continue;
+		}
+		slot = hcn_dr_find(dr->sent, &dr->sent_count, vectors[i].vector_type, vectors[i].subject, true);
+		if (slot == NULL) continue;
+		slot->vector = vectors[i].vector;
+		slot->tick = hcn_current->tick_count + 1;				// Ticks start at 1 here, so 0 is never sent.
+	}
+}
+
+// hcn_dr_received() - Remember vectors we got, so we can guess at them later.
+static void hcn_dr_received(int player_number, const struct HCN_subject_vector *vectors, int count) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	std::lock_guard<std::recursive_mutex> guard(hcn_player_lock(player_number));
+	struct HCN_dead_reckoning *dr = &hcn_current->dr[pi];
+	struct HCN_dr_slot *slot;
+
+	if (!hcn_current->dr_enabled || !(hcn_current->peer_capabilities[pi] & HCN_CAP_DEAD_RECKONING)) return;
+
+	dr->player_number = player_number;
+	for (int i = 0; i < count; i++) {
+		if (!hcn_dr_located(vectors[i].vector_type) && vectors[i].vector_type != HCN_VECTOR_BIPED_VELOCITY) continue;
+		slot = hcn_dr_find(dr->got, &dr->got_count, vectors[i].vector_type, vectors[i].subject, true);
+		if (slot == NULL) continue;
+		slot->vector = vectors[i].vector;
+		slot->tick = hcn_current->tick_count + 1;
+	}
+}
+
+// Turn dead reckoning on or off, and set how far off (in world units) the other side's guess can be before we send
+//	an update. It has to be on before the handshake, since that's where both sides find out.
+void hcn_set_dead_reckoning(bool enabled, float threshold) {
+
+	hcn_current->dr_enabled = enabled;
+	if (threshold > 0.0f) hcn_current->dr_threshold = threshold;
+	hcn_logger(HCN_LOG_DEBUG2, "Dead reckoning %s, threshold %f", enabled ? "on" : "off", hcn_current->dr_threshold);
+}
+
+// Get our guess at where a vector from the other side is now. False if we haven't got one, or it's too old.
+bool hcn_get_predicted_vector(int player_number, HCN_vector_type vector_type, unsigned char subject, struct HCN_vect3d *vector) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	std::lock_guard<std::recursive_mutex> guard(hcn_player_lock(player_number));
+	struct HCN_dead_reckoning *dr = &hcn_current->dr[pi];
+	struct HCN_dr_slot *slot = hcn_dr_find(dr->got, &dr->got_count, vector_type, subject, false);
+
+	if (slot == NULL || hcn_current->tick_count + 1 - slot->tick > HCN_DR_MAX_TICKS) return false;
+	if (hcn_dr_located(vector_type)) hcn_dr_predict(dr->got, &dr->got_count, slot, hcn_current->tick_count + 1, vector);
+	else *vector = slot->vector;
+	return true;
+}
+
+// hcn_send_subject_vectors() - Send vectors that say whose they are. If the other side has HCN_CAP_COMPACT_VECTOR, they
+//	go quantized, HCN_MAX_COMPACT_VECTORS to a packet, and as deltas if it has HCN_CAP_DELTA_VECTOR too. Otherwise
+//	they go as regular vector packets, without the subject.
+bool hcn_send_subject_vectors(int player_number, struct HCN_subject_vector *vectors, int vector_count) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	std::lock_guard<std::recursive_mutex> guard(hcn_player_lock(player_number));
+	struct HCN_subject_vector guessed[HCN_MAX_COMPACT_VECTORS];
+	struct HCN_queued entry;
+	bool sent = true;
+	int i, count;
+
+	if (vector_count > HCN_MAX_COMPACT_VECTORS) return false;		// make sure we're not asked to send too many.
+
+	if (hcn_current->dr_enabled && (hcn_current->peer_capabilities[pi] & HCN_CAP_DEAD_RECKONING)) {
+		vector_count = hcn_dr_filter(pi, vectors, vector_count, guessed); // Leave out what the other side can guess.
+		vectors = guessed;
+	}
+
+	if (hcn_current->scheduling) {
+		hcn_current->outbound[pi].player_number = player_number;
+		return hcn_queue_vectors(&hcn_current->outbound[pi], vectors, vector_count);
+	}
+
+	for (i = 0; i < vector_count; i += count) {
+		count = hcn_vector_packet(pi, &entry, vectors + i, vector_count - i);
+		if (entry.data[sizeof(struct HCN_preamble)] == 0) continue;	// Nothing in it needed sending.
+		if (hcn_send_queued(player_number, &entry)) hcn_vector_packet_sent(pi, &entry, vectors + i, count);
+		else sent = false;
+	}
+	return sent;
+}
+
+// Set the bounds compact vectors are quantized in, for the vector types in the list. Both sides need the same ones, set
+//	before the handshake; compact vectors aren't used until they are. No bounds at all is using the defaults.
+void hcn_set_vector_bounds(struct HCN_vector_bounds *bounds, int bounds_count) {
+
+	for (int i = 0; i < bounds_count; i++) {
+		memcpy(&hcn_current->vector_bounds[bounds[i].vector_type], &bounds[i], sizeof(struct HCN_vector_bounds));
+	}
+	hcn_current->bounds_set = true;
+}
+
+// hcn_bounds_hash() - A hash of every vector type's bounds, so the handshake can tell if both sides have the same ones.
+static unsigned int hcn_bounds_hash() {
+	unsigned int hash = 2166136261u;
+	float values[6];
+	unsigned char bytes[sizeof(values)];
+
+	for (int i = 0; i < 256; i++) {
+		const struct HCN_vector_bounds *bounds = &hcn_current->vector_bounds[i];
+
+		values[0] = bounds->min.x; values[1] = bounds->min.y; values[2] = bounds->min.z;
+		values[3] = bounds->max.x; values[4] = bounds->max.y; values[5] = bounds->max.z;
+		memcpy(bytes, values, sizeof(values));
+		for (int j = 0; j < (int)sizeof(bytes); j++) hash = (hash ^ bytes[j]) * 16777619u;
+	}
+	return hash;
+}
+
+// hcn_send_handshake() - Send a handshake with our version string.
+static bool hcn_send_handshake(int player_number, HCN_state state, unsigned char hcn_type) {
+	unsigned char head[2] = { (unsigned char)state, hcn_type };
+	unsigned short capabilities = hcn_advertised_capabilities();
+	unsigned int bounds_hash = hcn_bounds_hash();
+	unsigned char data[sizeof(hcn_current->our_version) + sizeof(capabilities) + sizeof(bounds_hash)];
+	int version_length = strlen(hcn_current->our_version) + 1;			// Always send the null terminator.
+
+	memcpy(data, hcn_current->our_version, version_length);
+	memcpy(data + version_length, &capabilities, sizeof(capabilities));	// Older versions stop reading at the version's null.
+	memcpy(data + version_length + sizeof(capabilities), &bounds_hash, sizeof(bounds_hash));
+	return hcn_send_body(player_number, HCN_PACKET_HANDSHAKE, head, 2, data, version_length + sizeof(capabilities) + sizeof(bounds_hash), HCN_HANDSHAKE_MAX_ENCODED);
+}
+
+// hcn_client_start() - Start the handshake from the client-side. Client implies player index 0.
+void hcn_client_start() {
+	std::lock_guard<std::recursive_mutex> guard(hcn_player_lock(0));
+
+	if (hcn_current->application_sender == NULL && hcn_current->application_reserve == NULL) {
+		hcn_logger(HCN_LOG_WARN, "HCN packet sender not set when hcn_client_start() called!");
+		return;
+	}
+
+	hcn_send_handshake(0, HCN_STATE_HANDSHAKE_C2S, hcn_current->client_type[0]);	// This is client-to-server, and we are whatever we were set to.
+
+	hcn_current->other_side[0].hcn_state = HCN_STATE_HANDSHAKE_C2S;			// Record that the other side was sent a Client->Server handshake packet.
+
+}
+
+// hcn_view_entries() - Get the entries out of a view of one of the counted packet types (head is just the count).
+//	Returns how many there are, with entries pointing at them in the packet, or -1 if it's the wrong type or doesn't
+//	hold together.
+template <typename Schema>
+static inline int hcn_view_entries(const struct HCN_packet_view *view, const typename Schema::entry_type **entries) {
+	static_assert(Schema::head_length == 1, "Only counted packet types have entries to view");
+	int count;
+
+	if (view->packet_type != Schema::packet_type || view->body_length < 1) return -1;
+
+	count = view->body[0];
+	if (count > Schema::max_count || Schema::body_length(count) > view->body_length) return -1;
+
+	*entries = (const typename Schema::entry_type *)(view->body + 1);
+	return count;
+}
+
+// hcn_make_view() - Point a view at a decoded packet. length is the decoded length in bytes.
+static void hcn_make_view(struct HCN_packet_view *view, const struct HCN_preamble *preamble, int length) {
+
+	view->packet_type = (HCN_packet_type)preamble->packet_type;
+	view->preamble = preamble;
+	view->body = (const unsigned char *)preamble + sizeof(struct HCN_preamble);
+	view->body_length = length - sizeof(struct HCN_preamble);
+}
+
+// hcn_view_datapoints() - Get the datapoints out of a datapoint packet view. False if the packet doesn't hold together.
+bool hcn_view_datapoints(const struct HCN_packet_view *view, struct HCN_datapoint_view *dps) {
+	const struct HCN_datapoint *entries;
+	int count = hcn_view_entries<HCN_datapoint_schema>(view, &entries);
+
+	if (count < 0) return false;
+
+	dps->count = count;
+	dps->dps = entries;
+	return true;
+}
+
+// hcn_view_vectors() - Get the vectors out of a vector packet view.
+bool hcn_view_vectors(const struct HCN_packet_view *view, struct HCN_vector_view *vectors) {
+	const struct HCN_vector *entries;
+	int count = hcn_view_entries<HCN_vector_schema>(view, &entries);
+
+	if (count < 0) return false;
+
+	vectors->count = count;
+	vectors->vectors = entries;
+	return true;
+}
+
+// hcn_view_compact_vectors() - Get the vectors out of a compact vector packet view. They can't be pointed at, since
+//	they have to be unquantized, so they're copied out to vectors, which needs room for HCN_MAX_COMPACT_VECTORS.
+//	Returns how many there were, or -1 if the packet is bad.
+int hcn_view_compact_vectors(const struct HCN_packet_view *view, struct HCN_subject_vector *vectors) {
+	const struct HCN_compact_vector *cv;
+	const struct HCN_vector_bounds *bounds;
+	int count = hcn_view_entries<HCN_compact_vector_schema>(view, &cv);
+
+	for (int i = 0; i < count; i++) {
+		bounds = &hcn_current->vector_bounds[cv[i].vector_type];
+		vectors[i].vector_type = cv[i].vector_type;
+		vectors[i].subject = cv[i].subject;
+		vectors[i].vector.x = hcn_dequantize(cv[i].x, bounds->min.x, bounds->max.x);
+		vectors[i].vector.y = hcn_dequantize(cv[i].y, bounds->min.y, bounds->max.y);
+		vectors[i].vector.z = hcn_dequantize(cv[i].z, bounds->min.z, bounds->max.z);
+	}
+	return count;
+}
+
+// hcn_view_keyvalue() - Split a keyvalue packet view into key and value, without touching the packet.
+//	If there's no =, the whole thing is the key and value is NULL (same as hcn_key_value_parse()).
+bool hcn_view_keyvalue(const struct HCN_packet_view *view, struct HCN_keyvalue_view *kv) {
+	const char *keyvalue = (const char *)view->body + 1;
+	const char *equals;
+	int length;
+
+	if (view->packet_type != HCN_PACKET_KEYVALUE || view->body_length < 2) return false;
+
+	length = view->body[0];							// keyvalue_length includes the null terminator.
+	if (length < 1 || 1 + length > view->body_length) return false;
+	if (memchr(keyvalue, 0, length) != keyvalue + length - 1) return false;	// Has to be exactly one null, right at the end.
+
+	equals = (const char *)memchr(keyvalue, '=', length - 1);
+	kv->key = keyvalue;
+	if (equals == NULL) {
+		kv->key_length = length - 1;
+		kv->value = NULL;
+		kv->value_length = 0;
+	}
+	else {
+		kv->key_length = equals - keyvalue;
+		kv->value = equals + 1;
+		kv->value_length = length - 1 - kv->key_length - 1;
+	}
+	return true;
+}
+
+// hcn_view_text() - Get the text out of a text packet view. Works out from the length whether the text is
+//	8-bit (console) or UTF-16, and makes sure it's null terminated.
+bool hcn_view_text(const struct HCN_packet_view *view, struct HCN_text_view *text) {
+	const struct HCN_text_packet *tp = (const struct HCN_text_packet *)(view->body - sizeof(struct HCN_preamble)); // Only the fields after the preamble are used.
+	int length;
+
+	if (view->packet_type != HCN_PACKET_TEXT || view->body_length < 3) return false;
+
+	length = tp->text_length;						// Includes the null terminator.
+	if (length < 1 || length > HCN_TEXT_LENGTH) return false;		// Nothing sends more, and handlers count on it fitting.
+
+	// Narrowed text is always 8-bit. Otherwise, text too short to be UTF-16 is 8-bit. The length alone can't tell for
+	//	an empty string, padded out to a whole 16-bit character it's as long as an empty UTF-16 one.
+	text->narrowed = (tp->text_type & HCN_TEXT_NARROWED) != 0;
+	text->narrow = text->narrowed || 3 + length * 2 > view->body_length;
+	if (text->narrow) {
+		if (3 + length > view->body_length || tp->text8[length - 1] != 0) return false;
+	}
+	else if (tp->text[length - 1] != 0) {
+		return false;
+	}
+
+	text->text_type = (HCN_text_type)(tp->text_type & ~HCN_TEXT_NARROWED);
+	text->color = tp->color;
+	text->length = length - 1;
+	text->text = tp->text;
+	text->text8 = tp->text8;
+	text->packet = tp;
+	return true;
+}
+
+// hcn_view_copy() - Copy a view into persistent storage as a whole packet. Returns the length in bytes.
+int hcn_view_copy(const struct HCN_packet_view *view, struct HCN_packet *packet) {
+	struct HCN_preamble preamble;						// Fresh preamble with our magic #.
+	int length = sizeof(struct HCN_preamble) + view->body_length;
+
+	preamble.packet_type = view->packet_type;
+	preamble.packet_length = (length / 2) + (length % 2);
+	preamble.encoded_length = (view->preamble != NULL) ? view->preamble->encoded_length : 0;
+	memcpy(packet->data, &preamble, sizeof(struct HCN_preamble));
+	memcpy(packet->data + sizeof(struct HCN_preamble), view->body, view->body_length);
+	return length;
+}
+
+// Set the packet view callback. If set, it gets every decoded datapoint/vector/keyvalue/text packet before the
+//	regular callback lists do. If it returns true, the packet is considered handled.
+void hcn_set_packet_callback(HCN_callback_packet callback) {
+
+	hcn_current->packet_callback = callback;
+}
+
+// hcn_store_handshake() - Keep a copy of the other side's handshake, making sure the version string is terminated.
+static void hcn_store_handshake(int pi, const struct HCN_handshake *handshake, int length) {
+
+	memset(&hcn_current->other_side[pi], 0, sizeof(struct HCN_handshake));
+	if (length > (int)sizeof(struct HCN_handshake)) length = sizeof(struct HCN_handshake);
+	memcpy(&hcn_current->other_side[pi], handshake, length);				// copy out just the part we got.
+	hcn_current->other_side[pi].version[HCN_KEYVALUE_LENGTH - 1] = 0;
+}
+
+// hcn_handshake_capabilities() - Get the capabilities that follow the version string, or zero if the other side
+//	is an older version that doesn't send them. Compact vectors are left out unless the other side's vector bounds
+//	are the same as ours, they'd come out wrong otherwise.
+static unsigned short hcn_handshake_capabilities(const struct HCN_handshake *handshake, int length) {
+	const char *end = (const char *)handshake + length;
+	const char *terminator;
+	unsigned short capabilities;
+	unsigned int bounds_hash;
+
+	if (length <= (int)(handshake->version - (const char *)handshake)) return 0;
+	terminator = (const char *)memchr(handshake->version, 0, end - handshake->version);
+	if (terminator == NULL || terminator + 1 + sizeof(capabilities) > end) return 0;
+
+	memcpy(&capabilities, terminator + 1, sizeof(capabilities));
+	if (terminator + 1 + sizeof(capabilities) + sizeof(bounds_hash) > end) {
+		capabilities &= ~(HCN_CAP_COMPACT_VECTOR | HCN_CAP_DELTA_VECTOR);
+	}
+	else {
+		memcpy(&bounds_hash, terminator + 1 + sizeof(capabilities), sizeof(bounds_hash));
+		if (bounds_hash != hcn_bounds_hash()) {
+			if (capabilities & HCN_CAP_COMPACT_VECTOR) hcn_logger(HCN_LOG_WARN, "Other side's vector bounds aren't the same as ours, not using compact vectors");
+			capabilities &= ~(HCN_CAP_COMPACT_VECTOR | HCN_CAP_DELTA_VECTOR);
+		}
+	}
+	return capabilities;
+}
+
+// hcn_handshake_packet_handler() - Deal with a handshake from the other side. length is the decoded length in bytes.
+static bool hcn_handshake_packet_handler(int player_number, const struct HCN_handshake *handshake, int length) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	std::lock_guard<std::recursive_mutex> guard(hcn_player_lock(player_number));
+
+	hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a handshake packet");
+
+	switch (hcn_current->our_side) {							// Server or client, we need to make decisions.
+	case HCN_SERVER:							// We are a server.
+		hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): We are a SERVER and got a packet from a client");
+		if (handshake->hcn_state == HCN_STATE_HANDSHAKE_C2S) {		// This is a client talking to us, who wants to go to state RUNNING
+			hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a client calling in, player_number %d", player_number);
+			hcn_current->state[pi] = HCN_STATE_RUNNING;			// Set the current state of this client to running.
+			hcn_store_handshake(pi, handshake, length);		// And keep a copy of the handshake packet.
+			hcn_current->peer_capabilities[pi] = hcn_advertised_capabilities() & hcn_handshake_capabilities(handshake, length);
+			hcn_bundle_reset(&hcn_current->bundles[pi]);
+			hcn_delta_reset(&hcn_current->delta[pi]);
+			hcn_keys_reset(&hcn_current->keys[pi]);
+
+			hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Sending back a handshake with state %d", HCN_STATE_HANDSHAKE_S2C);
+
+			hcn_logger(HCN_LOG_DEBUG, "Client version %s %s", hcn_enum_to_string(hcn_current->other_side[pi].hcn_type, HCN_client_names), hcn_current->other_side[pi].version);
+
+			// Reply telling the client that our state is Server->Client, and what we are.
+			hcn_send_handshake(player_number, HCN_STATE_HANDSHAKE_S2C, hcn_current->server_type);
+
+			return true;						// and tell the caller we did something.
+		}
+		else {
+			hcn_logger(HCN_LOG_DEBUG, "hcn_process_chat(): SERVER got an unknown state %d - going idle", handshake->hcn_state);
+			hcn_current->state[pi] = HCN_STATE_NONE;				// MISSION ABORT! We got something unexpected from the client.
+		}
+		break;;
+	case HCN_CLIENT:
+		hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): We are a CLIENT and got a packet from a server");
+
+		if (handshake->hcn_state == HCN_STATE_HANDSHAKE_S2C && hcn_current->other_side[0].hcn_state==HCN_STATE_HANDSHAKE_C2S) { // This is from a server, so check the "other side's" state.
+			hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a server calling in");
+			hcn_current->state[0] = HCN_STATE_RUNNING;			// we got back a handshake from the server, so we're running.
+			hcn_store_handshake(0, handshake, length);		// And keep a copy of the handshake packet.
+			hcn_current->peer_capabilities[0] = hcn_advertised_capabilities() & hcn_handshake_capabilities(handshake, length);
+			hcn_bundle_reset(&hcn_current->bundles[0]);
+			hcn_delta_reset(&hcn_current->delta[0]);
+			hcn_keys_reset(&hcn_current->keys[0]);
+			hcn_current->other_side[0].hcn_state = HCN_STATE_RUNNING;	// Set our copy of the handshake for this server, to state=RUNNING.
+
+			hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got handshake from server");
+
+			hcn_logger(HCN_LOG_DEBUG, "Server version %s %s", hcn_enum_to_string(hcn_current->other_side[0].hcn_type, HCN_server_names), hcn_current->other_side[0].version);
+
+			return true;						// we did something, YAY!
+		}
+		else {
+			hcn_logger(HCN_LOG_DEBUG, "hcn_process_chat(): CLIENT got an unknown state %d - going idle", handshake->hcn_state);
+			hcn_current->state[0] = HCN_STATE_NONE;				// MISSION ABORT! We got something unexpected from the server
+			return false;
+		}
+		break;;
+
+	}
+
+	return false;
+}
+
+// hcn_dispatch_view() - Hand a decoded packet view to the application. Handshakes never get here. The handlers only
+//	take the player's lock around the player's state, and let go of it before calling the application.
+bool hcn_dispatch_view(int player_number, const struct HCN_packet_view *view) {
+
+	if (hcn_current->packet_callback != NULL && hcn_current->packet_callback(player_number, view)) {
+		return true;							// The application took care of it.
+	}
+
+	switch (view->packet_type) {
+
+	// Datapoints.
+	case HCN_PACKET_DATAPOINT:
+		hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a list of datapoint values");
+		return hcn_datapoint_view_handler(player_number, view);
+		break;;
+
+	// Vector updates.
+	case HCN_PACKET_VECTOR:
+		hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a list of vector values");
+		return hcn_vector_view_handler(player_number, view);
+		break;;
+
+	// Keyvalue pair.
+	case HCN_PACKET_KEYVALUE:
+		hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a keyvalue packet");
+		return hcn_keyvalue_view_handler(player_number, view);
+		break;;
+
+	// Text packet
+	case HCN_PACKET_TEXT:
+		hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a text packet");
+		return hcn_text_view_handler(player_number, view);
+		break;;
+
+	// Quantized vectors
+	case HCN_PACKET_COMPACT_VECTOR:
+		hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a list of compact vectors");
+		return hcn_compact_vector_view_handler(player_number, view);
+		break;;
+
+	// Vectors as changes
+	case HCN_PACKET_DELTA_VECTOR:
+		hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a list of delta vectors");
+		return hcn_delta_vector_view_handler(player_number, view);
+		break;;
+
+	case HCN_PACKET_DELTA_ACK:
+		return hcn_delta_ack_view_handler(player_number, view);
+		break;;
+
+	// Keyvalue pairs with numbered keys.
+	case HCN_PACKET_KEY_DEFINE:
+		hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a key number");
+		return hcn_key_define_view_handler(player_number, view);
+		break;;
+
+	case HCN_PACKET_KEY_ID:
+		return hcn_key_id_view_handler(player_number, view);
+		break;;
+
+	// Datapoints, variable length.
+	case HCN_PACKET_PACKED_DATAPOINT:
+		hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a list of packed datapoint values");
+		return hcn_packed_datapoint_view_handler(player_number, view);
+		break;;
+
+	// Text or keyvalue, compressed.
+	case HCN_PACKET_COMPRESSED:
+		hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a compressed packet");
+		return hcn_compressed_view_handler(player_number, view);
+		break;;
+
+	// Keyvalue pair with a binary value.
+	case HCN_PACKET_TYPED_KEYVALUE:
+		hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a typed keyvalue packet");
+		return hcn_typed_keyvalue_view_handler(player_number, view);
+		break;;
+
+	// Several of the above in one packet.
+	case HCN_PACKET_BUNDLE:
+		hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): Got a bundle");
+		return hcn_bundle_view_handler(player_number, view);
+		break;;
+
+	}
+
+	return false;
+}
+
+// hcn_pipeline_push() - Copy a chat string into the inbound ring for the worker. Only as much as could be a packet is
+//	copied, anything longer won't decode anyway.
+static bool hcn_pipeline_push(int player_number, int chat_type, const wchar_t *our_packet) {
+	struct HCN_ring_slot *slot;
+	int length;
+
+	if ((slot = hcn_ring_reserve(&hcn_current->inbound_ring)) == NULL) {
+		hcn_logger(HCN_LOG_DEBUG, "Inbound ring is full, dropping packet from player %d", player_number);
+		return false;
+	}
+	for (length = 0; length < HCN_MAX_PACKET_LENGTH / 2 - 1 && our_packet[length] != 0; length++);
+	memcpy(slot->chat, our_packet, length * sizeof(wchar_t));
+	slot->chat[length] = 0;
+	slot->player_number = player_number;
+	slot->chat_type = chat_type;
+	slot->length = length + 1;
+	hcn_ring_commit(&hcn_current->inbound_ring, slot);
+	return true;
+}
+
+// hcn_pipeline_flush() - Hand the application what's waiting in the outbound ring. Called from hcn_on_tick(), on the
+//	game thread. Only what was there when it started, so a busy worker can't keep it going.
+static void hcn_pipeline_flush() {
+	struct HCN_ring_slot *slot;
+
+	for (int i = 0; i < HCN_RING_DEPTH && (slot = hcn_ring_peek(&hcn_current->outbound_ring)) != NULL; i++) {
+		if (slot->length > 0) hcn_deliver_encoded(slot->player_number, (struct HCN_packet *)slot->chat, slot->length);
+		hcn_ring_release(&hcn_current->outbound_ring, slot);
+	}
+}
+
+// Turn pipelined mode on or off. When on, hcn_process_chat() only copies HCN packets into a ring and returns, and the
+//	application's worker thread calls hcn_pipeline_work() to decode and handle them. Everything sent, from any thread,
+//	goes into another ring that hcn_on_tick() hands to the application. Stop the worker before turning it off; anything
+//	still waiting is handled then and there.
+void hcn_set_pipeline(bool enabled) {
+
+	if (enabled && !hcn_current->pipelining) {
+		hcn_ring_reset(&hcn_current->inbound_ring);
+		hcn_ring_reset(&hcn_current->outbound_ring);
+	}
+	if (!enabled && hcn_current->pipelining) {
+		hcn_pipeline_work(0);						// Whatever the worker didn't get to. Replies still go through the ring,
+		hcn_current->pipelining = false;
+		hcn_pipeline_flush();						// and then out.
+	}
+	hcn_current->pipelining = enabled;
+	hcn_logger(HCN_LOG_DEBUG2, "Pipelined mode %s", enabled ? "on" : "off");
+}
+
+// hcn_pipeline_work() - The worker thread's side of pipelined mode. Decodes and handles up to max_packets waiting in
+//	the inbound ring, or all of them if max_packets is 0. Returns how many it did. Only one thread at a time can do this.
+int hcn_pipeline_work(int max_packets) {
+	struct HCN_vector_block block;
+	struct HCN_ring_slot *slot;
+	bool collecting = hcn_collect_vectors(&block);
+	int done = 0;
+
+	while ((max_packets <= 0 || done < max_packets) && (slot = hcn_ring_peek(&hcn_current->inbound_ring)) != NULL) {
+		hcn_handle_chat(slot->player_number, slot->chat_type, slot->chat);
+		hcn_ring_release(&hcn_current->inbound_ring, slot);
+		done++;
+	}
+	if (collecting) hcn_collect_done(&block);
+	return done;
+}
+
+// Get the pipeline counters, and how much is waiting each way.
+void hcn_get_pipeline_stats(struct HCN_pipeline_stats *stats) {
+
+	stats->inbound_queued = hcn_current->inbound_ring.queued;
+	stats->inbound_dropped = hcn_current->inbound_ring.dropped;
+	stats->inbound_depth = hcn_ring_depth(&hcn_current->inbound_ring);
+	stats->outbound_queued = hcn_current->outbound_ring.queued;
+	stats->outbound_dropped = hcn_current->outbound_ring.dropped;
+	stats->outbound_depth = hcn_ring_depth(&hcn_current->outbound_ring);
+}
+
+// hsn_process_chat() - actually process an incoming packet. If return is true, we did work.
+//		*** Assume the chat text (our_packet) is null-terminated because Halo supplies
+//			a typical wchar_t string.
+//		*** The packet is decoded in place, right over our_packet. Decoding never makes it longer,
+//			and nothing gets copied unless the application asks for it with hcn_view_copy().
+//		*** When pipelining, it's only copied to the inbound ring here. See hcn_set_pipeline().
+bool hcn_process_chat(int player_number, int chat_type, wchar_t *our_packet) {
+
+	switch (hcn_classify_chat(chat_type, our_packet)) {			// Throw out regular chat before doing any real work.
+	case HCN_CHAT_NOT_HCN:
+		return false;
+	case HCN_CHAT_MALFORMED:
+		hcn_logger(HCN_LOG_DEBUG, "hcn_process_chat(): Malformed packet preamble from player %d", player_number);
+		return false;
+	}
+
+	if (hcn_current->pipelining) return hcn_pipeline_push(player_number, chat_type, our_packet);
+	return hcn_handle_chat(player_number, chat_type, our_packet);
+}
+
+// hcn_decode_chat() - Decode a chat string that hcn_classify_chat() says is ours, in place. Returns the decoded length
+//	in bytes, or 0 if it's no good.
+static int hcn_decode_chat(int chat_type, wchar_t *our_packet) {
+	struct HCN_preamble *preamble = (struct HCN_preamble *)our_packet;
+	HCN_decode_result result;
+
+	result = hcn_decode_packet((struct HCN_packet *)our_packet, our_packet, chat_type);	// Decode and validate it, all in one pass.
+
+	switch (result.status) {
+	case HCN_DECODE_OK:
+		break;;
+	case HCN_DECODE_ENCODED_LENGTH:						// The preamble is setup specifically so that we can look at it's contents without decoding first.
+		hcn_logger(HCN_LOG_DEBUG, "hcn_process_chat(): length of encoded packet doesn't match - %d vs. %d", result.encoded_length, preamble->encoded_length);
+		return 0;
+	case HCN_DECODE_LENGTH:
+		hcn_logger(HCN_LOG_DEBUG, "hcn_process_chat(): length of decoded packet doesn't match - %d vs. %d", result.length, preamble->packet_length);
+		return 0;
+	default:
+		hcn_logger(HCN_LOG_DEBUG, "hcn_process_chat(): Invalid packet received - %s", hcn_enum_to_string(result.status, HCN_decode_status_names));
+		return 0;
+	}
+
+	hcn_logger(HCN_LOG_DEBUG2, "hcn_process_chat(): got a valid packet");
+	return result.length * 2;
+}
+
+// hcn_handle_chat() - Decode and handle a chat string that hcn_classify_chat() says is ours.
+static bool hcn_handle_chat(int player_number, int chat_type, wchar_t *our_packet) {
+	struct HCN_preamble *preamble = (struct HCN_preamble *)our_packet;
+	struct HCN_packet_view view;
+	int length;
+
+	if ((length = hcn_decode_chat(chat_type, our_packet)) == 0) return false;
+
+	if (preamble->packet_type == HCN_PACKET_HANDSHAKE) {
+		return hcn_handshake_packet_handler(player_number, (const struct HCN_handshake *)our_packet, length);
+	}
+
+	hcn_make_view(&view, preamble, length);
+	return hcn_dispatch_view(player_number, &view);
+}
+
+// hcn_batch_mark() - Packet index in a batch chunk has a datapoint or vector (vt set) from player pi.
+static inline void hcn_batch_mark(struct HCN_batch_newest *newest, int index, int pi, int dp_type, int vt, unsigned char subject) {
+	int slot;
+
+	if (vt == 0) {
+		newest->datapoint[pi][dp_type] = index + 1;
+		return;
+	}
+	if ((slot = hcn_newest_vector(newest, pi, (HCN_vector_type)vt, subject, true)) >= 0) newest->vector[slot] = index + 1;
+}
+
+// hcn_batch_scan() - Note the datapoints and vectors in packet index of a batch chunk, as the newest so far of each.
+//	Regular, packed, compact, delta and bundled ones all count the same. Only a packet that will get to the application
+//	counts, so a bad one doesn't replace anything.
+static void hcn_batch_scan(struct HCN_batch_newest *newest, int index, int player_number, const struct HCN_packet_view *view) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	struct HCN_datapoint_view dps;
+	struct HCN_wide_datapoint packed[HCN_MAX_PACKED_DATAPOINTS];
+	struct HCN_vector_view vectors;
+	struct HCN_subject_vector compact[HCN_MAX_COMPACT_VECTORS];
+	struct HCN_packet_view message;
+	const unsigned char *p;
+	bool subject_ok = hcn_current->vector_block_callback != NULL || hcn_current->subject_vector_callback != NULL;
+	int i, count, offset;
+
+	switch (view->packet_type) {
+
+	case HCN_PACKET_DATAPOINT:
+		if (!hcn_view_datapoints(view, &dps)) return;
+		for (i = 0; i < dps.count; i++) if (hcn_current->datapoint_handlers[dps.dps[i].dp_type].handler == NULL) return;
+		for (i = 0; i < dps.count; i++) hcn_batch_mark(newest, index, pi, dps.dps[i].dp_type, 0, 0);
+		break;;
+
+	case HCN_PACKET_PACKED_DATAPOINT:
+		if ((count = hcn_view_packed_datapoints(view, packed)) < 0) return;
+		for (i = 0; i < count; i++) hcn_batch_mark(newest, index, pi, packed[i].dp_type, 0, 0);
+		break;;
+
+	case HCN_PACKET_VECTOR:
+		if (!hcn_view_vectors(view, &vectors)) return;
+		for (i = 0; i < vectors.count; i++) if (!hcn_vector_type_ok(vectors.vectors[i].vector_type)) return;
+		for (i = 0; i < vectors.count; i++) hcn_batch_mark(newest, index, pi, 0, vectors.vectors[i].vector_type, 0);
+		break;;
+
+	case HCN_PACKET_COMPACT_VECTOR:
+		if ((count = hcn_view_compact_vectors(view, compact)) < 0) return;
+		for (i = 0; i < count; i++) if (!subject_ok && hcn_current->vector_handlers[compact[i].vector_type].handler == NULL) return;
+		for (i = 0; i < count; i++) hcn_batch_mark(newest, index, pi, 0, compact[i].vector_type, compact[i].subject);
+		break;;
+
+	// A change from a packet we don't have any more counts too. It's rare, and there's a keyframe on the way.
+	case HCN_PACKET_DELTA_VECTOR:
+		if (view->body_length < 2 || view->body[0] > HCN_MAX_COMPACT_VECTORS || view->body[1] == 0) return;
+		for (i = 0, offset = 2; i < view->body[0]; i++) {
+			p = view->body + offset;
+			if (offset + 3 > view->body_length || offset + (p[2] == 0 ? 9 : 6) > view->body_length) return;
+			if (!subject_ok && hcn_current->vector_handlers[p[0]].handler == NULL) return;
+			offset += (p[2] == 0) ? 9 : 6;
+		}
+		for (i = 0, offset = 2; i < view->body[0]; i++) {
+			p = view->body + offset;
+			hcn_batch_mark(newest, index, pi, 0, p[0], p[1]);
+			offset += (p[2] == 0) ? 9 : 6;
+		}
+		break;;
+
+	case HCN_PACKET_BUNDLE:
+		if (view->body_length < 1) return;
+		for (i = 0, offset = 1; i < view->body[0]; i++) {			// Same checks as hcn_bundle_view_handler().
+			if (offset + 2 > view->body_length || offset + 2 + view->body[offset + 1] > view->body_length) return;
+			if (view->body[offset] == HCN_PACKET_HANDSHAKE || view->body[offset] == HCN_PACKET_BUNDLE || !hcn_known_packet_type(view->body[offset])) return;
+			offset += 2 + view->body[offset + 1];
+		}
+		for (i = 0, offset = 1; i < view->body[0]; i++) {
+			message.packet_type = (HCN_packet_type)view->body[offset];
+			message.preamble = NULL;
+			message.body = view->body + offset + 2;
+			message.body_length = view->body[offset + 1];
+			offset += 2 + message.body_length;
+			hcn_batch_scan(newest, index, player_number, &message);
+		}
+		break;;
+	}
+}
+
+// hcn_process_chat_chunk() - hcn_process_chat_batch() for up to HCN_BATCH_CHUNK chat strings.
+static int hcn_process_chat_chunk(struct HCN_chat_batch_entry *batch, int count) {
+	struct HCN_packet_view views[HCN_BATCH_CHUNK];
+	struct HCN_batch_newest newest;
+	struct HCN_batch_newest *outer = hcn_newest;
+	struct HCN_preamble *preamble;
+	bool coalesce = (hcn_current->packet_callback == NULL);		// The packet callback gets to see every packet.
+	int i, length, handled = 0;
+
+	// Classify and decode everything first.
+	for (i = 0; i < count; i++) {
+		batch[i].handled = false;
+		views[i].preamble = NULL;
+
+		if (hcn_current->pipelining) {					// The worker does the rest.
+			batch[i].handled = hcn_process_chat(batch[i].player_number, batch[i].chat_type, batch[i].chat);
+			continue;
+		}
+
+		switch (hcn_classify_chat(batch[i].chat_type, batch[i].chat)) {
+		case HCN_CHAT_NOT_HCN:
+			continue;
+		case HCN_CHAT_MALFORMED:
+			hcn_logger(HCN_LOG_DEBUG, "hcn_process_chat(): Malformed packet preamble from player %d", batch[i].player_number);
+			continue;
+		}
+		if ((length = hcn_decode_chat(batch[i].chat_type, batch[i].chat)) == 0) continue;
+
+		preamble = (struct HCN_preamble *)batch[i].chat;
+		hcn_make_view(&views[i], preamble, length);
+	}
+
+	// Then find the newest of each datapoint and vector, so older ones in the chunk can be skipped.
+	if (coalesce) {
+		memset(newest.datapoint, 0, sizeof(newest.datapoint));
+		memset(newest.vector_key, 0, sizeof(newest.vector_key));
+		for (i = 0; i < count; i++) {
+			if (views[i].preamble != NULL && views[i].packet_type != HCN_PACKET_HANDSHAKE) hcn_batch_scan(&newest, i, batch[i].player_number, &views[i]);
+		}
+	}
+
+	// Then handle them in the order they came in, handshakes and all.
+	hcn_newest = coalesce ? &newest : NULL;
+	for (i = 0; i < count; i++) {
+		if (views[i].preamble == NULL) continue;
+
+		newest.current = i;
+		if (views[i].packet_type == HCN_PACKET_HANDSHAKE) {
+			batch[i].handled = hcn_handshake_packet_handler(batch[i].player_number, (const struct HCN_handshake *)views[i].preamble, views[i].body_length + sizeof(struct HCN_preamble));
+		}
+		else batch[i].handled = hcn_dispatch_view(batch[i].player_number, &views[i]);
+	}
+	hcn_newest = outer;
+
+	for (i = 0; i < count; i++) if (batch[i].handled) handled++;
+	return handled;
+}
+
+// hcn_process_chat_batch() - Process the chat strings collected over a tick all at once. Each one is classified and
+//	decoded, then they're handled in the order they came in. Only the newest datapoint of each type and vector of each
+//	type and subject from each player gets to the callbacks, whichever kind of packet it came in, unless there's a
+//	packet callback. Each entry's handled is set to what hcn_process_chat() would have returned. Returns how many
+//	were handled.
+int hcn_process_chat_batch(struct HCN_chat_batch_entry *batch, int count) {
+	struct HCN_vector_block block;
+	bool collecting = hcn_collect_vectors(&block);				// The whole batch's vectors go in one block.
+	int handled = 0;
+
+	for (int start = 0; start < count; start += HCN_BATCH_CHUNK) {
+		handled += hcn_process_chat_chunk(batch + start, (count - start < HCN_BATCH_CHUNK) ? count - start : HCN_BATCH_CHUNK);
+	}
+	if (collecting) hcn_collect_done(&block);
+	return handled;
+}
+
+// hcn_datapoint_view_handler() - Hand each datapoint in a packet view to the application. The callbacks get pointers
+//	straight into the packet.
+bool hcn_datapoint_view_handler(int player_number, const struct HCN_packet_view *view) {
+	int i;
+	HCN_datapoint_type dp_type;
+	struct HCN_datapoint_view dps;
+
+	if (!hcn_view_datapoints(view, &dps)) {
+		hcn_logger(HCN_LOG_DEBUG, "Datapoint packet is short, %d bytes", view->body_length);
+		return false;
+	}
+
+	for (i = 0; i < dps.count; i++) {
+		dp_type = dps.dps[i].dp_type;
+		if (hcn_current->datapoint_handlers[dp_type].handler == NULL) {
+			hcn_logger(HCN_LOG_DEBUG, "Invalid datapoint type %d", dp_type);
+			return false;						// ABORT if the datapoint type is unknown. Chances are the rest of the packet is bad anyway.
+		}
+		if (hcn_replaced_datapoint(player_number, dp_type)) continue;	// There's a newer one further on in the batch.
+		hcn_handle_datapoint(player_number, dp_type, &dps.dps[i]);	// Call the application's handler for this datapoint type.
+	}
+	return true;
+
+}
+
+// hcn_varint_put() - Put a value in as a varint, 7 bits a byte. Returns how many bytes it took, at most 10.
+static inline int hcn_varint_put(unsigned char *out, unsigned long long value) {
+	int n = 0;
+
+	while (value >= 0x80) {
+		out[n++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	out[n++] = (unsigned char)value;
+	return n;
+}
+
+// hcn_varint_get() - Get a varint back out. Returns how many bytes it took, or 0 if it runs off the end or is too long.
+static inline int hcn_varint_get(const unsigned char *in, int length, unsigned long long *value) {
+	*value = 0;
+
+	for (int n = 0; n < length && n < 10; n++) {
+		*value |= (unsigned long long)(in[n] & 0x7F) << (7 * n);
+		if (!(in[n] & 0x80)) return n + 1;
+	}
+	return 0;
+}
+
+// hcn_varint_length() - How many bytes a value takes as a varint.
+static inline int hcn_varint_length(unsigned long long value) {
+	int n = 1;
+
+	while (value >= 0x80) {
+		value >>= 7;
+		n++;
+	}
+	return n;
+}
+
+// Zigzag a signed value, 0, -1, 1, -2... to 0, 1, 2, 3..., and back.
+static inline unsigned long long hcn_zigzag(long long value) {
+
+	return ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63);
+}
+
+static inline long long hcn_unzigzag(unsigned long long value) {
+
+	return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+// hcn_packed_datapoint_put() - Put a datapoint in a packed datapoint packet. Returns how many bytes it took, at most
+//	12, or 0 if the kind isn't one we know.
+static int hcn_packed_datapoint_put(unsigned char *out, const struct HCN_wide_datapoint *dp) {
+	float f;
+
+	out[0] = dp->dp_type;
+	out[1] = dp->kind;
+	switch (dp->kind) {
+	case HCN_DP_INT:
+		return 2 + hcn_varint_put(out + 2, hcn_zigzag(dp->dp_int));
+		break;;
+	case HCN_DP_UINT:
+		return 2 + hcn_varint_put(out + 2, dp->dp_uint);
+		break;;
+	case HCN_DP_FLOAT:
+		memcpy(out + 2, &dp->dp_float, 4);
+		return 6;
+		break;;
+	case HCN_DP_INT64:
+		return 2 + hcn_varint_put(out + 2, hcn_zigzag(dp->dp_int64));
+		break;;
+	case HCN_DP_DOUBLE:
+		f = (float)dp->dp_double;
+		if ((double)f == dp->dp_double) {				// Nothing lost as a float.
+			out[1] |= HCN_DP_AS_FLOAT;
+			memcpy(out + 2, &f, 4);
+			return 6;
+		}
+		memcpy(out + 2, &dp->dp_double, 8);
+		return 10;
+		break;;
+	}
+	return 0;
+}
+
+// hcn_packed_datapoint_get() - Get a datapoint out of a packed datapoint packet. Returns how many bytes it took, or 0
+//	if it's bad.
+static int hcn_packed_datapoint_get(const unsigned char *in, int length, struct HCN_wide_datapoint *dp) {
+	unsigned long long value;
+	float f;
+	int n;
+
+	if (length < 3) return 0;
+	dp->dp_type = (HCN_datapoint_type)in[0];
+	dp->kind = (HCN_datapoint_kind)(in[1] & ~HCN_DP_AS_FLOAT);
+
+	switch (in[1]) {
+	case HCN_DP_INT:
+	case HCN_DP_UINT:
+	case HCN_DP_INT64:
+		n = hcn_varint_get(in + 2, length - 2, &value);
+		if (n == 0 || (dp->kind != HCN_DP_INT64 && value > 0xFFFFFFFFull)) return 0;
+		if (dp->kind == HCN_DP_INT) dp->dp_int = (int)hcn_unzigzag(value);
+		else if (dp->kind == HCN_DP_UINT) dp->dp_uint = (unsigned int)value;
+		else dp->dp_int64 = hcn_unzigzag(value);
+		return 2 + n;
+		break;;
+	case HCN_DP_FLOAT:
+		if (length < 6) return 0;
+		memcpy(&dp->dp_float, in + 2, 4);
+		return 6;
+		break;;
+	case HCN_DP_DOUBLE | HCN_DP_AS_FLOAT:
+		if (length < 6) return 0;
+		memcpy(&f, in + 2, 4);
+		dp->dp_double = f;
+		return 6;
+		break;;
+	case HCN_DP_DOUBLE:
+		if (length < 10) return 0;
+		memcpy(&dp->dp_double, in + 2, 8);
+		return 10;
+		break;;
+	}
+	return 0;
+}
+
+// hcn_packed_datapoint_narrow() - The smallest way to pack a regular datapoint. It doesn't say what it holds, so it
+//	goes as whichever of int, unsigned int or float is shortest. They all come back out as the same 32 bits.
+static void hcn_packed_datapoint_narrow(const struct HCN_datapoint *dp, struct HCN_wide_datapoint *wide) {
+	int int_length = hcn_varint_length(hcn_zigzag(dp->dp_int));
+	int uint_length = hcn_varint_length(dp->dp_uint);
+
+	wide->dp_type = dp->dp_type;
+	if (uint_length <= int_length && uint_length <= 4) {
+		wide->kind = HCN_DP_UINT;
+		wide->dp_uint = dp->dp_uint;
+	}
+	else if (int_length <= 4) {
+		wide->kind = HCN_DP_INT;
+		wide->dp_int = dp->dp_int;
+	}
+	else {
+		wide->kind = HCN_DP_FLOAT;
+		wide->dp_float = dp->dp_float;
+	}
+}
+
+// hcn_view_packed_datapoints() - Unpack the datapoints in a packed datapoint packet view into dps, which needs room
+//	for HCN_MAX_PACKED_DATAPOINTS, and check they can all be handed to the application. Returns how many there were,
+//	or -1 if any of them are bad.
+static int hcn_view_packed_datapoints(const struct HCN_packet_view *view, struct HCN_wide_datapoint *dps) {
+	int i, n, count, offset;
+
+	if (view->body_length < 1 || view->body[0] > HCN_MAX_PACKED_DATAPOINTS) {
+		hcn_logger(HCN_LOG_DEBUG, "Packed datapoint packet is bad, %d bytes", view->body_length);
+		return -1;
+	}
+	count = view->body[0];
+
+	for (i = 0, offset = 1; i < count; i++) {
+		n = hcn_packed_datapoint_get(view->body + offset, view->body_length - offset, &dps[i]);
+		if (n == 0) {
+			hcn_logger(HCN_LOG_DEBUG, "Packed datapoint packet is short, %d bytes", view->body_length);
+			return -1;
+		}
+		offset += n;
+
+		if (hcn_current->wide_datapoint_handlers[dps[i].dp_type].handler != NULL) continue;
+		if (hcn_current->datapoint_handlers[dps[i].dp_type].handler == NULL || dps[i].kind == HCN_DP_INT64 || dps[i].kind == HCN_DP_DOUBLE) {
+			hcn_logger(HCN_LOG_DEBUG, "Invalid datapoint type %d, kind %d", dps[i].dp_type, dps[i].kind);
+			return -1;
+		}
+	}
+	return count;
+}
+
+// hcn_packed_datapoint_view_handler() - Hand each datapoint in a packed datapoint packet to the application. They're
+//	all unpacked and checked first, so a bad one means none of them are handled.
+bool hcn_packed_datapoint_view_handler(int player_number, const struct HCN_packet_view *view) {
+	struct HCN_wide_datapoint dps[HCN_MAX_PACKED_DATAPOINTS];
+	const struct HCN_wide_datapoint_handler *wide;
+	struct HCN_datapoint dp;
+	int i, count;
+
+	if ((count = hcn_view_packed_datapoints(view, dps)) < 0) return false;
+
+	for (i = 0; i < count; i++) {
+		if (hcn_replaced_datapoint(player_number, dps[i].dp_type)) continue;	// There's a newer one further on in the batch.
+		wide = &hcn_current->wide_datapoint_handlers[dps[i].dp_type];
+		if (wide->handler != NULL) {
+			wide->handler(wide->context, player_number, &dps[i]);
+			continue;
+		}
+		dp.dp_type = dps[i].dp_type;
+		dp.dp_uint = dps[i].dp_uint;					// The same 32 bits, whichever of the three it was.
+		hcn_handle_datapoint(player_number, dp.dp_type, &dp);
+	}
+	return true;
+}
+
+// The compression dictionary. Both sides have to have the exact same one, so NEVER change it. A new dictionary needs a
+//	new capability. Things that are said a lot go towards the end, where they're found first.
+static const char hcn_dictionary[] =
+	"http://www. the and for you with that this from have are was not all can has its out but one new get"
+	" Welcome to the server! Type !help for a list of commands. Please be respectful. No camping. No team killing. "
+	"Blood Gulch Sidewinder Hang 'Em High Battle Creek Chill Out Danger Canyon Death Island Derelict Gephyrophobia "
+	"Ice Fields Infinity Longest Prisoner Rat Race Timberland Wizard Damnation Boarding Action Capture the Flag "
+	"Slayer King of the Hill Oddball Juggernaut Race Team Red Team Blue Team Red team Blue team scored! wins! "
+	"Game over. Next map: Map changed to seconds remaining. minutes remaining. Server is restarting. "
+	"Warthog Banshee Ghost Scorpion Rocket Launcher Sniper Rifle Assault Rifle Plasma Pistol Shotgun Fuel Rod Needler "
+	"grenade Overshield Active Camouflage Health pack respawn in disconnected. left the game. joined the game. "
+	" was kicked was banned by the server is now a player killed themselves. was killed by  with a double kill "
+	"killing spree running riot Speed jump ON Speed jump OFF  is not allowed  is enabled  is disabled  has the flag! "
+	"dropped the flag! returned the flag! Flag captured by  captured the flag! =true=false=on=off=yes=no=1=0";
+
+#define HCN_DICTIONARY_LENGTH	((int)sizeof(hcn_dictionary) - 1)
+#define HCN_COMPRESS_WINDOW	(2 * HCN_DICTIONARY_LENGTH + HCN_COMPRESSED_MAX_BODY)
+#define HCN_COMPRESS_HASH	4096
+#define HCN_COMPRESS_CHAIN	32						// Most earlier matches looked at, so it stays quick.
+
+static_assert(HCN_COMPRESS_WINDOW <= 0x7FFF, "Compression window has to fit in a short, and distances in two bytes");
+
+// hcn_dictionary_byte() - Byte i of the dictionary, as 8-bit or UTF-16 characters.
+static inline unsigned char hcn_dictionary_byte(int i, bool wide) {
+
+	if (!wide) return hcn_dictionary[i];
+	return (i & 1) ? 0 : hcn_dictionary[i >> 1];
+}
+
+// hcn_compress_hash() - Hash of the HCN_COMPRESS_MIN_MATCH bytes at p.
+static inline int hcn_compress_hash(const unsigned char *p) {
+
+	return ((p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24)) * 2654435761u) >> 20;
+}
+
+// HCN_dictionary_chains - The dictionary, as 8-bit or UTF-16 characters, already in the hash chains. Every compress
+//	starts from a copy, so only the body has to be hashed.
+struct HCN_dictionary_chains {
+	unsigned char window[2 * HCN_DICTIONARY_LENGTH];
+	short head[HCN_COMPRESS_HASH];
+	short prev[2 * HCN_DICTIONARY_LENGTH];
+};
+
+// hcn_dictionary_chains_build() - Hash the dictionary both ways. The last few bytes of it are left out, their hash
+//	takes in the start of the body.
+static bool hcn_dictionary_chains_build(struct HCN_dictionary_chains chains[2]) {
+	struct HCN_dictionary_chains *c;
+	int i, pos, start;
+
+	for (int wide = 0; wide < 2; wide++) {
+		c = &chains[wide];
+		start = wide ? 2 * HCN_DICTIONARY_LENGTH : HCN_DICTIONARY_LENGTH;
+		for (i = 0; i < start; i++) c->window[i] = hcn_dictionary_byte(i, wide != 0);
+		for (i = 0; i < HCN_COMPRESS_HASH; i++) c->head[i] = -1;
+		for (pos = 0; pos + HCN_COMPRESS_MIN_MATCH <= start; pos++) {
+			i = hcn_compress_hash(c->window + pos);
+			c->prev[pos] = c->head[i];
+			c->head[i] = pos;
+		}
+	}
+	return true;
+}
+
+// hcn_dictionary_chains() - The dictionary's hash chains, built the first time they're needed.
+static const struct HCN_dictionary_chains *hcn_dictionary_chains(bool wide) {
+	static struct HCN_dictionary_chains chains[2];
+	static bool built = hcn_dictionary_chains_build(chains);		// Only ever runs once, even with threads.
+
+	(void)built;
+	return &chains[wide ? 1 : 0];
+}
+
+// hcn_compress() - LZ compress length bytes of body against the dictionary, into at most limit bytes of out. Greedy, with
+//	hash chains that go back through the dictionary too. Everything's on the stack. Returns the compressed length, or
+//	0 if it didn't fit.
+static int hcn_compress(unsigned char *out, int limit, const unsigned char *body, int length, bool wide) {
+	const struct HCN_dictionary_chains *chains = hcn_dictionary_chains(wide);
+	unsigned char window[HCN_COMPRESS_WINDOW];
+	short head[HCN_COMPRESS_HASH];
+	short prev[HCN_COMPRESS_WINDOW];
+	int start = wide ? 2 * HCN_DICTIONARY_LENGTH : HCN_DICTIONARY_LENGTH;	// Where the body starts in the window.
+	int end = start + length;
+	int i, pos, n = 0, literals = 0, best, best_distance, match, candidate, chain;
+
+	if (length > HCN_COMPRESSED_MAX_BODY) return 0;
+	memcpy(window, chains->window, start);
+	memcpy(window + start, body, length);
+	memcpy(head, chains->head, sizeof(head));
+	memcpy(prev, chains->prev, start * sizeof(short));
+
+	for (pos = start - HCN_COMPRESS_MIN_MATCH + 1; pos < end; ) {		// The dictionary's already hashed, up to where the body comes in.
+		best = 0;
+		best_distance = 0;
+		if (pos + HCN_COMPRESS_MIN_MATCH <= end) {
+			i = hcn_compress_hash(window + pos);
+			if (pos >= start) {						// Look for a match, only in the body.
+				for (candidate = head[i], chain = 0; candidate >= 0 && chain < HCN_COMPRESS_CHAIN; candidate = prev[candidate], chain++) {
+					for (match = 0; match < HCN_COMPRESS_MAX_MATCH && pos + match < end && window[candidate + match] == window[pos + match]; match++);
+					if (match > best) {
+						best = match;
+						best_distance = pos - candidate;
+					}
+				}
+			}
+			prev[pos] = head[i];
+			head[i] = pos;
+		}
+
+		if (pos < start) {							// Still putting the end of the dictionary in the hash table.
+			pos++;
+			continue;
+		}
+
+		if (best < HCN_COMPRESS_MIN_MATCH) {				// No match, it goes as-is.
+			if (literals == 0) {
+				if (n + 1 > limit) return 0;
+				n++;
+			}
+			if (n + 1 > limit) return 0;
+			out[n++] = window[pos++];
+			literals++;
+			out[n - literals - 1] = literals - 1;				// The run's length byte, in front of it.
+			if (literals == 0x80) literals = 0;			// That run's full, the next one starts a new run.
+			continue;
+		}
+
+		if (n + 3 > limit) return 0;
+		out[n++] = 0x80 | (best - HCN_COMPRESS_MIN_MATCH);
+		out[n++] = best_distance & 0xFF;
+		out[n++] = best_distance >> 8;
+		literals = 0;
+
+		for (i = 1, pos++; i < best; i++, pos++) {			// Put the rest of what matched in the hash table.
+			if (pos + HCN_COMPRESS_MIN_MATCH > end) continue;
+			candidate = hcn_compress_hash(window + pos);
+			prev[pos] = head[candidate];
+			head[candidate] = pos;
+		}
+	}
+
+	return n;
+}
+
+// hcn_decompress() - Undo hcn_compress(), into at most limit bytes of out. Never reads or writes past either end,
+//	and takes time in proportion to what comes out. Returns the decompressed length, or -1 if it's bad.
+static int hcn_decompress(unsigned char *out, int limit, const unsigned char *in, int length, bool wide) {
+	int start = wide ? 2 * HCN_DICTIONARY_LENGTH : HCN_DICTIONARY_LENGTH;
+	int i, n = 0, count, from;
+
+	for (i = 0; i < length; ) {
+		if (in[i] == 0 && i + 1 == length) break;			// A zero all alone at the end is padding, to a whole 16-bit character.
+		if (in[i] < 0x80) {							// Bytes as-is.
+			count = in[i++] + 1;
+			if (i + count > length || n + count > limit) return -1;
+			memcpy(out + n, in + i, count);
+			i += count;
+			n += count;
+			continue;
+		}
+
+		if (i + 3 > length) return -1;
+		count = (in[i] & 0x7F) + HCN_COMPRESS_MIN_MATCH;
+		from = start + n - (in[i + 1] | (in[i + 2] << 8));		// Where it starts, counting the dictionary.
+		i += 3;
+		if (from < 0 || from >= start + n || n + count > limit) return -1;
+
+		for (; count > 0; count--, from++) {				// Byte by byte, a match can run into what it's copying.
+			out[n++] = (from < start) ? hcn_dictionary_byte(from, wide) : out[from - start];
+		}
+	}
+
+	return n;
+}
+
+// hcn_send_compressed() - Send a text or keyvalue packet compressed, if the other side takes it and that's smaller.
+//	Otherwise it goes as usual. wide is for UTF-16 text.
+static bool hcn_send_compressed(int player_number, HCN_packet_type type, const void *head, int head_length, const void *data, int data_length, int max_encoded, bool wide) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	unsigned char body[HCN_COMPRESSED_MAX_BODY];
+	unsigned char packed[HCN_COMPRESSED_BODY];
+	int length = head_length + data_length, n;
+
+	if (!(hcn_current->peer_capabilities[pi] & HCN_CAP_COMPRESSED) || length <= HCN_COMPRESS_MIN_MATCH || length > HCN_COMPRESSED_MAX_BODY) {
+		return hcn_send_body(player_number, type, head, head_length, data, data_length, max_encoded);
+	}
+
+	memcpy(body, head, head_length);
+	if (data_length > 0) memcpy(body + head_length, data, data_length);
+
+	packed[0] = type;
+	packed[1] = wide ? HCN_COMPRESS_WIDE : 0;
+	n = hcn_compress(packed + 2, HCN_COMPRESSED_BODY - 2, body, length, wide);
+	if (n == 0 || n + 2 >= length) {
+		return hcn_send_body(player_number, type, head, head_length, data, data_length, max_encoded);
+	}
+
+	hcn_logger(HCN_LOG_DEBUG2, "Packet of type %d compressed from %d to %d bytes for player %d", type, length, n + 2, player_number);
+	return hcn_send_body(player_number, HCN_PACKET_COMPRESSED, packed, n + 2, NULL, 0, HCN_COMPRESSED_MAX_ENCODED);
+}
+
+// hcn_compressed_view_handler() - Decompress a text or keyvalue packet, and dispatch it as if it had come in that way.
+bool hcn_compressed_view_handler(int player_number, const struct HCN_packet_view *view) {
+	unsigned char packet[sizeof(struct HCN_preamble) + HCN_COMPRESSED_MAX_BODY];	// Room in front, text views look back at the preamble.
+	struct HCN_packet_view message;
+	int length;
+
+	if (view->body_length < 2 || (view->body[1] & ~HCN_COMPRESS_WIDE)) {
+		hcn_logger(HCN_LOG_DEBUG, "Compressed packet is bad, %d bytes", view->body_length);
+		return false;
+	}
+
+	switch (view->body[0]) {
+	case HCN_PACKET_KEYVALUE:
+	case HCN_PACKET_TEXT:
+	case HCN_PACKET_KEY_DEFINE:
+	case HCN_PACKET_KEY_ID:
+		break;;
+	default:
+		hcn_logger(HCN_LOG_DEBUG, "Compressed packet has a packet of type %d, which isn't allowed", view->body[0]);
+		return false;
+	}
+
+	length = hcn_decompress(packet + sizeof(struct HCN_preamble), HCN_COMPRESSED_MAX_BODY, view->body + 2, view->body_length - 2, (view->body[1] & HCN_COMPRESS_WIDE) != 0);
+	if (length < 0) {
+		hcn_logger(HCN_LOG_DEBUG, "Compressed packet from player %d doesn't decompress", player_number);
+		return false;
+	}
+
+	message.packet_type = (HCN_packet_type)view->body[0];
+	message.preamble = NULL;
+	message.body = packet + sizeof(struct HCN_preamble);
+	message.body_length = length;
+	return hcn_dispatch_view(player_number, &message);
+}
+
+// hcn_vector_view_handler() - Hand each vector in a packet view to the application.
+bool hcn_vector_view_handler(int player_number, const struct HCN_packet_view *view) {
+	int i;
+	HCN_vector_type vt;
+	struct HCN_vector_view vectors;
+
+	if (!hcn_view_vectors(view, &vectors)) {
+		hcn_logger(HCN_LOG_DEBUG, "Vector packet is short, %d bytes", view->body_length);
+		return false;
+	}
+
+	if (hcn_current->vector_block_callback != NULL) {				// All of them at once, if they're all good.
+		struct HCN_subject_vector block[HCN_MAX_VECTORS];
+		int n = 0;
+
+		for (i = 0; i < vectors.count; i++) {
+			if (!hcn_vector_type_ok(vectors.vectors[i].vector_type)) {
+				hcn_logger(HCN_LOG_DEBUG, "Invalid vector type %d", vectors.vectors[i].vector_type);
+				return false;
+			}
+			if (hcn_replaced_vector(player_number, vectors.vectors[i].vector_type, 0)) continue;
+			block[n].vector_type = vectors.vectors[i].vector_type;
+			block[n].subject = 0;
+			block[n].vector = vectors.vectors[i].vector;
+			n++;
+		}
+		hcn_deliver_vector_block(player_number, block, n);
+	}
+	else for (i = 0; i < vectors.count; i++) {
+		vt = vectors.vectors[i].vector_type;
+		if (!hcn_vector_type_ok(vt)) {
+			hcn_logger(HCN_LOG_DEBUG, "Invalid vector type %d", vt);
+			return false;						// ABORT if the vector type is unknown. Chances are the rest of the packet is bad anyway.
+		}
+		if (hcn_replaced_vector(player_number, vt, 0)) continue;	// There's a newer one further on in the batch.
+		hcn_handle_vector(player_number, vt, &vectors.vectors[i].vector);	// Call the application's handler for this vector type.
+	}
+
+	if (hcn_current->dr_enabled) {							// Remember them for dead reckoning.
+		struct HCN_subject_vector received;
+
+		for (i = 0; i < vectors.count; i++) {
+			if (hcn_replaced_vector(player_number, vectors.vectors[i].vector_type, 0)) continue;
+			received.vector_type = vectors.vectors[i].vector_type;
+			received.subject = 0;
+			received.vector = vectors.vectors[i].vector;
+			hcn_dr_received(player_number, &received, 1);
+		}
+	}
+	return true;
+
+}
+
+// hcn_deliver_subject_vectors() - Hand vectors that say whose they are to the application. The subject vector callback
+//	gets them if there is one, otherwise the regular vector callbacks do. The block callback beats both.
+static bool hcn_deliver_subject_vectors(int player_number, struct HCN_subject_vector *vectors, int count) {
+	HCN_vector_type vt;
+
+	if (hcn_current->vector_block_callback != NULL) {
+		hcn_deliver_vector_block(player_number, vectors, count);
+		return true;
+	}
+
+	for (int i = 0; i < count; i++) {
+		vt = vectors[i].vector_type;
+		if (hcn_current->subject_vector_callback != NULL) {
+			hcn_current->subject_vector_callback(player_number, vt, vectors[i].subject, &vectors[i].vector);
+			continue;
+		}
+		if (hcn_current->vector_handlers[vt].handler == NULL) {
+			hcn_logger(HCN_LOG_DEBUG, "Invalid vector type %d", vt);
+			return false;						// ABORT if the vector type is unknown. Chances are the rest of the packet is bad anyway.
+		}
+		hcn_handle_vector(player_number, vt, &vectors[i].vector);
+	}
+	return true;
+
+}
+
+// hcn_dispatch_subject_vectors() - Vectors came in. Remember them for dead reckoning, and hand them to the application.
+//	Any that there's a newer one of further on in the batch are dropped first.
+static bool hcn_dispatch_subject_vectors(int player_number, struct HCN_subject_vector *vectors, int count) {
+	int n = 0;
+
+	for (int i = 0; i < count; i++) {
+		if (!hcn_replaced_vector(player_number, vectors[i].vector_type, vectors[i].subject)) vectors[n++] = vectors[i];
+	}
+	hcn_dr_received(player_number, vectors, n);
+	return hcn_deliver_subject_vectors(player_number, vectors, n);
+}
+
+// hcn_dr_tick() - Our guesses at a player's located vectors we didn't get an update for this tick, into vectors (room
+//	for HCN_DR_SLOTS) for the caller to hand to the application once it's let go of the player's lock. Returns how many,
+//	and which player_number they're from.
+static int hcn_dr_tick(int pi, struct HCN_subject_vector *vectors, int *player_number) {
+	struct HCN_dead_reckoning *dr = &hcn_current->dr[pi];
+	unsigned int age;
+	int i, n;
+
+	if (!hcn_current->dr_enabled) return 0;
+
+	for (i = 0, n = 0; i < dr->got_count; i++) {
+		age = hcn_current->tick_count + 1 - dr->got[i].tick;
+		if (!hcn_dr_located(dr->got[i].vector_type) || age == 0 || age > HCN_DR_MAX_TICKS) continue;
+
+		vectors[n].vector_type = dr->got[i].vector_type;
+		vectors[n].subject = dr->got[i].subject;
+		hcn_dr_predict(dr->got, &dr->got_count, &dr->got[i], hcn_current->tick_count + 1, &vectors[n].vector);
+		n++;
+	}
+	*player_number = dr->player_number;
+	return n;
+}
+
+// hcn_compact_vector_view_handler() - Hand each vector in a compact vector packet to the application.
+bool hcn_compact_vector_view_handler(int player_number, const struct HCN_packet_view *view) {
+	struct HCN_subject_vector vectors[HCN_MAX_COMPACT_VECTORS];
+	int count;
+
+	count = hcn_view_compact_vectors(view, vectors);
+	if (count < 0) {
+		hcn_logger(HCN_LOG_DEBUG, "Compact vector packet is short, %d bytes", view->body_length);
+		return false;
+	}
+	return hcn_dispatch_subject_vectors(player_number, vectors, count);
+
+}
+
+// hcn_delta_vector_view_handler() - Put the vectors in a delta vector packet back together from what we already have,
+//	and hand them to the application like compact vectors. A change from a packet we don't have any more is skipped,
+//	a keyframe will be along. The packet gets acked on the next hcn_on_tick().
+bool hcn_delta_vector_view_handler(int player_number, const struct HCN_packet_view *view) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	struct HCN_delta *delta = &hcn_current->delta[pi];
+	struct HCN_subject_vector vectors[HCN_MAX_COMPACT_VECTORS];
+	struct HCN_delta_recv_slot *slot;
+	const struct HCN_vector_bounds *bounds;
+	const unsigned char *p;
+	unsigned short q[3];
+	unsigned char sequence;
+	int i, k, h, count, offset, n = 0;
+
+	if (view->body_length < 2 || view->body[0] > HCN_MAX_COMPACT_VECTORS || view->body[1] == 0) {
+		hcn_logger(HCN_LOG_DEBUG, "Delta vector packet is bad, %d bytes", view->body_length);
+		return false;
+	}
+	count = view->body[0];
+	sequence = view->body[1];
+
+	std::unique_lock<std::recursive_mutex> guard(hcn_player_lock(player_number));	// Until the vectors are put back together.
+	for (i = 0, offset = 2; i < count; i++) {
+		p = view->body + offset;
+		if (offset + 3 > view->body_length || offset + (p[2] == 0 ? 9 : 6) > view->body_length) {
+			hcn_logger(HCN_LOG_DEBUG, "Delta vector packet is short, %d bytes", view->body_length);
+			return false;
+		}
+		offset += (p[2] == 0) ? 9 : 6;
+		slot = hcn_delta_recv_slot(delta, (HCN_vector_type)p[0], p[1]);
+
+		if (p[2] == 0) {						// Keyframe.
+			memcpy(q, p + 3, sizeof(q));
+		}
+		else {								// Change from a packet we should still have.
+			for (h = 0; slot != NULL && h < HCN_DELTA_HISTORY; h++) {
+				if (slot->got[h].sequence == p[2]) break;
+			}
+			if (slot == NULL || h == HCN_DELTA_HISTORY) {
+				hcn_logger(HCN_LOG_DEBUG, "Delta vector type %d subject %d is from packet %d, which we don't have", p[0], p[1], p[2]);
+				continue;
+			}
+			for (k = 0; k < 3; k++) q[k] = slot->got[h].q[k] + p[3 + k] - 128;
+		}
+
+		if (slot != NULL) {
+			slot->got[slot->next].sequence = sequence;
+			memcpy(slot->got[slot->next].q, q, sizeof(q));
+			slot->next = (slot->next + 1) % HCN_DELTA_HISTORY;
+		}
+
+		bounds = &hcn_current->vector_bounds[p[0]];
+		vectors[n].vector_type = (HCN_vector_type)p[0];
+		vectors[n].subject = p[1];
+		vectors[n].vector.x = hcn_dequantize(q[0], bounds->min.x, bounds->max.x);
+		vectors[n].vector.y = hcn_dequantize(q[1], bounds->min.y, bounds->max.y);
+		vectors[n].vector.z = hcn_dequantize(q[2], bounds->min.z, bounds->max.z);
+		n++;
+	}
+
+	delta->player_number = player_number;
+	hcn_delta_got(delta, sequence);						// Ack it on the next tick.
+	guard.unlock();
+
+	return hcn_dispatch_subject_vectors(player_number, vectors, n);
+}
+
+// hcn_delta_ack_view_handler() - The other side has these delta vector packets, the newest one and any of the 32
+//	before it that are marked. Everything in them can be used as a baseline now. Nothing else is taken as got, a
+//	packet that wasn't acked may never have arrived.
+bool hcn_delta_ack_view_handler(int player_number, const struct HCN_packet_view *view) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	struct HCN_delta *delta = &hcn_current->delta[pi];
+	struct HCN_delta_slot *slot;
+	unsigned int acked, newest, back, also = 0;
+	int i, h;
+	std::lock_guard<std::recursive_mutex> guard(hcn_player_lock(player_number));
+
+	if (view->body_length < 1 || view->body[0] == 0 || delta->serial == 0) return false;
+	if (view->body_length >= 1 + (int)sizeof(also)) memcpy(&also, view->body + 1, sizeof(also));
+
+	// Work out which packet serial the sequence number was. Anything sent 255 or more packets ago is long gone, and
+	//	one from further back than we've sent is from before a reset.
+	back = (hcn_delta_sequence(delta->serial) - view->body[0] + 255) % 255;
+	if (back >= delta->serial) {
+		hcn_logger(HCN_LOG_DEBUG, "Delta ack %d from player %d is for a packet we haven't sent", view->body[0], player_number);
+		return false;
+	}
+	acked = delta->serial - back;
+
+	for (i = 0; i < delta->slot_count; i++) {
+		slot = &delta->slots[i];
+		newest = h = -1;
+		for (int j = 0; j < HCN_DELTA_HISTORY; j++) {			// Newest packet with this vector, that's been acked.
+			back = acked - slot->sent[j].serial;
+			if (slot->sent[j].serial == 0 || slot->sent[j].serial > acked) continue;
+			if (back != 0 && (back > 32 || !(also & (1u << (back - 1))))) continue;
+			if (h < 0 || slot->sent[j].serial > newest) {
+				newest = slot->sent[j].serial;
+				h = j;
+			}
+		}
+		if (h >= 0 && newest > slot->acked_serial) {
+			slot->acked_serial = newest;
+			memcpy(slot->acked, slot->sent[h].q, sizeof(slot->acked));
+		}
+	}
+	return true;
+}
+
+// Set the callback for vectors in bulk. NULL goes back to the one at a time callbacks.
+void hcn_set_vector_block_callback(HCN_callback_vector_block callback) {
+
+	hcn_current->vector_block_callback = callback;
+}
+
+// Set the callback for vectors that say whose they are.
+void hcn_set_subject_vector_callback(HCN_callback_subject_vector callback) {
+
+	hcn_current->subject_vector_callback = callback;
+}
+
+// hcn_value_string() - A typed value as a string, for a callback that only takes strings. Bools are on or off, like
+//	SJ=ON. NULL if it's a string with no value.
+static char *hcn_value_string(const struct HCN_value *value, char (&buffer)[HCN_VALUE_LENGTH]) {
+
+	switch (value->value_type) {
+	case HCN_VALUE_BOOL:
+		strcpy_s(buffer, value->b ? "on" : "off");
+		break;;
+	case HCN_VALUE_INT:
+		sprintf_s(buffer, "%d", value->i);
+		break;;
+	case HCN_VALUE_FLOAT:
+		sprintf_s(buffer, "%g", value->f);
+		break;;
+	default:
+		return (char *)value->s;
+		break;;
+	}
+	return buffer;
+}
+
+// hcn_deliver_value() - Hand a value to a key's callback. The typed callback if it has one, otherwise the string one.
+static bool hcn_deliver_value(int player_number, const struct HCN_key_dispatch *entry, const struct HCN_value *value) {
+	char buffer[HCN_VALUE_LENGTH];
+
+	if (entry->typed_callback != NULL) return entry->typed_callback(player_number, entry->key, value);
+	if (entry->callback == NULL) return false;
+
+	entry->callback(player_number, entry->key, hcn_value_string(value, buffer));
+	return true;
+}
+
+// hcn_deliver_string() - Hand a value that came as a string to a key's callback.
+static bool hcn_deliver_string(int player_number, const struct HCN_key_dispatch *entry, const char *string) {
+	struct HCN_value value;
+
+	if (entry->typed_callback == NULL && entry->callback == NULL) return false;
+	if (entry->typed_callback == NULL) {
+		entry->callback(player_number, entry->key, (char *)string);
+		return true;
+	}
+
+	value.value_type = HCN_VALUE_STRING;
+	value.s = string;
+	return entry->typed_callback(player_number, entry->key, &value);
+}
+
+// hcn_keyvalue_view_handler() - Find the callback for a key. The key is matched right in the packet, and the
+//	callback gets the key string from the application's list, and a value pointing into the packet.
+bool hcn_keyvalue_view_handler(int player_number, const struct HCN_packet_view *view) {
+	struct HCN_key_dispatch *entry;
+	struct HCN_keyvalue_view kv;
+
+	if (!hcn_view_keyvalue(view, &kv)) {
+		hcn_logger(HCN_LOG_DEBUG, "keyvalue length did not match actual length - sent=%d, packet=%d", view->body_length > 0 ? view->body[0] : 0, view->body_length);
+		return false;
+	}
+
+	hcn_logger(HCN_LOG_DEBUG2, "keyvalue = %.*s for player %d", kv.key_length, kv.key, player_number);
+
+	// See if we have a callback for this key/value pair.
+	if (hcn_current->key_dispatch_list == NULL) {
+		hcn_logger(HCN_LOG_WARN, "HCN got a keyvalue but the application hasn't defined a list of keyvalues");
+		return false;
+	}
+
+	entry = hcn_key_lookup(kv.key, kv.key_length);
+	if (entry == NULL) return false;
+
+	return hcn_deliver_string(player_number, entry, kv.value);
+}
+
+// hcn_keys_reset() - Forget all numbered keys, both ways.
+static void hcn_keys_reset(struct HCN_keys *keys) {
+
+	keys->sent.count = keys->sent.used = 0;
+	keys->got.count = keys->got.used = 0;
+	keys->generation = 0;
+}
+
+// hcn_key_table_find() - The number of a key in a key table, 0 if it isn't there. Keys are matched exactly, case and all.
+static int hcn_key_table_find(const struct HCN_key_table *table, const char *key, int length) {
+	unsigned int hash = hcn_key_hash(key, length);
+	const char *k;
+
+	for (int i = 0; i < table->count; i++) {
+		k = table->keys + table->offset[i];
+		if (table->hash[i] == hash && memcmp(k, key, length) == 0 && k[length] == 0) return i + 1;
+	}
+	return 0;
+}
+
+// hcn_key_table_fits() - Can a key go in a key table as number id. It has to be the next number, or the last one again.
+static bool hcn_key_table_fits(const struct HCN_key_table *table, int id, int length) {
+	int used = (id == table->count && id > 0) ? table->offset[id - 1] : table->used;
+
+	return id > 0 && id <= HCN_KEY_IDS && id >= table->count && id <= table->count + 1 && used + length + 1 <= HCN_KEY_ID_SPACE;
+}
+
+// hcn_key_table_set() - Put a key in a key table as number id. False if it doesn't fit, see hcn_key_table_fits().
+static bool hcn_key_table_set(struct HCN_key_table *table, int id, const char *key, int length) {
+	int i = id - 1;
+
+	if (!hcn_key_table_fits(table, id, length)) return false;
+
+	if (id == table->count) table->used = table->offset[i];		// The last one again, it's replaced.
+	table->offset[i] = table->used;
+	table->hash[i] = hcn_key_hash(key, length);
+	memcpy(table->keys + table->used, key, length);
+	table->keys[table->used + length] = 0;
+	table->used += length + 1;
+	table->count = id;
+	return true;
+}
+
+// hcn_key_defined() - A packet giving a key a number to the other side was just sent, or queued. The number only counts
+//	once the packet has gone, so a queued one is marked, and hcn_outbound_send() counts it. Until then the key gets
+//	numbered again if it's sent again, with the same number; the other side takes that as the last one again.
+static void hcn_key_defined(int player_number, int id, const char *key, int length) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	struct HCN_lane_queue *lane = &hcn_current->outbound[pi].lanes[HCN_LANE_CONTROL];
+	struct HCN_queued *entry;
+
+	if (!hcn_current->scheduling) {
+		hcn_key_table_set(&hcn_current->keys[pi].sent, id, key, length);
+		return;
+	}
+
+	entry = &lane->entries[(lane->head + lane->count - 1) % HCN_LANE_DEPTH];	// It's the last one in.
+	entry->key_id = id;
+	memcpy(entry->key, key, length);
+	entry->key[length] = 0;
+}
+
+// hcn_key_entry() - Which entry in the application's key list a number the other side gave a key stands for. Looked up
+//	the first time it's used, and again if the key list changes. NULL if the key isn't in the list.
+static struct HCN_key_dispatch *hcn_key_entry(struct HCN_keys *keys, int id) {
+	struct HCN_key_dispatch *entry;
+	const char *key;
+
+	if (keys->generation != hcn_current->key_generation) {
+		memset(keys->got_entry, 0, sizeof(keys->got_entry));
+		keys->generation = hcn_current->key_generation;
+	}
+	if (keys->got_entry[id - 1] == 0) {
+		key = keys->got.keys + keys->got.offset[id - 1];
+		entry = hcn_key_lookup(key, strlen(key));
+		keys->got_entry[id - 1] = (entry == NULL) ? HCN_KEY_UNLISTED : (unsigned short)(entry - hcn_current->key_dispatch_list + 1);
+	}
+	if (keys->got_entry[id - 1] == HCN_KEY_UNLISTED) return NULL;
+	return &hcn_current->key_dispatch_list[keys->got_entry[id - 1] - 1];
+}
+
+// hcn_key_define_view_handler() - The other side numbered a key. Remember the number, and handle the keyvalue pair
+//	that came with it like any other.
+bool hcn_key_define_view_handler(int player_number, const struct HCN_packet_view *view) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	struct HCN_keys *keys = &hcn_current->keys[pi];
+	struct HCN_packet_view keyvalue;
+	struct HCN_keyvalue_view kv;
+
+	if (view->body_length < 1) return false;
+
+	keyvalue.packet_type = HCN_PACKET_KEYVALUE;				// After the number, it's a keyvalue packet.
+	keyvalue.preamble = view->preamble;
+	keyvalue.body = view->body + 1;
+	keyvalue.body_length = view->body_length - 1;
+	{
+		std::lock_guard<std::recursive_mutex> guard(hcn_player_lock(player_number));
+
+		if (!hcn_view_keyvalue(&keyvalue, &kv) || !hcn_key_table_set(&keys->got, view->body[0], kv.key, kv.key_length)) {
+			hcn_logger(HCN_LOG_DEBUG, "Bad key number %d from player %d, %d bytes", view->body[0], player_number, view->body_length);
+			return false;
+		}
+		keys->got_entry[view->body[0] - 1] = 0;
+	}
+
+	return hcn_keyvalue_view_handler(player_number, &keyvalue);
+}
+
+// hcn_key_id_view_handler() - A value for a numbered key. The callback gets the key string from the application's
+//	list, and a value pointing into the packet, same as for a keyvalue packet.
+bool hcn_key_id_view_handler(int player_number, const struct HCN_packet_view *view) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	struct HCN_keys *keys = &hcn_current->keys[pi];
+	struct HCN_key_dispatch *entry;
+	const char *value = NULL;
+	int id, length;
+
+	if (view->body_length < 2) return false;
+
+	id = view->body[0];
+	length = view->body[1];
+	if (length > 0) {
+		value = (const char *)view->body + 2;
+		if (2 + length > view->body_length || memchr(value, 0, length) != value + length - 1) {
+			hcn_logger(HCN_LOG_DEBUG, "Key number packet is short or not terminated, %d bytes", view->body_length);
+			return false;
+		}
+	}
+
+	if (hcn_current->key_dispatch_list == NULL) {
+		hcn_logger(HCN_LOG_WARN, "HCN got a keyvalue but the application hasn't defined a list of keyvalues");
+		return false;
+	}
+	{
+		std::lock_guard<std::recursive_mutex> guard(hcn_player_lock(player_number));
+
+		if (id == 0 || id > keys->got.count) {
+			hcn_logger(HCN_LOG_DEBUG, "Player %d used key number %d, which they haven't sent", player_number, id);
+			return false;
+		}
+		entry = hcn_key_entry(keys, id);
+	}
+	if (entry == NULL) return false;
+
+	return hcn_deliver_string(player_number, entry, value);
+}
+
+// hcn_view_typed_keyvalue() - Pull apart a typed keyvalue packet. key is NULL if there's only a number. False if the
+//	packet doesn't hold together.
+static bool hcn_view_typed_keyvalue(const struct HCN_packet_view *view, int *id, bool *define, const char **key, int *key_length, struct HCN_value *value) {
+	const unsigned char *body = view->body;
+	int length, n = 2;
+
+	if (view->body_length < 2) return false;
+
+	value->value_type = (HCN_value_type)(body[0] & ~HCN_TYPED_DEFINE);
+	*define = (body[0] & HCN_TYPED_DEFINE) != 0;
+	*id = body[1];
+	*key = NULL;
+	*key_length = 0;
+	if (*id == 0 || *define) {						// The key is here.
+		if (n + 1 > view->body_length || body[n] == 0 || n + 1 + body[n] > view->body_length) return false;
+		*key_length = body[n];
+		*key = (const char *)body + n + 1;
+		n += 1 + *key_length;
+	}
+
+	switch (value->value_type) {
+	case HCN_VALUE_BOOL:
+		if (n + 1 > view->body_length) return false;
+		value->b = body[n] != 0;
+		break;;
+	case HCN_VALUE_INT:
+		if (n + 4 > view->body_length) return false;
+		memcpy(&value->i, body + n, 4);
+		break;;
+	case HCN_VALUE_FLOAT:
+		if (n + 4 > view->body_length) return false;
+		memcpy(&value->f, body + n, 4);
+		break;;
+	case HCN_VALUE_STRING:
+		if (n + 1 > view->body_length) return false;
+		length = body[n];
+		value->s = (length == 0) ? NULL : (const char *)body + n + 1;
+		if (length > 0 && (n + 1 + length > view->body_length || memchr(value->s, 0, length) != value->s + length - 1)) return false;
+		break;;
+	default:
+		return false;							// A type we don't know about.
+	}
+	return true;
+}
+
+// hcn_typed_keyvalue_view_handler() - A key with a binary value. The key is either in the packet, or a number, or
+//	both if it's being numbered.
+bool hcn_typed_keyvalue_view_handler(int player_number, const struct HCN_packet_view *view) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	struct HCN_keys *keys = &hcn_current->keys[pi];
+	struct HCN_key_dispatch *entry;
+	struct HCN_value value;
+	const char *key;
+	int id, key_length;
+	bool define;
+
+	if (!hcn_view_typed_keyvalue(view, &id, &define, &key, &key_length, &value)) {
+		hcn_logger(HCN_LOG_DEBUG, "Typed keyvalue packet is bad, %d bytes", view->body_length);
+		return false;
+	}
+
+	{
+		std::lock_guard<std::recursive_mutex> guard(hcn_player_lock(player_number));
+
+		if (define) {
+			if (!hcn_key_table_set(&keys->got, id, key, key_length)) {
+				hcn_logger(HCN_LOG_DEBUG, "Bad key number %d from player %d", id, player_number);
+				return false;
+			}
+			keys->got_entry[id - 1] = 0;
+		}
+		else if (id > keys->got.count) {
+			hcn_logger(HCN_LOG_DEBUG, "Player %d used key number %d, which they haven't sent", player_number, id);
+			return false;
+		}
+
+		if (hcn_current->key_dispatch_list == NULL) {
+			hcn_logger(HCN_LOG_WARN, "HCN got a keyvalue but the application hasn't defined a list of keyvalues");
+			return false;
+		}
+		entry = (id != 0) ? hcn_key_entry(keys, id) : hcn_key_lookup(key, key_length);
+	}
+	if (entry == NULL) return false;
+
+	return hcn_deliver_value(player_number, entry, &value);
+}
+
+// hcn_text_view_handler() - Deal with text packets.
+bool hcn_text_view_handler(int player_number, const struct HCN_packet_view *view) {
+	const struct HCN_text_handler *handler;
+	HCN_text_type tt;
+	struct HCN_text_view text;
+	struct HCN_text_packet widened;
+
+	if (!hcn_view_text(view, &text)) {
+		hcn_logger(HCN_LOG_DEBUG, "Text packet is short or not terminated, %d bytes", view->body_length);
+		return false;
+	}
+
+	tt = text.text_type;
+	handler = &hcn_current->text_handlers[tt];
+	if (handler->handler == NULL) {
+		hcn_logger(HCN_LOG_DEBUG, "Invalid text type %d", tt);
+		return false;						// ABORT if the text type is unknown. Chances are the rest of the packet is bad anyway.
+	}
+
+	if (text.narrowed) {							// It was UTF-16 when it was sent, so it gets handed over that way.
+		if (text.length + 1 > HCN_TEXT_LENGTH) {
+			hcn_logger(HCN_LOG_DEBUG, "Narrowed text is too long to widen, %d characters", text.length + 1);
+			return false;
+		}
+		widened.text_type = tt;
+		widened.color = text.color;
+		widened.text_length = text.length + 1;
+		hcn_widen_kernel(widened.text, text.text8, text.length + 1);
+		text.packet = &widened;
+	}
+	handler->handler(handler->context, player_number, tt, (struct HCN_text_packet *)text.packet);	// Call the application's handler for this text type.
+	return true;
+
+}
+
+// hcn_bundle_view_handler() - Unpack a bundle, and dispatch each message in it as if it had come in on its own.
+//	The whole bundle is checked before anything is dispatched. Returns true if any of the messages were handled.
+bool hcn_bundle_view_handler(int player_number, const struct HCN_packet_view *view) {
+	struct HCN_packet_view message;
+	int i, count, offset;
+	bool handled = false;
+
+	if (view->body_length < 1) return false;
+	count = view->body[0];
+
+	for (i = 0, offset = 1; i < count; i++) {				// Each message is [type][length][body].
+		if (offset + 2 > view->body_length || offset + 2 + view->body[offset + 1] > view->body_length) {
+			hcn_logger(HCN_LOG_DEBUG, "Bundle is short, message %d of %d doesn't fit in %d bytes", i + 1, count, view->body_length);
+			return false;
+		}
+		if (view->body[offset] == HCN_PACKET_HANDSHAKE || view->body[offset] == HCN_PACKET_BUNDLE || !hcn_known_packet_type(view->body[offset])) {
+			hcn_logger(HCN_LOG_DEBUG, "Bundle has a message of type %d, which isn't allowed", view->body[offset]);
+			return false;
+		}
+		offset += 2 + view->body[offset + 1];
+	}
+
+	for (i = 0, offset = 1; i < count; i++) {
+		message.packet_type = (HCN_packet_type)view->body[offset];
+		message.preamble = NULL;
+		message.body = view->body + offset + 2;
+		message.body_length = view->body[offset + 1];
+		offset += 2 + message.body_length;
+
+		handled |= hcn_dispatch_view(player_number, &message);
+	}
+
+	return handled;
+}
+
+// hcn_datapoint_packet_handler() - Decode a datapoint packet. Assume the packet has already been decoded and verified.
+bool hcn_datapoint_packet_handler(int player_number, HCN_packet *packet) {
+	struct HCN_packet_view view;
+
+	hcn_make_view(&view, (struct HCN_preamble *)packet, ((struct HCN_preamble *)packet)->packet_length * 2);
+	return hcn_datapoint_view_handler(player_number, &view);
+}
+
+// hcn_vector_packet_handler() - Decode a vector packet. Assume the packet has already been decoded and verified.
+bool hcn_vector_packet_handler(int player_number, HCN_packet *packet) {
+	struct HCN_packet_view view;
+
+	hcn_make_view(&view, (struct HCN_preamble *)packet, ((struct HCN_preamble *)packet)->packet_length * 2);
+	return hcn_vector_view_handler(player_number, &view);
+}
+
+// hcn_text_packet_handler() - Deal with text packets.
+bool hcn_text_packet_handler(int player_number, HCN_packet *packet) {
+	struct HCN_packet_view view;
+
+	hcn_make_view(&view, (struct HCN_preamble *)packet, ((struct HCN_preamble *)packet)->packet_length * 2);
+	return hcn_text_view_handler(player_number, &view);
+}
+
+// hcn_send_datapoints() - allow an application to provide a list of datapoints, and send them to the other side.
+//	If the other side can take packed datapoints, they go that way when it's smaller.
+bool hcn_send_datapoints(int player_number, struct HCN_datapoint *dps, int dp_count) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	std::lock_guard<std::recursive_mutex> guard(hcn_player_lock(player_number));
+	unsigned char body[1 + HCN_MAX_DATAPOINTS * 6];				// Packed, 6 bytes is the most a narrow one takes.
+	struct HCN_wide_datapoint wide;
+	int length = 1;
+
+	if ((hcn_current->peer_capabilities[pi] & HCN_CAP_PACKED_DATAPOINT) && dp_count > 0 && dp_count <= HCN_MAX_DATAPOINTS) {
+		body[0] = dp_count;
+		for (int i = 0; i < dp_count; i++) {
+			hcn_packed_datapoint_narrow(&dps[i], &wide);
+			length += hcn_packed_datapoint_put(body + length, &wide);
+		}
+		if (length < HCN_datapoint_schema::body_length(dp_count)) {
+			return hcn_send_body(player_number, HCN_PACKET_PACKED_DATAPOINT, body, length, NULL, 0, HCN_PACKED_DATAPOINT_MAX_ENCODED);
+		}
+	}
+
+	// The datapoint count, and only as many datapoints as we were given, encoded right out of the caller's array.
+	return hcn_send_entries<HCN_datapoint_schema, hcn_send_body>(player_number, dps, dp_count);
+
+}
+
+// hcn_send_wide_datapoints() - send any number of datapoints, of any kind, as packed datapoints. As many go in each
+//	packet as fit. If the other side can't take packed datapoints, the ones that fit in an HCN_datapoint go the
+//	regular way, and it fails if any of them don't.
+bool hcn_send_wide_datapoints(int player_number, const struct HCN_wide_datapoint *dps, int dp_count) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	std::lock_guard<std::recursive_mutex> guard(hcn_player_lock(player_number));
+	unsigned char body[HCN_PACKED_DATAPOINT_BODY];
+	unsigned char entry[12];
+	struct HCN_datapoint narrow[HCN_MAX_DATAPOINTS];
+	int i, n, length = 1, count = 0;
+
+	if (!(hcn_current->peer_capabilities[pi] & HCN_CAP_PACKED_DATAPOINT)) {	// The old way, HCN_MAX_DATAPOINTS at a time.
+		for (i = 0; i < dp_count; i++) {
+			if (dps[i].kind != HCN_DP_INT && dps[i].kind != HCN_DP_UINT && dps[i].kind != HCN_DP_FLOAT) {
+				hcn_logger(HCN_LOG_DEBUG, "Player %d can't take 64-bit datapoints", player_number);
+				return false;
+			}
+		}
+		for (i = 0; i < dp_count; i++) {
+			narrow[count].dp_type = dps[i].dp_type;
+			narrow[count].dp_uint = dps[i].dp_uint;
+			if (++count == HCN_MAX_DATAPOINTS || i == dp_count - 1) {
+				if (!hcn_send_datapoints(player_number, narrow, count)) return false;
+				count = 0;
+			}
+		}
+		return true;
+	}
+
+	for (i = 0; i < dp_count; i++) {
+		n = hcn_packed_datapoint_put(entry, &dps[i]);
+		if (n == 0) {
+			hcn_logger(HCN_LOG_DEBUG, "Datapoint type %d is an unknown kind %d", dps[i].dp_type, dps[i].kind);
+			return false;
+		}
+		if (length + n > HCN_PACKED_DATAPOINT_BODY) {			// Full, send what we have.
+			body[0] = count;
+			if (!hcn_send_body(player_number, HCN_PACKET_PACKED_DATAPOINT, body, length, NULL, 0, HCN_PACKED_DATAPOINT_MAX_ENCODED)) return false;
+			length = 1;
+			count = 0;
+		}
+		memcpy(body + length, entry, n);
+		length += n;
+		count++;
+	}
+	if (count == 0) return true;
+
+	body[0] = count;
+	return hcn_send_body(player_number, HCN_PACKET_PACKED_DATAPOINT, body, length, NULL, 0, HCN_PACKED_DATAPOINT_MAX_ENCODED);
+}
+
+// hcn_send_vectors() - allow an application to provide a list of vectors, and send them to the other side.
+//	If the other side can take compact vectors, or does dead reckoning, up to HCN_MAX_COMPACT_VECTORS can be sent at once.
+bool hcn_send_vectors(int player_number, struct HCN_vector *vectors, int vector_count) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	std::lock_guard<std::recursive_mutex> guard(hcn_player_lock(player_number));
+	struct HCN_subject_vector subject_vectors[HCN_MAX_COMPACT_VECTORS];
+
+	if (!(hcn_current->peer_capabilities[pi] & (HCN_CAP_COMPACT_VECTOR | HCN_CAP_DEAD_RECKONING))) {
+		// The vector count, and only as many vectors as we were given.
+		return hcn_send_entries<HCN_vector_schema, hcn_send_body>(player_number, vectors, vector_count);
+	}
+
+	if (vector_count > HCN_MAX_COMPACT_VECTORS) return false;
+	for (int i = 0; i < vector_count; i++) {
+		subject_vectors[i].vector_type = vectors[i].vector_type;
+		subject_vectors[i].subject = 0;
+		subject_vectors[i].vector = vectors[i].vector;
+	}
+	return hcn_send_subject_vectors(player_number, subject_vectors, vector_count);
+
+}
+
+// hcn_send_numbered_keyvalue() - Send a keyvalue pair to a player that has HCN_CAP_KEY_ID. If we've already numbered
+//	the key for them, only the number and the value go. Otherwise it's numbered now, if there's room. The number only
+//	counts once the packet that gives it has gone, see hcn_key_defined().
+static bool hcn_send_numbered_keyvalue(int player_number, char *keyvalue, int kv_length) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	struct HCN_key_table *sent = &hcn_current->keys[pi].sent;
+	const char *equals = strchr(keyvalue, '=');
+	int key_length = (equals == NULL) ? kv_length - 1 : equals - keyvalue;
+	unsigned char head[2];
+	int id;
+
+	id = hcn_key_table_find(sent, keyvalue, key_length);
+	if (id != 0) {
+		head[0] = id;
+		head[1] = (equals == NULL) ? 0 : kv_length - key_length - 1;	// The value and its null terminator.
+		return hcn_send_compressed(player_number, HCN_PACKET_KEY_ID, head, 2, (equals == NULL) ? NULL : equals + 1, head[1], HCN_KEY_ID_MAX_ENCODED, false);
+	}
+
+	id = sent->count + 1;
+	head[0] = id;
+	head[1] = kv_length;
+	if (!hcn_key_table_fits(sent, id, key_length)) {				// Out of numbers, it goes the old way.
+		return hcn_send_compressed(player_number, HCN_PACKET_KEYVALUE, head + 1, 1, keyvalue, kv_length, HCN_KEYVALUE_MAX_ENCODED, false);
+	}
+	if (!hcn_send_compressed(player_number, HCN_PACKET_KEY_DEFINE, head, 2, keyvalue, kv_length, HCN_KEY_ID_MAX_ENCODED, false)) return false;
+
+	hcn_key_defined(player_number, id, keyvalue, key_length);
+	return true;
+}
+
+// hcn_send_keyvalue() - send a key-value pair to the other side.
+bool hcn_send_keyvalue(int player_number, char *keyvalue) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	std::lock_guard<std::recursive_mutex> guard(hcn_player_lock(player_number));
+	int kv_length;
+	unsigned char head;
+
+	if (hcn_current->application_sender == NULL && hcn_current->application_reserve == NULL) {
+		hcn_logger(HCN_LOG_WARN, "hcn_send_keyvalue(): Application packet sender not set!");
+		return false;
+	}
+
+	if (hcn_current->state[pi] == HCN_STATE_RUNNING) {				// if the state is "RUNNING" we can go ahead and send it.
+		hcn_logger(HCN_LOG_DEBUG2, "HCN sending keyvalue '%s' to player %d", keyvalue, player_number);
+		kv_length = strlen(keyvalue) + 1;				// make sure we have a char* length plus the null terminator.
+		if (kv_length > HCN_KEYVALUE_LENGTH) {
+			hcn_logger(HCN_LOG_DEBUG, "hcn_send_keyvalue(): keyvalue too long, %d characters", kv_length);
+			return false;
+		}
+		if (hcn_current->peer_capabilities[pi] & HCN_CAP_KEY_ID) return hcn_send_numbered_keyvalue(player_number, keyvalue, kv_length);
+
+		head = kv_length;
+		return hcn_send_compressed(player_number, HCN_PACKET_KEYVALUE, &head, 1, keyvalue, kv_length, HCN_KEYVALUE_MAX_ENCODED, false); // The keyvalue pair goes straight in.
+	}
+	else {
+		hcn_logger(HCN_LOG_DEBUG, "Other side status is not RUNNING, state = %d, pi = %d", hcn_current->state[pi].load(), pi);
+	}
+
+	return false;								// indicate we failed.
+
+}
+
+// hcn_send_typed_keyvalue() - send a key and a typed value to the other side. If they can't take typed keyvalues, the
+//	value goes as a string, the same as hcn_send_keyvalue() with "key=value".
+bool hcn_send_typed_keyvalue(int player_number, const char *key, const struct HCN_value *value) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	std::lock_guard<std::recursive_mutex> guard(hcn_player_lock(player_number));
+	struct HCN_key_table *sent = &hcn_current->keys[pi].sent;
+	unsigned short caps = hcn_current->peer_capabilities[pi];
+	unsigned char body[4 + HCN_KEY_LENGTH + HCN_VALUE_LENGTH];
+	char keyvalue[HCN_KEYVALUE_LENGTH];
+	char buffer[HCN_VALUE_LENGTH];
+	const char *string;
+	int id = 0, key_length = strlen(key), length, n = 2;
+	bool define = false;
+
+	if (key_length == 0 || key_length > HCN_KEY_LENGTH) {
+		hcn_logger(HCN_LOG_DEBUG, "hcn_send_typed_keyvalue(): key is empty or too long, %d characters", key_length);
+		return false;
+	}
+
+	if (!(caps & HCN_CAP_TYPED_KEYVALUE)) {					// The old way.
+		string = hcn_value_string(value, buffer);
+		if (string != NULL && key_length + 1 + (int)strlen(string) + 1 > HCN_KEYVALUE_LENGTH) {
+			hcn_logger(HCN_LOG_DEBUG, "hcn_send_typed_keyvalue(): value too long for a keyvalue, %d characters", (int)strlen(string));
+			return false;
+		}
+		if (string == NULL) strcpy_s(keyvalue, key);
+		else sprintf_s(keyvalue, "%s=%s", key, string);
+		return hcn_send_keyvalue(player_number, keyvalue);
+	}
+
+	if (hcn_current->state[pi] != HCN_STATE_RUNNING) {
+		hcn_logger(HCN_LOG_DEBUG, "Other side status is not RUNNING, state = %d, pi = %d", hcn_current->state[pi].load(), pi);
+		return false;
+	}
+
+	if (caps & HCN_CAP_KEY_ID) {						// Use the key's number, or give it one.
+		id = hcn_key_table_find(sent, key, key_length);
+		if (id == 0 && hcn_key_table_fits(sent, sent->count + 1, key_length)) {
+			id = sent->count + 1;
+			define = true;
+		}
+	}
+
+	body[0] = value->value_type | (define ? HCN_TYPED_DEFINE : 0);
+	body[1] = id;
+	if (id == 0 || define) {
+		body[n++] = key_length;
+		memcpy(body + n, key, key_length);
+		n += key_length;
+	}
+
+	switch (value->value_type) {
+	case HCN_VALUE_BOOL:
+		body[n++] = value->b ? 1 : 0;
+		break;;
+	case HCN_VALUE_INT:
+		memcpy(body + n, &value->i, 4);
+		n += 4;
+		break;;
+	case HCN_VALUE_FLOAT:
+		memcpy(body + n, &value->f, 4);
+		n += 4;
+		break;;
+	case HCN_VALUE_STRING:
+		length = (value->s == NULL) ? 0 : strlen(value->s) + 1;
+		if (length > HCN_VALUE_LENGTH) {
+			hcn_logger(HCN_LOG_DEBUG, "hcn_send_typed_keyvalue(): value too long, %d characters", length);
+			return false;
+		}
+		body[n++] = length;
+		if (length > 0) memcpy(body + n, value->s, length);
+		n += length;
+		break;;
+	default:
+		return false;
+	}
+
+	if (!hcn_send_body(player_number, HCN_PACKET_TYPED_KEYVALUE, body, n, NULL, 0, HCN_TYPED_KEYVALUE_MAX_ENCODED)) return false;
+
+	if (define) hcn_key_defined(player_number, id, key, key_length);	// Only counts once the packet has gone.
+	return true;
+}
+
+// Send a key with a bool value.
+bool hcn_send_keyvalue_bool(int player_number, const char *key, bool value) {
+	struct HCN_value v;
+
+	v.value_type = HCN_VALUE_BOOL;
+	v.b = value;
+	return hcn_send_typed_keyvalue(player_number, key, &v);
+}
+
+// Send a key with an int value.
+bool hcn_send_keyvalue_int(int player_number, const char *key, int value) {
+	struct HCN_value v;
+
+	v.value_type = HCN_VALUE_INT;
+	v.i = value;
+	return hcn_send_typed_keyvalue(player_number, key, &v);
+}
+
+// Send a key with a float value.
+bool hcn_send_keyvalue_float(int player_number, const char *key, float value) {
+	struct HCN_value v;
+
+	v.value_type = HCN_VALUE_FLOAT;
+	v.f = value;
+	return hcn_send_typed_keyvalue(player_number, key, &v);
+}
+
+// hcn_send_text_packet() - Common part of hcn_send_text(). text_bytes includes the null terminator.
+static bool hcn_send_text_packet(int player_number, HCN_text_type type, HCN_text_color color, const void *text, int text_length, int text_bytes) {
+	unsigned char head[3] = { (unsigned char)type, (unsigned char)color, (unsigned char)text_length }; // Text type, color, and length including the terminator.
+
+	return hcn_send_compressed(player_number, HCN_PACKET_TEXT, head, 3, text, text_bytes, HCN_TEXT_MAX_ENCODED, text_bytes != text_length); // The text itself goes straight in.
+}
+
+// Send a text packet to a client or server
+//	If it's all Latin-1 and the other side can widen it back, it goes as 8-bit text, half the size.
+bool hcn_send_text(int player_number, HCN_text_type type, HCN_text_color color, wchar_t *text) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	std::lock_guard<std::recursive_mutex> guard(hcn_player_lock(player_number));
+	char narrow[HCN_TEXT_LENGTH];
+	int text_length;
+
+	if (hcn_current->application_sender == NULL && hcn_current->application_reserve == NULL) {
+		hcn_logger(HCN_LOG_WARN, "hcn_send_text(): Application packet sender not set!");
+		return false;
+	}
+
+	if (hcn_current->state[pi] == HCN_STATE_RUNNING) {				// if the state is "RUNNING" we can go ahead and send it.
+		hcn_logger(HCN_LOG_DEBUG2, "HCN sending text to player %d - '%S'", player_number, text);
+		text_length = wcslen(text) + 1;					// make sure we have a null terminator.
+		if (text_length > HCN_TEXT_LENGTH) {
+			hcn_logger(HCN_LOG_DEBUG, "hcn_send_text(): text too long, %d characters", text_length);
+			return false;
+		}
+		if ((hcn_current->peer_capabilities[pi] & HCN_CAP_NARROW_TEXT) && hcn_narrow_kernel(narrow, text, text_length)) {
+			return hcn_send_text_packet(player_number, (HCN_text_type)(type | HCN_TEXT_NARROWED), color, narrow, text_length, text_length);
+		}
+		return hcn_send_text_packet(player_number, type, color, text, text_length, text_length * 2);
+	}
+	else {
+		hcn_logger(HCN_LOG_DEBUG, "Other side status is not RUNNING, state = %d, pi = %d", hcn_current->state[pi].load(), pi);
+	}
+
+	return false;								// indicate we failed.
+
+}
+
+// Overloaded version of hcn_send_text() for 8-bit character strings. Be careful to use this only for console output.
+bool hcn_send_text(int player_number, HCN_text_type type, HCN_text_color color, char *text) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	std::lock_guard<std::recursive_mutex> guard(hcn_player_lock(player_number));
+	int text_length;
+
+	if (hcn_current->application_sender == NULL && hcn_current->application_reserve == NULL) {
+		hcn_logger(HCN_LOG_WARN, "hcn_send_text(): Application packet sender not set!");
+		return false;
+	}
+
+	if (hcn_current->state[pi] == HCN_STATE_RUNNING) {				// if the state is "RUNNING" we can go ahead and send it.
+		hcn_logger(HCN_LOG_DEBUG2, "HCN sending text8 to player %d - '%s'", player_number, text);
+		text_length = strlen(text) + 1;					// make sure we have a null terminator.
+		if (text_length > HCN_TEXT_LENGTH) {
+			hcn_logger(HCN_LOG_DEBUG, "hcn_send_text(): text too long, %d characters", text_length);
+			return false;
+		}
+		return hcn_send_text_packet(player_number, type, color, text, text_length, text_length);
+	}
+	else {
+		hcn_logger(HCN_LOG_DEBUG, "Other side status is not RUNNING, state = %d, pi = %d", hcn_current->state[pi].load(), pi);
+	}
+
+	return false;								// indicate we failed.
+
+}
+
+// hcn_bundle_flush() - Send everything bundled up for a player as a single packet. If the other side doesn't know
+//	about bundles, each message goes out on its own instead.
+bool hcn_bundle_flush(int player_number) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	std::lock_guard<std::recursive_mutex> guard(hcn_player_lock(player_number));
+	struct HCN_bundle *bundle = &hcn_current->bundles[pi];
+	int i, offset;
+	bool sent = true;
+
+	if (bundle->count == 0) return true;					// Nothing to do.
+
+	if (hcn_current->peer_capabilities[pi] & HCN_CAP_BUNDLE) {
+		bundle->data[sizeof(struct HCN_preamble)] = bundle->count;
+		sent = hcn_send_body(player_number, HCN_PACKET_BUNDLE, bundle->data + sizeof(struct HCN_preamble), bundle->length - sizeof(struct HCN_preamble), NULL, 0, HCN_BUNDLE_MAX_ENCODED);
+	}
+	else {
+		offset = sizeof(struct HCN_preamble) + 1;
+		for (i = 0; i < bundle->count; i++) {				// Each message is [type][length][body].
+			sent &= hcn_send_body(player_number, (HCN_packet_type)bundle->data[offset], bundle->data + offset + 2, bundle->data[offset + 1], NULL, 0, HCN_MAX_PACKET_LENGTH / 2);
+			offset += 2 + bundle->data[offset + 1];
+		}
+	}
+
+	hcn_logger(HCN_LOG_DEBUG2, "Flushed a bundle of %d messages to player %d", bundle->count, player_number);
+	hcn_bundle_reset(bundle);
+	return sent;
+}
+
+// hcn_bundle_add() - Add a message to a player's bundle. The message body is a fixed head plus a variable-length data
+//	part, same as hcn_send_body(). If it won't fit, the bundle is flushed first. If it won't fit in a bundle at all,
+//	it's sent on its own.
+static bool hcn_bundle_add(int player_number, HCN_packet_type type, const void *head, int head_length, const void *data, int data_length, int max_encoded) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+	std::lock_guard<std::recursive_mutex> guard(hcn_player_lock(player_number));
+	struct HCN_bundle *bundle = &hcn_current->bundles[pi];
+	int body_length = head_length + data_length;
+	int start;
+
+	if (hcn_current->state[pi] != HCN_STATE_RUNNING) {
+		hcn_logger(HCN_LOG_DEBUG, "Other side status is not RUNNING, state = %d, pi = %d", hcn_current->state[pi].load(), pi);
+		return false;
+	}
+
+	if (body_length <= HCN_BUNDLE_MAX_MESSAGE) {
+		for (;;) {
+			start = bundle->length;
+			if (bundle->count < 255 && start + 2 + body_length <= HCN_MAX_PACKET_LENGTH) {
+				bundle->data[start] = type;
+				bundle->data[start + 1] = body_length;
+				memcpy(bundle->data + start + 2, head, head_length);
+				memcpy(bundle->data + start + 2 + head_length, data, data_length);
+				bundle->length += 2 + body_length;
+				bundle->data[sizeof(struct HCN_preamble)] = bundle->count + 1;
+
+				if (hcn_encoded_size(bundle->data, bundle->length) <= HCN_MAX_PACKET_LENGTH / 2) {
+					bundle->count++;
+					return true;
+				}
+
+				bundle->length = start;					// Doesn't fit once encoded, take it back out.
+				bundle->data[sizeof(struct HCN_preamble)] = bundle->count;
+			}
+
+			if (bundle->count == 0) break;				// Won't even fit in an empty bundle.
+			if (!hcn_bundle_flush(player_number)) return false;
+		}
+	}
+
+	if (!hcn_bundle_flush(player_number)) return false;			// Keep things in order,
+	return hcn_send_body(player_number, type, head, head_length, data, data_length, max_encoded); // and send it on its own.
+}
+
+// Add datapoints to a player's bundle.
+bool hcn_bundle_datapoints(int player_number, struct HCN_datapoint *dps, int dp_count) {
+
+	return hcn_send_entries<HCN_datapoint_schema, hcn_bundle_add>(player_number, dps, dp_count);
+}
+
+// Add vectors to a player's bundle.
+bool hcn_bundle_vectors(int player_number, struct HCN_vector *vectors, int vector_count) {
+
+	return hcn_send_entries<HCN_vector_schema, hcn_bundle_add>(player_number, vectors, vector_count);
+}
+
+// Add a key-value pair to a player's bundle.
+bool hcn_bundle_keyvalue(int player_number, char *keyvalue) {
+	int kv_length = strlen(keyvalue) + 1;
+	unsigned char head = kv_length;
+
+	if (kv_length > HCN_KEYVALUE_LENGTH) return false;
+	return hcn_bundle_add(player_number, HCN_PACKET_KEYVALUE, &head, 1, keyvalue, kv_length, HCN_KEYVALUE_MAX_ENCODED);
+}
+
+// Add text to a player's bundle.
+bool hcn_bundle_text(int player_number, HCN_text_type type, HCN_text_color color, wchar_t *text) {
+	int text_length = wcslen(text) + 1;
+	unsigned char head[3] = { (unsigned char)type, (unsigned char)color, (unsigned char)text_length };
+
+	if (text_length > HCN_TEXT_LENGTH) return false;
+	return hcn_bundle_add(player_number, HCN_PACKET_TEXT, head, 3, text, text_length * 2, HCN_TEXT_MAX_ENCODED);
+}
+
+// Add 8-bit text to a player's bundle. Console output only, same as hcn_send_text().
+bool hcn_bundle_text(int player_number, HCN_text_type type, HCN_text_color color, char *text) {
+	int text_length = strlen(text) + 1;
+	unsigned char head[3] = { (unsigned char)type, (unsigned char)color, (unsigned char)text_length };
+
+	if (text_length > HCN_TEXT_LENGTH) return false;
+	return hcn_bundle_add(player_number, HCN_PACKET_TEXT, head, 3, text, text_length, HCN_TEXT_MAX_ENCODED);
+}
+
+// Set what team a player is on, or HCN_NO_TEAM.
+void hcn_set_player_team(int player_number, int team) {
+	int pi = (player_number == 0) ? 0 : player_number - 1;
+
+	hcn_current->player_team[pi] = team;
+}
+
+// Get the mask of players on a team.
+unsigned int hcn_team_mask(int team) {
+	unsigned int mask = 0;
+
+	for (int pi = 0; pi < HCN_MAX_PLAYERS; pi++) {
+		if (hcn_current->player_team[pi] == team) mask |= 1u << pi;
+	}
+	return mask;
+}
+
+// hcn_deliver_encoded() - Hand an already encoded packet to the application for a player. length includes the terminator.
+static bool hcn_deliver_encoded(int player_number, struct HCN_packet *encoded_packet, int length) {
+	wchar_t *out;
+
+	if (hcn_current->application_reserve != NULL) {
+		if ((out = hcn_current->application_reserve(player_number, length)) == NULL) {
+			hcn_logger(HCN_LOG_DEBUG, "Application couldn't reserve %d characters for player %d", length, player_number);
+			return false;
+		}
+		memcpy(out, encoded_packet, length * sizeof(wchar_t));
+		hcn_current->application_commit(player_number, out, length);
+		return true;
+	}
+	if (hcn_current->application_sender != NULL) {
+		hcn_current->application_sender(player_number, encoded_packet);
+		return true;
+	}
+
+	hcn_logger(HCN_LOG_WARN, "HCN packet sender not set!");
+	return false;
+}
+
+// hcn_send_encoded() - Send an already encoded packet to a player, through the outbound ring if we're pipelining.
+static bool hcn_send_encoded(int player_number, struct HCN_packet *encoded_packet, int length) {
+	struct HCN_ring_slot *slot;
+
+	if (!hcn_current->pipelining) return hcn_deliver_encoded(player_number, encoded_packet, length);
+
+	if ((slot = hcn_ring_reserve(&hcn_current->outbound_ring)) == NULL) {
+		hcn_logger(HCN_LOG_DEBUG, "Outbound ring is full, dropping packet for player %d", player_number);
+		return false;
+	}
+	slot->player_number = player_number;
+	slot->length = length;
+	memcpy(slot->chat, encoded_packet, length * sizeof(wchar_t));
+	hcn_ring_commit(&hcn_current->outbound_ring, slot);
+	return true;
+}
+
+// hcn_multicast_body() - Send the same packet to every RUNNING player in a mask. It's only encoded once, and each
+//	player gets a copy of the encoded packet. With the scheduler on, it's queued for each of them instead.
+//	Returns how many players it went to.
+static int hcn_multicast_body(unsigned int player_mask, HCN_packet_type type, const void *head, int head_length, const void *data, int data_length) {
+	HCN_packet encoded_packet;
+	struct HCN_writer w;
+	int pi, player_number, length = -1, sent = 0;
+
+	for (pi = 0; pi < HCN_MAX_PLAYERS; pi++) {
+		if (!(player_mask & (1u << pi)) || hcn_current->state[pi] != HCN_STATE_RUNNING) continue;
+		player_number = (hcn_current->our_side == HCN_CLIENT) ? 0 : pi + 1;
+		std::lock_guard<std::recursive_mutex> guard(hcn_current->player_lock[pi]);
+
+		if (hcn_current->scheduling) {
+			if (hcn_queue_body(player_number, type, head, head_length, data, data_length)) sent++;
+			continue;
+		}
+
+		if (length < 0) {						// First one, encode it.
+			hcn_writer_begin(&w, (wchar_t *)&encoded_packet, HCN_MAX_PACKET_LENGTH / 2 - 1, type, sizeof(struct HCN_preamble) + head_length + data_length, false);
+			hcn_writer_put(&w, head, head_length);
+			hcn_writer_put(&w, data, data_length);
+			length = hcn_writer_end(&w);
+		}
+		if (length == 0) {
+			hcn_logger(HCN_LOG_DEBUG, "Packet doesn't fit in %d characters once encoded", HCN_MAX_PACKET_LENGTH / 2);
+			return 0;
+		}
+
+		if (hcn_send_encoded(player_number, &encoded_packet, length)) sent++;
+	}
+	return sent;
+}
+
+// Send datapoints to every RUNNING player in a mask.
+int hcn_multicast_datapoints(unsigned int player_mask, struct HCN_datapoint *dps, int dp_count) {
+	unsigned char count = dp_count;
+
+	if (dp_count > HCN_MAX_DATAPOINTS) return 0;
+	return hcn_multicast_body(player_mask, HCN_PACKET_DATAPOINT, &count, 1, dps, HCN_datapoint_schema::body_length(dp_count) - 1);
+}
+
+// Send vectors to every RUNNING player in a mask. Players that can take compact vectors get one encoded compact packet,
+//	the rest get regular vector packets. Deltas and dead reckoning are per player, so they're not used here. Returns
+//	how many players got all of them.
+int hcn_multicast_vectors(unsigned int player_mask, struct HCN_vector *vectors, int vector_count) {
+	struct HCN_subject_vector subject_vectors[HCN_MAX_COMPACT_VECTORS];
+	struct HCN_queued entry;
+	unsigned int compact_mask = 0;
+	int i, count, sent = 0, fewest = -1;
+
+	if (vector_count > HCN_MAX_COMPACT_VECTORS) return 0;
+
+	if (hcn_current->scheduling) {							// Every player's vector lane keeps its own latest vectors.
+		for (int pi = 0; pi < HCN_MAX_PLAYERS; pi++) {
+			if (!(player_mask & (1u << pi)) || hcn_current->state[pi] != HCN_STATE_RUNNING) continue;
+			if (hcn_send_vectors((hcn_current->our_side == HCN_CLIENT) ? 0 : pi + 1, vectors, vector_count)) sent++;
+		}
+		return sent;
+	}
+
+	for (i = 0; i < vector_count; i++) {
+		subject_vectors[i].vector_type = vectors[i].vector_type;
+		subject_vectors[i].subject = 0;
+		subject_vectors[i].vector = vectors[i].vector;
+	}
+	for (int pi = 0; pi < HCN_MAX_PLAYERS; pi++) {
+		if (hcn_current->peer_capabilities[pi] & HCN_CAP_COMPACT_VECTOR) compact_mask |= 1u << pi;
+	}
+
+	for (i = 0; i < vector_count; i += count) {
+		count = hcn_vector_chunk(vector_count - i, false);
+		hcn_queued_begin(&entry, HCN_PACKET_VECTOR);
+		entry.length += hcn_vector_body(entry.data + entry.length, subject_vectors + i, count, false);
+		sent = hcn_multicast_body(player_mask & ~compact_mask, HCN_PACKET_VECTOR, entry.data + sizeof(struct HCN_preamble), entry.length - sizeof(struct HCN_preamble), NULL, 0);
+		if (fewest < 0 || sent < fewest) fewest = sent;			// No more players got every chunk than got the one that went to the fewest.
+	}
+	if (fewest < 0) fewest = 0;
+
+	hcn_queued_begin(&entry, HCN_PACKET_COMPACT_VECTOR);
+	entry.length += hcn_vector_body(entry.data + entry.length, subject_vectors, vector_count, true);
+	return fewest + hcn_multicast_body(player_mask & compact_mask, HCN_PACKET_COMPACT_VECTOR, entry.data + sizeof(struct HCN_preamble), entry.length - sizeof(struct HCN_preamble), NULL, 0);
+}
+
+// Send a key-value pair to every RUNNING player in a mask.
+int hcn_multicast_keyvalue(unsigned int player_mask, char *keyvalue) {
+	int kv_length = strlen(keyvalue) + 1;
+	unsigned char head = kv_length;
+
+	if (kv_length > HCN_KEYVALUE_LENGTH) {
+		hcn_logger(HCN_LOG_DEBUG, "hcn_multicast_keyvalue(): keyvalue too long, %d characters", kv_length);
+		return 0;
+	}
+	return hcn_multicast_body(player_mask, HCN_PACKET_KEYVALUE, &head, 1, keyvalue, kv_length);
+}
+
+// Send text to every RUNNING player in a mask.
+int hcn_multicast_text(unsigned int player_mask, HCN_text_type type, HCN_text_color color, wchar_t *text) {
+	int text_length = wcslen(text) + 1;
+	unsigned char head[3] = { (unsigned char)type, (unsigned char)color, (unsigned char)text_length };
+
+	if (text_length > HCN_TEXT_LENGTH) {
+		hcn_logger(HCN_LOG_DEBUG, "hcn_multicast_text(): text too long, %d characters", text_length);
+		return 0;
+	}
+	return hcn_multicast_body(player_mask, HCN_PACKET_TEXT, head, 3, text, text_length * 2);
+}
+
+// Send 8-bit text to every RUNNING player in a mask. Console output only, same as hcn_send_text().
+int hcn_multicast_text(unsigned int player_mask, HCN_text_type type, HCN_text_color color, char *text) {
+	int text_length = strlen(text) + 1;
+	unsigned char head[3] = { (unsigned char)type, (unsigned char)color, (unsigned char)text_length };
+
+	if (text_length > HCN_TEXT_LENGTH) {
+		hcn_logger(HCN_LOG_DEBUG, "hcn_multicast_text(): text too long, %d characters", text_length);
+		return 0;
+	}
+	return hcn_multicast_body(player_mask, HCN_PACKET_TEXT, head, 3, text, text_length);
+}
+
+// Send datapoints to every RUNNING player.
+int hcn_broadcast_datapoints(struct HCN_datapoint *dps, int dp_count) {
+
+	return hcn_multicast_datapoints(HCN_ALL_PLAYERS, dps, dp_count);
+}
+
+// Send vectors to every RUNNING player.
+int hcn_broadcast_vectors(struct HCN_vector *vectors, int vector_count) {
+
+	return hcn_multicast_vectors(HCN_ALL_PLAYERS, vectors, vector_count);
+}
+
+// Send a key-value pair to every RUNNING player.
+int hcn_broadcast_keyvalue(char *keyvalue) {
+
+	return hcn_multicast_keyvalue(HCN_ALL_PLAYERS, keyvalue);
+}
+
+// Send text to every RUNNING player.
+int hcn_broadcast_text(HCN_text_type type, HCN_text_color color, wchar_t *text) {
+
+	return hcn_multicast_text(HCN_ALL_PLAYERS, type, color, text);
+}
+
+// Send 8-bit text to every RUNNING player.
+int hcn_broadcast_text(HCN_text_type type, HCN_text_color color, char *text) {
+
+	return hcn_multicast_text(HCN_ALL_PLAYERS, type, color, text);
+}
+
+// Versions of the entry points that take a context, for applications running more than one session. They switch the
+//	calling thread to the context for the call. The codec (hcn_set_codec()) is for the whole process, so it has none,
+//	and neither do the packet-level functions that don't touch a context, hcn_encode(), hcn_narrow() and the
+//	hcn_view_*() family.
+void hcn_init(struct HCN_context *context, char *version) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_init(version);
+	hcn_set_context(previous);
+}
+
+void hcn_what_we_are(struct HCN_context *context, HCN_OUR_SIDE our_side, HCN_CLIENT_TYPE client_type) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_what_we_are(our_side, client_type);
+	hcn_set_context(previous);
+}
+
+void hcn_what_we_are(struct HCN_context *context, HCN_OUR_SIDE our_side, HCN_SERVER_TYPE server_type) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_what_we_are(our_side, server_type);
+	hcn_set_context(previous);
+}
+
+void hcn_on_tick(struct HCN_context *context) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_on_tick();
+	hcn_set_context(previous);
+}
+
+bool hcn_running(struct HCN_context *context, int player_number) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool running = hcn_running(player_number);
+
+	hcn_set_context(previous);
+	return running;
+}
+
+void hcn_clear_player(struct HCN_context *context, int player_number) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_clear_player(player_number);
+	hcn_set_context(previous);
+}
+
+bool hcn_process_chat(struct HCN_context *context, int player_number, int chat_type, wchar_t *our_packet) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool handled = hcn_process_chat(player_number, chat_type, our_packet);
+
+	hcn_set_context(previous);
+	return handled;
+}
+
+int hcn_process_chat_batch(struct HCN_context *context, struct HCN_chat_batch_entry *batch, int count) {
+	struct HCN_context *previous = hcn_set_context(context);
+	int handled = hcn_process_chat_batch(batch, count);
+
+	hcn_set_context(previous);
+	return handled;
+}
+
+int hcn_pipeline_work(struct HCN_context *context, int max_packets) {
+	struct HCN_context *previous = hcn_set_context(context);
+	int done = hcn_pipeline_work(max_packets);
+
+	hcn_set_context(previous);
+	return done;
+}
+
+bool hcn_send_datapoints(struct HCN_context *context, int player_number, struct HCN_datapoint *dps, int dp_count) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool sent = hcn_send_datapoints(player_number, dps, dp_count);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+bool hcn_send_vectors(struct HCN_context *context, int player_number, struct HCN_vector *vectors, int vector_count) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool sent = hcn_send_vectors(player_number, vectors, vector_count);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+bool hcn_send_subject_vectors(struct HCN_context *context, int player_number, struct HCN_subject_vector *vectors, int vector_count) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool sent = hcn_send_subject_vectors(player_number, vectors, vector_count);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+bool hcn_send_keyvalue(struct HCN_context *context, int player_number, char *keyvalue) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool sent = hcn_send_keyvalue(player_number, keyvalue);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+bool hcn_send_text(struct HCN_context *context, int player_number, HCN_text_type type, HCN_text_color color, wchar_t *text) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool sent = hcn_send_text(player_number, type, color, text);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+bool hcn_send_text(struct HCN_context *context, int player_number, HCN_text_type type, HCN_text_color color, char *text) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool sent = hcn_send_text(player_number, type, color, text);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+void hcn_set_debug_level(struct HCN_context *context, int level) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_set_debug_level(level);
+	hcn_set_context(previous);
+}
+
+void hcn_set_logger_callback(struct HCN_context *context, HCN_logger_callback callback) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_set_logger_callback(callback);
+	hcn_set_context(previous);
+}
+
+void hcn_set_packet_sender(struct HCN_context *context, HCN_application_sender application_sender) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_set_packet_sender(application_sender);
+	hcn_set_context(previous);
+}
+
+void hcn_set_packet_reserve_commit(struct HCN_context *context, HCN_application_reserve reserve, HCN_application_commit commit) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_set_packet_reserve_commit(reserve, commit);
+	hcn_set_context(previous);
+}
+
+void hcn_set_packet_callback(struct HCN_context *context, HCN_callback_packet callback) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_set_packet_callback(callback);
+	hcn_set_context(previous);
+}
+
+void hcn_set_datapoint_callback_list(struct HCN_context *context, HCN_datapoint_dispatch *datapoint_list, int datapoint_list_length) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_set_datapoint_callback_list(datapoint_list, datapoint_list_length);
+	hcn_set_context(previous);
+}
+
+void hcn_set_vector_callback_list(struct HCN_context *context, HCN_vector_dispatch *vector_list, int vector_list_length) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_set_vector_callback_list(vector_list, vector_list_length);
+	hcn_set_context(previous);
+}
+
+void hcn_set_keyvalue_callback_list(struct HCN_context *context, HCN_key_dispatch *key_list) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_set_keyvalue_callback_list(key_list);
+	hcn_set_context(previous);
+}
+
+void hcn_set_text_callback_list(struct HCN_context *context, HCN_text_dispatch *text_list, int text_list_length) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_set_text_callback_list(text_list, text_list_length);
+	hcn_set_context(previous);
+}
+
+bool hcn_set_datapoint_handler(struct HCN_context *context, HCN_datapoint_type dp_type, HCN_handler_datapoint handler, void *handler_context) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool set = hcn_set_datapoint_handler(dp_type, handler, handler_context);
+
+	hcn_set_context(previous);
+	return set;
+}
+
+bool hcn_set_wide_datapoint_handler(struct HCN_context *context, HCN_datapoint_type dp_type, HCN_handler_wide_datapoint handler, void *handler_context) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool set = hcn_set_wide_datapoint_handler(dp_type, handler, handler_context);
+
+	hcn_set_context(previous);
+	return set;
+}
+
+bool hcn_set_vector_handler(struct HCN_context *context, HCN_vector_type vector_type, HCN_handler_vector handler, void *handler_context) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool set = hcn_set_vector_handler(vector_type, handler, handler_context);
+
+	hcn_set_context(previous);
+	return set;
+}
+
+bool hcn_set_text_handler(struct HCN_context *context, HCN_text_type text_type, HCN_handler_text handler, void *handler_context) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool set = hcn_set_text_handler(text_type, handler, handler_context);
+
+	hcn_set_context(previous);
+	return set;
+}
+
+void hcn_set_capabilities(struct HCN_context *context, unsigned short capabilities) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_set_capabilities(capabilities);
+	hcn_set_context(previous);
+}
+
+void hcn_set_vector_bounds(struct HCN_context *context, struct HCN_vector_bounds *bounds, int bounds_count) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_set_vector_bounds(bounds, bounds_count);
+	hcn_set_context(previous);
+}
+
+void hcn_set_subject_vector_callback(struct HCN_context *context, HCN_callback_subject_vector callback) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_set_subject_vector_callback(callback);
+	hcn_set_context(previous);
+}
+
+void hcn_set_vector_block_callback(struct HCN_context *context, HCN_callback_vector_block callback) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_set_vector_block_callback(callback);
+	hcn_set_context(previous);
+}
+
+void hcn_set_dead_reckoning(struct HCN_context *context, bool enabled, float threshold) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_set_dead_reckoning(enabled, threshold);
+	hcn_set_context(previous);
+}
+
+void hcn_set_scheduler(struct HCN_context *context, bool enabled) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_set_scheduler(enabled);
+	hcn_set_context(previous);
+}
+
+void hcn_set_send_budget(struct HCN_context *context, int bytes_per_tick, int packets_per_tick) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_set_send_budget(bytes_per_tick, packets_per_tick);
+	hcn_set_context(previous);
+}
+
+void hcn_set_pipeline(struct HCN_context *context, bool enabled) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_set_pipeline(enabled);
+	hcn_set_context(previous);
+}
+
+void hcn_set_player_team(struct HCN_context *context, int player_number, int team) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_set_player_team(player_number, team);
+	hcn_set_context(previous);
+}
+
+void hcn_client_start(struct HCN_context *context) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_client_start();
+	hcn_set_context(previous);
+}
+
+bool hcn_send_wide_datapoints(struct HCN_context *context, int player_number, const struct HCN_wide_datapoint *dps, int dp_count) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool sent = hcn_send_wide_datapoints(player_number, dps, dp_count);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+bool hcn_send_keyvalue_bool(struct HCN_context *context, int player_number, const char *key, bool value) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool sent = hcn_send_keyvalue_bool(player_number, key, value);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+bool hcn_send_keyvalue_int(struct HCN_context *context, int player_number, const char *key, int value) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool sent = hcn_send_keyvalue_int(player_number, key, value);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+bool hcn_send_keyvalue_float(struct HCN_context *context, int player_number, const char *key, float value) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool sent = hcn_send_keyvalue_float(player_number, key, value);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+bool hcn_send_typed_keyvalue(struct HCN_context *context, int player_number, const char *key, const struct HCN_value *value) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool sent = hcn_send_typed_keyvalue(player_number, key, value);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+bool hcn_bundle_datapoints(struct HCN_context *context, int player_number, struct HCN_datapoint *dps, int dp_count) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool bundled = hcn_bundle_datapoints(player_number, dps, dp_count);
+
+	hcn_set_context(previous);
+	return bundled;
+}
+
+bool hcn_bundle_vectors(struct HCN_context *context, int player_number, struct HCN_vector *vectors, int vector_count) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool bundled = hcn_bundle_vectors(player_number, vectors, vector_count);
+
+	hcn_set_context(previous);
+	return bundled;
+}
+
+bool hcn_bundle_keyvalue(struct HCN_context *context, int player_number, char *keyvalue) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool bundled = hcn_bundle_keyvalue(player_number, keyvalue);
+
+	hcn_set_context(previous);
+	return bundled;
+}
+
+bool hcn_bundle_text(struct HCN_context *context, int player_number, HCN_text_type type, HCN_text_color color, wchar_t *text) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool bundled = hcn_bundle_text(player_number, type, color, text);
+
+	hcn_set_context(previous);
+	return bundled;
+}
+
+bool hcn_bundle_text(struct HCN_context *context, int player_number, HCN_text_type type, HCN_text_color color, char *text) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool bundled = hcn_bundle_text(player_number, type, color, text);
+
+	hcn_set_context(previous);
+	return bundled;
+}
+
+bool hcn_bundle_flush(struct HCN_context *context, int player_number) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool sent = hcn_bundle_flush(player_number);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+int hcn_multicast_datapoints(struct HCN_context *context, unsigned int player_mask, struct HCN_datapoint *dps, int dp_count) {
+	struct HCN_context *previous = hcn_set_context(context);
+	int sent = hcn_multicast_datapoints(player_mask, dps, dp_count);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+int hcn_multicast_vectors(struct HCN_context *context, unsigned int player_mask, struct HCN_vector *vectors, int vector_count) {
+	struct HCN_context *previous = hcn_set_context(context);
+	int sent = hcn_multicast_vectors(player_mask, vectors, vector_count);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+int hcn_multicast_keyvalue(struct HCN_context *context, unsigned int player_mask, char *keyvalue) {
+	struct HCN_context *previous = hcn_set_context(context);
+	int sent = hcn_multicast_keyvalue(player_mask, keyvalue);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+int hcn_multicast_text(struct HCN_context *context, unsigned int player_mask, HCN_text_type type, HCN_text_color color, wchar_t *text) {
+	struct HCN_context *previous = hcn_set_context(context);
+	int sent = hcn_multicast_text(player_mask, type, color, text);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+int hcn_multicast_text(struct HCN_context *context, unsigned int player_mask, HCN_text_type type, HCN_text_color color, char *text) {
+	struct HCN_context *previous = hcn_set_context(context);
+	int sent = hcn_multicast_text(player_mask, type, color, text);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+int hcn_broadcast_datapoints(struct HCN_context *context, struct HCN_datapoint *dps, int dp_count) {
+	struct HCN_context *previous = hcn_set_context(context);
+	int sent = hcn_broadcast_datapoints(dps, dp_count);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+int hcn_broadcast_vectors(struct HCN_context *context, struct HCN_vector *vectors, int vector_count) {
+	struct HCN_context *previous = hcn_set_context(context);
+	int sent = hcn_broadcast_vectors(vectors, vector_count);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+int hcn_broadcast_keyvalue(struct HCN_context *context, char *keyvalue) {
+	struct HCN_context *previous = hcn_set_context(context);
+	int sent = hcn_broadcast_keyvalue(keyvalue);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+int hcn_broadcast_text(struct HCN_context *context, HCN_text_type type, HCN_text_color color, wchar_t *text) {
+	struct HCN_context *previous = hcn_set_context(context);
+	int sent = hcn_broadcast_text(type, color, text);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+int hcn_broadcast_text(struct HCN_context *context, HCN_text_type type, HCN_text_color color, char *text) {
+	struct HCN_context *previous = hcn_set_context(context);
+	int sent = hcn_broadcast_text(type, color, text);
+
+	hcn_set_context(previous);
+	return sent;
+}
+
+unsigned short hcn_get_capabilities(struct HCN_context *context, int player_number) {
+	struct HCN_context *previous = hcn_set_context(context);
+	unsigned short capabilities = hcn_get_capabilities(player_number);
+
+	hcn_set_context(previous);
+	return capabilities;
+}
+
+void hcn_get_send_stats(struct HCN_context *context, int player_number, struct HCN_send_stats *stats) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_get_send_stats(player_number, stats);
+	hcn_set_context(previous);
+}
+
+void hcn_reset_send_stats(struct HCN_context *context) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_reset_send_stats();
+	hcn_set_context(previous);
+}
+
+void hcn_get_pipeline_stats(struct HCN_context *context, struct HCN_pipeline_stats *stats) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_get_pipeline_stats(stats);
+	hcn_set_context(previous);
+}
+
+void hcn_get_chat_stats(struct HCN_context *context, struct HCN_chat_stats *stats) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_get_chat_stats(stats);
+	hcn_set_context(previous);
+}
+
+void hcn_reset_chat_stats(struct HCN_context *context) {
+	struct HCN_context *previous = hcn_set_context(context);
+
+	hcn_reset_chat_stats();
+	hcn_set_context(previous);
+}
+
+bool hcn_get_predicted_vector(struct HCN_context *context, int player_number, HCN_vector_type vector_type, unsigned char subject, struct HCN_vect3d *vector) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool predicted = hcn_get_predicted_vector(player_number, vector_type, subject, vector);
+
+	hcn_set_context(previous);
+	return predicted;
+}
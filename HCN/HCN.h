@@ -50,6 +50,7 @@
 #pragma once
 
 #include <memory>
+#include <atomic>
 
 // We need to pack packets as densely as possible, so set this:
 #pragma pack(push, 1)
@@ -98,6 +99,11 @@ enum HCN_CLIENT_TYPE : unsigned char {
 // Max players is always 16.
 #define HCN_MAX_PLAYERS			16
 
+// Player masks, for sending to more than one player at once. One bit per player number, starting with player 1.
+#define HCN_PLAYER_BIT(player_number)	(1u << ((player_number) - 1))
+#define HCN_ALL_PLAYERS			((1u << HCN_MAX_PLAYERS) - 1)
+#define HCN_NO_TEAM			-1
+
 // Some max sizes for key/value string lengths. Includes the null terminator.
 #define HCN_KEY_LENGTH		30
 #define HCN_VALUE_LENGTH	128
@@ -110,6 +116,22 @@ enum HCN_CLIENT_TYPE : unsigned char {
 #define HCN_ENCODE_ZERO		0xFF01				// If second 16-bit character is this, it decodes to a single 0x0000
 #define HCN_ENCODE_ORIGINAL	0xFFFF				// If second 16-bit character is this, it decodes to a 0xFFFF
 
+// Alternate encoding. Floats and small ints are full of 16-bit zeroes, which take two characters each. With a player
+//	that has HCN_CAP_ALTERNATE_ENCODING, every character after the first three is XORed with HCN_ENCODE_XOR before
+//	zero-encoding, so only the much rarer HCN_ENCODE_XOR and its complement need two. The sender uses it when it
+//	comes out shorter, and says so with HCN_PACKET_ALTERNATE in the packet type.
+#define HCN_ENCODE_XOR		0xA5A5
+#define HCN_PACKET_ALTERNATE	0x80				// Flag in the preamble's packet_type. Never seen once it's decoded.
+
+// Which encode/decode kernels to use. They all produce the exact same output, the SIMD ones are just faster.
+//	HCN_CODEC_AUTO picks the best the CPU supports. See hcn_set_codec().
+enum HCN_codec {
+	HCN_CODEC_AUTO = 0,
+	HCN_CODEC_SCALAR,					// One 16-bit character at a time. This is the reference.
+	HCN_CODEC_SSE2,						// 8 characters at a time.
+	HCN_CODEC_AVX2						// 16 characters at a time.
+};
+
 
 // A 3D vector (location, velocity, whatever). We need to define this here so that the application can actually use the
 //	data that HCN provides.
@@ -146,9 +168,32 @@ enum HCN_packet_type : unsigned char {
 	HCN_PACKET_DATAPOINT,					// BI - Report or update a datapoint. INT, FLOAT, whatever. Time remaining and tickrate are the first uses.
 	HCN_PACKET_VECTOR,					// BI - Update multiple vectors. Usually server->client for biped location/velocity, or tag locations like flags.
 	HCN_PACKET_KEYVALUE,					// BI - Pass a key and a value. SJ=ON, SJ=OFF, MTV=ON, etc.
-	HCN_PACKET_TEXT						// BI - Text of various types, possibly with a color set.
+	HCN_PACKET_TEXT,					// BI - Text of various types, possibly with a color set.
+	HCN_PACKET_BUNDLE,					// BI - Several of the above in one packet. Only sent if the other side has HCN_CAP_BUNDLE.
+	HCN_PACKET_COMPACT_VECTOR,				// BI - Quantized vectors, many to a packet. Only sent if the other side has HCN_CAP_COMPACT_VECTOR.
+	HCN_PACKET_DELTA_VECTOR,				// BI - Quantized vectors as changes from what the other side already has. HCN_CAP_DELTA_VECTOR.
+	HCN_PACKET_DELTA_ACK,					// BI - Tell the other side which delta vector packets we've got.
+	HCN_PACKET_KEY_DEFINE,					// BI - A keyvalue pair, and the number its key goes by from now on. HCN_CAP_KEY_ID.
+	HCN_PACKET_KEY_ID,					// BI - A value for a key the other side already numbered. HCN_CAP_KEY_ID.
+	HCN_PACKET_TYPED_KEYVALUE,				// BI - A key and a bool, int, float or string value in binary. HCN_CAP_TYPED_KEYVALUE.
+	HCN_PACKET_PACKED_DATAPOINT,				// BI - Datapoints as variable length values, 64-bit too. HCN_CAP_PACKED_DATAPOINT.
+	HCN_PACKET_COMPRESSED					// BI - A text or keyvalue packet, compressed. HCN_CAP_COMPRESSED.
 };
 
+// Capabilities. Sent after the version string in the handshake, older versions just don't send them. What's used with
+//	a player is what both sides have.
+#define HCN_CAP_BUNDLE		0x0001				// Understands HCN_PACKET_BUNDLE.
+#define HCN_CAP_COMPACT_VECTOR	0x0002				// Understands HCN_PACKET_COMPACT_VECTOR. Only once vector bounds are set.
+#define HCN_CAP_DELTA_VECTOR	0x0004				// Understands HCN_PACKET_DELTA_VECTOR and HCN_PACKET_DELTA_ACK. Needs HCN_CAP_COMPACT_VECTOR too.
+#define HCN_CAP_DEAD_RECKONING	0x0008				// Extrapolates locations between updates. Only sent while hcn_set_dead_reckoning() is on.
+#define HCN_CAP_KEY_ID		0x0010				// Understands HCN_PACKET_KEY_DEFINE and HCN_PACKET_KEY_ID.
+#define HCN_CAP_TYPED_KEYVALUE	0x0020				// Understands HCN_PACKET_TYPED_KEYVALUE.
+#define HCN_CAP_PACKED_DATAPOINT 0x0040				// Understands HCN_PACKET_PACKED_DATAPOINT.
+#define HCN_CAP_ALTERNATE_ENCODING 0x0080			// Decodes packets flagged with HCN_PACKET_ALTERNATE.
+#define HCN_CAP_COMPRESSED	0x0100				// Understands HCN_PACKET_COMPRESSED, with the dictionary in this version.
+#define HCN_CAP_NARROW_TEXT	0x0200				// Widens text flagged with HCN_TEXT_NARROWED.
+#define HCN_CAP_ALL		(HCN_CAP_BUNDLE | HCN_CAP_COMPACT_VECTOR | HCN_CAP_DELTA_VECTOR | HCN_CAP_DEAD_RECKONING | HCN_CAP_KEY_ID | HCN_CAP_TYPED_KEYVALUE | HCN_CAP_PACKED_DATAPOINT | HCN_CAP_ALTERNATE_ENCODING | HCN_CAP_COMPRESSED | HCN_CAP_NARROW_TEXT)
+
 // States for the state machine. At various stages of handshake, version exchange, and whatever follows that, we need to track state.
 enum HCN_state : unsigned char {
 	HCN_STATE_NONE = 1,					// we haven't done anything yet. This indicates a handshake needs to be performed.
@@ -182,6 +227,48 @@ struct HCN_preamble {
 
 };
 
+// What hcn_classify_chat() thinks a chat string is.
+enum HCN_chat_class {
+	HCN_CHAT_NOT_HCN = 0,					// Regular chat. Leave it alone.
+	HCN_CHAT_HCN,						// Looks like one of ours, go ahead and decode it.
+	HCN_CHAT_MALFORMED					// Has our magic # and chat type, but the preamble is bad.
+};
+
+// Counters kept by hcn_classify_chat().
+struct HCN_chat_stats {
+	unsigned int total;					// Every chat string we were asked about.
+	unsigned int not_hcn;					// Filtered out as regular chat.
+	unsigned int hcn;					// Passed on for decoding.
+	unsigned int malformed;					// Had our magic #, but was rejected anyway.
+};
+
+// One chat string for hcn_process_chat_batch().
+#define HCN_BATCH_CHUNK		64				// Batches are worked on this many at a time.
+struct HCN_chat_batch_entry {
+	int player_number;
+	int chat_type;
+	wchar_t *chat;						// Decoded in place, the same as hcn_process_chat().
+	bool handled;						// Set to what hcn_process_chat() would have returned.
+};
+
+// Result of hcn_decode_packet(). Anything but HCN_DECODE_OK means the packet should be dropped.
+enum HCN_decode_status {
+	HCN_DECODE_OK = 0,
+	HCN_DECODE_WRONG_CHAT_TYPE,				// Not our chat type.
+	HCN_DECODE_BAD_MAGIC,					// No magic # - probably just someone chatting.
+	HCN_DECODE_TOO_SHORT,					// Ends before the preamble does.
+	HCN_DECODE_BAD_TYPE,					// Packet type we don't know about.
+	HCN_DECODE_BAD_ESCAPE,					// Garbage after an encode tag.
+	HCN_DECODE_ENCODED_LENGTH,				// Encoded length doesn't match the preamble.
+	HCN_DECODE_LENGTH					// Decoded length doesn't match the preamble.
+};
+
+struct HCN_decode_result {
+	HCN_decode_status status;
+	int length;						// Decoded length in 16-bit characters.
+	int encoded_length;					// Encoded length in 16-bit characters, including the null terminator.
+};
+
 // HCN_handshake - A handshake packet. Includes versioning. 
 struct HCN_handshake {						// A handshake packet.
 	struct HCN_preamble preamble;				// Always need a preamble.
@@ -192,7 +279,9 @@ struct HCN_handshake {						// A handshake packet.
 								// - Client immediately goes to HCN_STATE_RUNNING after receiving this.
 
 	unsigned char hcn_type;					// enum of HCN_SERVER_TYPE or HCN_CLIENT_TYPE (based on hcn_state).
-	char version[HCN_KEYVALUE_LENGTH];			// There's always a version string at the end.
+	char version[HCN_KEYVALUE_LENGTH];			// There's always a version string at the end. Newer versions follow its
+								//	null terminator with an unsigned short of HCN_CAP_* capabilities,
+								//	then an unsigned int hash of their compact vector bounds.
 
 	HCN_handshake() { memset(version, 0, HCN_KEYVALUE_LENGTH); } // On construction, zero out the entire string.
 
@@ -243,6 +332,37 @@ struct HCN_datapoint_dispatch {
 	HCN_callback_datapoint callback;
 };
 
+// Or a handler per datapoint type, that gets back the context it was set with. See hcn_set_datapoint_handler().
+typedef bool(*HCN_handler_datapoint)(void *context, int player_number, HCN_datapoint_type dp_type, struct HCN_datapoint *dp);
+
+//
+// HCN packed datapoints - datapoints that say what kind of value they are, so each can go in as few bytes as it needs,
+//	and 64-bit values can go too. With a player that has HCN_CAP_PACKED_DATAPOINT, hcn_send_datapoints() uses them
+//	when they're smaller, and hcn_send_wide_datapoints() can send any number of them. After the preamble is a count,
+//	then each datapoint as:
+//
+//	unsigned char dp_type;
+//	unsigned char kind;					// HCN_datapoint_kind, plus HCN_DP_AS_FLOAT for a double that's exactly a float.
+//	value							// Varint for ints: 7 bits a byte, low bits first, top bit set on all
+//								//	but the last. Signed ones are zigzagged first, so small negative
+//								//	numbers are small too. Floats are 4 bytes, doubles 8, or 4 as a float.
+//
+
+#define HCN_DP_AS_FLOAT		0x80				// kind flag, a double sent as a float.
+#define HCN_PACKED_DATAPOINT_BODY 240				// Most bytes after the preamble. Enough that it fits however it's encoded.
+#define HCN_MAX_PACKED_DATAPOINTS (HCN_PACKED_DATAPOINT_BODY / 3) // Most datapoints in one packet, at 3 bytes for the smallest.
+
+enum HCN_datapoint_kind : unsigned char {
+	HCN_DP_INT,						// int, zigzag varint.
+	HCN_DP_UINT,						// unsigned int, varint.
+	HCN_DP_FLOAT,						// float, 4 bytes.
+	HCN_DP_INT64,						// long long, zigzag varint.
+	HCN_DP_DOUBLE						// double, 8 bytes, or 4.
+};
+
+// Packed datapoints are handed to handlers as HCN_wide_datapoint. See hcn_set_wide_datapoint_handler().
+typedef bool(*HCN_handler_wide_datapoint)(void *context, int player_number, const struct HCN_wide_datapoint *dp);
+
 
 
 //
@@ -288,6 +408,87 @@ struct HCN_vector_dispatch {
 	HCN_callback_vector callback;
 };
 
+// Or a handler per vector type, with a context. See hcn_set_vector_handler().
+typedef bool(*HCN_handler_vector)(void *context, int player_number, HCN_vector_type vector_type, struct HCN_vect3d *vector);
+
+//
+// HCN compact vectors - vectors quantized to 16 bits a component, inside bounds set per vector type, so a packet can
+//	carry every biped and both flags at once. Each one also says whose vector it is. Both sides have to use the same
+//	bounds, see hcn_set_vector_bounds(). Until the application sets them, HCN_CAP_COMPACT_VECTOR isn't offered, and
+//	the handshake checks both sides' bounds match. Precision is (max - min) / HCN_QUANTIZE_STEPS on each axis.
+//
+
+#define HCN_MAX_COMPACT_VECTORS	32				// Max compact vectors in a single packet.
+#define HCN_QUANTIZE_STEPS	65533				// Quantized values run 1 to 0xFFFE, so they never need zero-encoding.
+
+// HCN_subject_vector - a vector, and whose it is.
+struct HCN_subject_vector {
+	HCN_vector_type vector_type;
+	unsigned char subject;					// Player number for biped vectors, 0 if it's not anyone's.
+	struct HCN_vect3d vector;
+};
+
+// HCN_compact_vector - how a vector goes over the wire in a compact vector packet.
+struct HCN_compact_vector {
+	HCN_vector_type vector_type;
+	unsigned char subject;
+	unsigned short x;					// Quantized inside the bounds for vector_type.
+	unsigned short y;
+	unsigned short z;
+};
+
+// HCN_compact_vector_packet - a packet that can contain up to HCN_MAX_COMPACT_VECTORS vectors.
+struct HCN_compact_vector_packet {
+	struct HCN_preamble preamble;
+
+	unsigned char vector_count;
+	struct HCN_compact_vector vectors[HCN_MAX_COMPACT_VECTORS];
+
+	int size() const { return sizeof(preamble) + sizeof(vector_count); } // Return the size of the base packet.
+
+};
+
+// The range a vector type is quantized in.
+struct HCN_vector_bounds {
+	HCN_vector_type vector_type;
+	struct HCN_vect3d min;
+	struct HCN_vect3d max;
+};
+
+//
+// HCN delta vectors - compact vectors sent as the change from the last one the other side acked. After the preamble is
+//	a vector count and a sequence number (1-255, wrapping), then each vector as:
+//
+//	unsigned char vector_type;
+//	unsigned char subject;
+//	unsigned char baseline;					// Sequence number of the packet this is a change from, or 0 for a keyframe.
+//	unsigned short x, y, z;					// Keyframe: quantized, same as HCN_compact_vector.
+//	 - or -
+//	unsigned char dx, dy, dz;				// Change: change in the quantized values, plus 128 (-127 to 127).
+//
+//	The receiver sends back an HCN_PACKET_DELTA_ACK from hcn_on_tick(), with the newest sequence number it got since
+//	the last tick, then an unsigned int with a bit for each of the 32 before it that it got too, bit 0 for the one
+//	just before. Only those are used as baselines. So hcn_on_tick() has to be called for deltas to be used,
+//	otherwise it's all keyframes.
+//
+
+#define HCN_DELTA_SLOTS		64				// Different vectors (type and subject) tracked per player.
+#define HCN_DELTA_HISTORY	16				// Packets remembered per vector, sent or received.
+#define HCN_DELTA_KEYFRAME	32				// Send a keyframe for a vector at least this often.
+
+//
+// Dead reckoning. When both sides have it on, a biped location or flag vector is only sent when the other side's guess
+//	at it would be off by more than the threshold. The guess is the last location sent, moved along by the last
+//	HCN_VECTOR_BIPED_VELOCITY sent for the same subject (a flag's subject is whoever is carrying it, 0 if nobody),
+//	for each tick since. Velocities are per tick. The receiver hands its guesses to the vector callbacks every
+//	hcn_on_tick() there isn't a real update, for up to HCN_DR_MAX_TICKS ticks. Ticks are counted by hcn_on_tick().
+//
+
+#define HCN_DR_SLOTS		64				// Different vectors (type and subject) tracked per player.
+#define HCN_DR_MAX_TICKS	30				// Stop guessing after this many ticks without an update.
+
+typedef bool(*HCN_callback_subject_vector)(int player_number, HCN_vector_type vector_type, unsigned char subject, struct HCN_vect3d *vector);
+
 
 // HCN_keyvalue - takes a variable-length string of the form "key=value". 
 struct HCN_keyvalue_packet {
@@ -308,10 +509,65 @@ struct HCN_keyvalue_packet {
 //	char *value is provided by the application, as a string array to copy the value to. MUST adhere to HCN_VALUE_LENGTH
 typedef bool(*HCN_callback_keyvalue)(int player_number, char *key, char *value);
 
+// HCN_callback_typed_keyvalue - the same, but the value is whatever type it was sent as. See HCN_value.
+typedef bool(*HCN_callback_typed_keyvalue)(int player_number, char *key, const struct HCN_value *value);
+
 // HCN_key_dispatch - Application will use this to define an array of key callback functions.
+//	If a key has a typed_callback, it gets every value for that key, and callback can be NULL. Values sent as strings
+//	come to it as HCN_VALUE_STRING. Without one, typed values are turned into strings for callback.
 struct HCN_key_dispatch {
 	char *key;
 	HCN_callback_keyvalue callback;
+	HCN_callback_typed_keyvalue typed_callback;
+};
+
+#define HCN_KEY_SLOTS		256				// Hash table slots for the key list. Has to be a power of 2, and
+								//	only half as many keys are hashed, the rest are looked up one by one.
+
+//
+// HCN key numbers. With a player that has HCN_CAP_KEY_ID, hcn_send_keyvalue() numbers each key the first time it
+//	goes to them, and after that only sends the number and the value. The first time is an HCN_PACKET_KEY_DEFINE:
+//
+//	unsigned char key_id;					// 1 for the first key, then 2, and so on. The same number again replaces it.
+//	char keyvalue_length;					// Then the same as HCN_keyvalue_packet.
+//	char keyvalue[];
+//
+//	After that it's an HCN_PACKET_KEY_ID:
+//
+//	unsigned char key_id;
+//	unsigned char value_length;				// Including the null terminator. 0 if there was no = in the pair.
+//	char value[];
+//
+//	Numbers are per player and per direction, and start over with a new handshake. Keys that don't fit in
+//	HCN_KEY_IDS numbers or HCN_KEY_ID_SPACE bytes go as plain keyvalue packets.
+//
+
+#define HCN_KEY_IDS		64				// Keys numbered per player, each way.
+#define HCN_KEY_ID_SPACE	1024				// Bytes for those keys, null terminators and all.
+
+//
+// HCN typed keyvalues - a key and a value in binary, so on/off toggles and numbers don't have to be turned into
+//	strings and back. See hcn_send_keyvalue_bool() and the others. After the preamble:
+//
+//	unsigned char value_type;				// HCN_value_type, plus HCN_TYPED_DEFINE if the key is being numbered.
+//	unsigned char key_id;					// A key number, the same numbers as HCN_PACKET_KEY_DEFINE, or 0.
+//	unsigned char key_length;				// Only if key_id is 0, or the key is being numbered,
+//	char key[];						//	and no null terminator.
+//	bool / int / float					// Then the value, 1 byte for a bool, 4 for an int or float.
+//	 - or -
+//	unsigned char value_length;				// For a string, including the null terminator. 0 for no value.
+//	char value[];
+//
+//	Players that don't have HCN_CAP_TYPED_KEYVALUE get a regular keyvalue, with the value turned into a string.
+//
+
+#define HCN_TYPED_DEFINE	0x80				// value_type flag, key_id is a new number for this key.
+
+enum HCN_value_type : unsigned char {
+	HCN_VALUE_STRING,
+	HCN_VALUE_BOOL,
+	HCN_VALUE_INT,
+	HCN_VALUE_FLOAT
 };
 
 // Define a way to list keys and values. Useful for decoding ENUMS into text.
@@ -328,6 +584,10 @@ enum HCN_text_type : unsigned char {
 	HCN_TEXT_HUD						// HUD text.
 };
 
+// Flag in a text packet's text_type. UTF-16 text that was all Latin-1, so it was sent as 8-bit. Only sent to players
+//	with HCN_CAP_NARROW_TEXT, and it's widened back to UTF-16 before the handler sees it.
+#define HCN_TEXT_NARROWED	0x80
+
 // HCN_text_color - Mirrors HAC2's text colors for now. If more are needed, start at enum 20
 enum HCN_text_color : unsigned char {
 	HCN_COLOR_DEFAULT,
@@ -364,16 +624,225 @@ struct HCN_text_dispatch {
 	HCN_callback_text callback;
 };
 
+// Or a handler per text type, with a context. See hcn_set_text_handler().
+typedef bool(*HCN_handler_text)(void *context, int player_number, HCN_text_type text_type, struct HCN_text_packet *packet);
+
+//
+// HCN bundles - several datapoint, vector, keyvalue or text messages in one packet, so a tick's worth of small updates
+//	costs one chat message instead of many. After the preamble is a message count, then each message as:
+//
+//	unsigned char packet_type;				// HCN_PACKET_DATAPOINT, etc. Never a handshake or another bundle.
+//	unsigned char length;					// Length of the body in bytes.
+//	body							// Exactly what would follow the preamble if it was sent on its own.
+//
+
+#define HCN_BUNDLE_MAX_MESSAGE	255				// Biggest message body that can go in a bundle.
+
+//
+// HCN compressed packets - text and keyvalue packets, LZ compressed against a fixed dictionary of things servers say a
+//	lot. Only sent to players with HCN_CAP_COMPRESSED, and only when it's smaller. After the preamble is:
+//
+//	unsigned char packet_type;				// What it is once it's decompressed. Text, keyvalue, or a numbered keyvalue.
+//	unsigned char flags;					// HCN_COMPRESS_WIDE if the dictionary is matched as UTF-16.
+//	tokens							// 0-127 is that many plus one bytes as-is. 128-255 is a match of
+//								//	(token & 0x7F) + 4 bytes, starting two more bytes (low first)
+//								//	back. The dictionary counts as being right before the body.
+//
+
+#define HCN_COMPRESS_WIDE	0x01				// Dictionary characters are 16-bit, for UTF-16 text.
+#define HCN_COMPRESSED_BODY	240				// Most bytes after the preamble, compressed.
+#define HCN_COMPRESSED_MAX_BODY	(HCN_MAX_PACKET_LENGTH - (int)sizeof(struct HCN_preamble))	// Most bytes it can decompress to.
+#define HCN_COMPRESS_MIN_MATCH	4
+#define HCN_COMPRESS_MAX_MATCH	(0x7F + HCN_COMPRESS_MIN_MATCH)
+
 
 // Turn off tight packing.
 #pragma pack(pop)
 
+// Vectors in bulk, as a struct of arrays, for the vector block callback. Instead of one call per vector, it gets each
+//	packet's vectors at once, or everything from a hcn_process_chat_batch(), a hcn_pipeline_work() or the dead
+//	reckoning guesses of a hcn_on_tick(), across all players. Entries 0 to count-1 are filled in. More than
+//	HCN_VECTOR_BLOCK vectors come in more than one call. x, y and z are aligned so they can be worked on with SIMD,
+//	which is why this is after the tight packing is turned off.
+#define HCN_VECTOR_BLOCK	256
+
+struct HCN_vector_block {
+	int count;
+	int player_number[HCN_VECTOR_BLOCK];
+	HCN_vector_type vector_type[HCN_VECTOR_BLOCK];
+	unsigned char subject[HCN_VECTOR_BLOCK];		// 0 for vectors that came in regular vector packets.
+	alignas(32) float x[HCN_VECTOR_BLOCK];
+	alignas(32) float y[HCN_VECTOR_BLOCK];
+	alignas(32) float z[HCN_VECTOR_BLOCK];
+};
+
+typedef void(*HCN_callback_vector_block)(const struct HCN_vector_block *block);
+
+// A datapoint of any kind, for packed datapoints. Not part of any packet either.
+struct HCN_wide_datapoint {
+	HCN_datapoint_type dp_type;
+	HCN_datapoint_kind kind;
+	union {
+		int dp_int;
+		unsigned int dp_uint;
+		float dp_float;
+		long long dp_int64;
+		double dp_double;
+	};
+};
+
+// A keyvalue's value, for typed keyvalue callbacks. Not part of any packet, so it's not packed.
+struct HCN_value {
+	HCN_value_type value_type;
+	union {
+		bool b;
+		int i;
+		float f;
+		const char *s;						// NULL if there was no value. Only good until the callback returns.
+	};
+};
+
+// Worst case encoded length of a packet with the given un-encoded length in bytes, if every 16-bit character needs
+//	encoding. In 16-bit characters, including the null terminator.
+#define HCN_ENCODED_SIZE(bytes)		((int)((((bytes) + 1) / 2) * 2 + 1))
+
+// Packet schema. Every packet type is a short head after the preamble, then up to Max entries of the same type, so
+//	each one is described once here and everything about its size is worked out from that at compile time. The
+//	head of the counted types is just the count. body_length() is the body with count entries, not the preamble.
+template <HCN_packet_type Type, int Head, typename Entry, int Max>
+struct HCN_packet_schema {
+	typedef Entry entry_type;
+	static const HCN_packet_type packet_type = Type;
+	static const int head_length = Head;
+	static const int max_count = Max;
+
+	static constexpr int body_length(int count) { return Head + count * (int)sizeof(Entry); }
+	static constexpr int max_length() { return (int)sizeof(struct HCN_preamble) + body_length(Max); }
+	static constexpr int max_encoded() { return HCN_ENCODED_SIZE(max_length()); }
+};
+
+typedef HCN_packet_schema<HCN_PACKET_HANDSHAKE, 2, char, HCN_KEYVALUE_LENGTH + sizeof(unsigned short)> HCN_handshake_schema; // Version, then capabilities.
+typedef HCN_packet_schema<HCN_PACKET_DATAPOINT, 1, struct HCN_datapoint, HCN_MAX_DATAPOINTS> HCN_datapoint_schema;
+typedef HCN_packet_schema<HCN_PACKET_VECTOR, 1, struct HCN_vector, HCN_MAX_VECTORS> HCN_vector_schema;
+typedef HCN_packet_schema<HCN_PACKET_COMPACT_VECTOR, 1, struct HCN_compact_vector, HCN_MAX_COMPACT_VECTORS> HCN_compact_vector_schema;
+typedef HCN_packet_schema<HCN_PACKET_KEYVALUE, 1, char, HCN_KEYVALUE_LENGTH> HCN_keyvalue_schema;
+typedef HCN_packet_schema<HCN_PACKET_TEXT, 3, wchar_t, HCN_TEXT_LENGTH> HCN_text_schema;	// Type, color and length.
+
+// Worst case encoded length of each packet type.
+#define HCN_HANDSHAKE_MAX_ENCODED	HCN_handshake_schema::max_encoded()
+#define HCN_DATAPOINT_MAX_ENCODED	HCN_datapoint_schema::max_encoded()
+#define HCN_VECTOR_MAX_ENCODED		HCN_vector_schema::max_encoded()
+#define HCN_KEYVALUE_MAX_ENCODED	HCN_keyvalue_schema::max_encoded()
+#define HCN_TEXT_MAX_ENCODED		HCN_text_schema::max_encoded()			// More than HCN_MAX_PACKET_LENGTH.
+#define HCN_BUNDLE_MAX_ENCODED		(HCN_MAX_PACKET_LENGTH / 2)				// Bundles are filled to fit.
+#define HCN_KEY_ID_MAX_ENCODED		HCN_ENCODED_SIZE(HCN_keyvalue_schema::max_length() + 1)	// Either one, a keyvalue plus the key number at most.
+#define HCN_TYPED_KEYVALUE_MAX_ENCODED	HCN_ENCODED_SIZE(sizeof(struct HCN_preamble) + 4 + HCN_KEY_LENGTH + HCN_VALUE_LENGTH)
+#define HCN_PACKED_DATAPOINT_MAX_ENCODED HCN_ENCODED_SIZE(sizeof(struct HCN_preamble) + HCN_PACKED_DATAPOINT_BODY)
+#define HCN_COMPRESSED_MAX_ENCODED	HCN_ENCODED_SIZE(sizeof(struct HCN_preamble) + HCN_COMPRESSED_BODY)
+
+// Compact vectors start on a 16-bit boundary, and only the type/subject can need encoding, so it's much less than the worst case.
+#define HCN_COMPACT_VECTOR_MAX_ENCODED	((int)(sizeof(struct HCN_preamble) + 1) / 2 + HCN_MAX_COMPACT_VECTORS * ((int)sizeof(struct HCN_compact_vector) / 2 + 1) + 1)
+
+//
+// Packet views. On receive, packets are decoded in place, right over the chat string Halo gave us, and the application
+//	gets read-only views that point into it. Nothing is copied unless the application asks for it with hcn_view_copy().
+//	Views are only good until the callback returns.
+//
+
+// A decoded packet.
+struct HCN_packet_view {
+	HCN_packet_type packet_type;
+	const struct HCN_preamble *preamble;			// The packet's preamble. NULL for a message that came in a bundle.
+	const unsigned char *body;				// Everything after the preamble.
+	int body_length;					// Length of the body in bytes.
+};
+
+// The datapoints in a datapoint packet. See hcn_view_datapoints().
+struct HCN_datapoint_view {
+	int count;
+	const struct HCN_datapoint *dps;
+};
+
+// The vectors in a vector packet. See hcn_view_vectors().
+struct HCN_vector_view {
+	int count;
+	const struct HCN_vector *vectors;
+};
+
+// A key/value pair. Neither key nor value is null terminated at the split, use the lengths. See hcn_view_keyvalue().
+struct HCN_keyvalue_view {
+	const char *key;
+	int key_length;
+	const char *value;					// NULL if there was no = in the pair.
+	int value_length;
+};
+
+// The text in a text packet. See hcn_view_text().
+struct HCN_text_view {
+	HCN_text_type text_type;
+	HCN_text_color color;
+	bool narrow;						// true if it's 8-bit text (text8), otherwise UTF-16 (text).
+	bool narrowed;						// 8-bit text that was UTF-16 when it was sent, see HCN_TEXT_NARROWED.
+	int length;						// In characters, not counting the null terminator.
+	const wchar_t *text;
+	const char *text8;
+	const struct HCN_text_packet *packet;			// The whole packet, for the HCN_callback_text callbacks. If it came in a
+								//	bundle, only the fields after the preamble are real.
+};
+
+//
+// Outbound scheduler. Off by default, so sends go out immediately. When it's on, hcn_send_*() queue per player, and each
+//	hcn_on_tick() sends up to the per-player budget, one lane at a time in this order.
+//
+enum HCN_lane : unsigned char {
+	HCN_LANE_CONTROL = 0,					// Handshakes and key/value pairs.
+	HCN_LANE_TEXT,						// Text, HUD messages and such.
+	HCN_LANE_DATAPOINT,					// Datapoints, and bundles.
+	HCN_LANE_VECTOR,					// Vectors. Only the latest of each type and subject is kept.
+	HCN_LANES
+};
+
+#define HCN_LANE_DEPTH		8				// Packets each lane can hold. Vectors don't count against this,
+#define HCN_LANE_VECTORS	64				// the vector lane holds this many different vectors.
+
+// Outbound counters, per player. See hcn_get_send_stats().
+struct HCN_send_stats {
+	unsigned int queued;					// Packets queued, each vector counts as one.
+	unsigned int sent;					// Packets sent from the queues.
+	unsigned int bytes;					// Encoded bytes sent from the queues.
+	unsigned int superseded;				// Vectors replaced by a newer one before they went out.
+	unsigned int dropped;					// Packets (or vectors) refused because their lane was full, or that couldn't be sent when their turn came.
+	int depth;						// Packets and vectors still queued.
+};
+
+// Pipelined mode, see hcn_set_pipeline(). Chat goes to the worker, and packets come back to hcn_on_tick(), through rings.
+#define HCN_RING_DEPTH		64				// Packets each ring holds. Has to be a power of 2.
+
+// Pipeline counters. See hcn_get_pipeline_stats().
+struct HCN_pipeline_stats {
+	unsigned int inbound_queued;				// Chat packets handed to the worker.
+	unsigned int inbound_dropped;				// Refused because the inbound ring was full.
+	int inbound_depth;					// Still waiting for the worker.
+	unsigned int outbound_queued;				// Encoded packets handed to hcn_on_tick().
+	unsigned int outbound_dropped;				// Refused because the outbound ring was full.
+	int outbound_depth;					// Still waiting for hcn_on_tick().
+};
+
+// Optional callback that gets every decoded packet, except handshakes, as a view. Return true if it was handled.
+typedef bool(*HCN_callback_packet)(int player_number, const struct HCN_packet_view *view);
+
 // An external logger callback. Set by hcn_logger_callback(...) - so a caller can log HCN errors or debug output through it's own logger function
 typedef void(*HCN_logger_callback)(int level, const char *string);
 
 // An external "application packet sender" that the application defines. Takes player_number and a packet.
 typedef void(*HCN_application_sender)(int player_number, struct HCN_packet *packet);
 
+// Or, a reserve/commit pair so HCN can encode straight into the application's chat buffer. reserve has to return room
+//	for at least length 16-bit characters (never more than HCN_MAX_PACKET_LENGTH / 2), or NULL if it can't. commit
+//	sends it, length includes the null terminator. A length of 0 means the packet didn't fit, and should be dropped.
+typedef wchar_t *(*HCN_application_reserve)(int player_number, int length);
+typedef void(*HCN_application_commit)(int player_number, wchar_t *chat, int length);
+
 // Levels for HCN logger.
 enum HCN_log_level {
 	HCN_LOG_FATAL = 0,					// Completely fatal.
@@ -388,14 +857,29 @@ enum HCN_log_level {
 // All externals are below. Data locations first:
 // **********************************************
 
-// The current HCN state.
-extern HCN_state hcn_state[HCN_MAX_PLAYERS];
-extern char hcn_our_version[HCN_VALUE_LENGTH];
-
-// What we are, client or server. And what type.
-extern HCN_OUR_SIDE hcn_our_side;
-extern HCN_SERVER_TYPE hcn_server_type;
-extern HCN_CLIENT_TYPE hcn_client_type[HCN_MAX_PLAYERS];
+// All of HCN's state lives in a context. Applications with one session never need to know, everything works on the
+//	default context. Others can make more with hcn_context_create(), and pick one per thread with hcn_set_context().
+//	Within a context, hcn_process_chat() and the send functions can run on different threads as long as each is working
+//	on a different player, and hcn_running() is fine from anywhere. Setting callbacks, options and hcn_init() are still
+//	for one thread, before the others get going. A thread that exits with a context still selected lets go of it.
+struct HCN_context;
+
+// The current HCN state. These work like they always have, but on the current context.
+//	hcn_state can't be a macro, the handshake packet has a member by that name.
+struct HCN_context_state {
+	std::atomic<HCN_state> &operator[](int pi) const;
+};
+extern const struct HCN_context_state hcn_state;
+extern char *hcn_context_our_version();
+inline char *hcn_our_version() { return hcn_context_our_version(); }
+
+// What we are, client or server. And what type. Set them with hcn_what_we_are().
+extern HCN_OUR_SIDE *hcn_context_our_side();
+extern HCN_SERVER_TYPE *hcn_context_server_type();
+extern HCN_CLIENT_TYPE *hcn_context_client_type();
+inline HCN_OUR_SIDE hcn_our_side() { return *hcn_context_our_side(); }
+inline HCN_SERVER_TYPE hcn_server_type() { return *hcn_context_server_type(); }
+inline HCN_CLIENT_TYPE hcn_client_type() { return hcn_context_client_type()[0]; }	// A client only has the one.
 
 // Functions. Careful, some are overloaded...
 extern void hcn_logger(int level, const char *string, ...);
@@ -403,14 +887,22 @@ extern int hcn_get_debug_level();
 extern void hcn_set_debug_level(int level);
 extern void hcn_client_start();
 extern void hcn_set_packet_sender(HCN_application_sender application_sender);
+extern void hcn_set_packet_reserve_commit(HCN_application_reserve reserve, HCN_application_commit commit);
 extern void hcn_set_datapoint_callback_list(HCN_datapoint_dispatch *datapoint_list, int datapoint_list_length);
 extern void hcn_set_vector_callback_list(HCN_vector_dispatch *vector_list, int vector_list_length);
 extern void hcn_set_keyvalue_callback_list(HCN_key_dispatch *key_list);
 extern void hcn_set_text_callback_list(HCN_text_dispatch *text_list, int text_list_length);
+extern bool hcn_set_datapoint_handler(HCN_datapoint_type dp_type, HCN_handler_datapoint handler, void *context);
+extern bool hcn_set_wide_datapoint_handler(HCN_datapoint_type dp_type, HCN_handler_wide_datapoint handler, void *context);
+extern bool hcn_set_vector_handler(HCN_vector_type vector_type, HCN_handler_vector handler, void *context);
+extern bool hcn_set_text_handler(HCN_text_type text_type, HCN_handler_text handler, void *context);
 
 extern struct HCN_enum_to_string HCN_state_names[];
 extern struct HCN_enum_to_string HCN_server_names[];
 extern struct HCN_enum_to_string HCN_client_names[];
+extern struct HCN_enum_to_string HCN_codec_names[];
+extern struct HCN_enum_to_string HCN_decode_status_names[];
+extern struct HCN_enum_to_string HCN_chat_class_names[];
 
 extern void hcn_init(char *version);
 extern void hcn_what_we_are(HCN_OUR_SIDE our_side, HCN_CLIENT_TYPE client_type);
@@ -419,20 +911,234 @@ extern void hcn_on_tick();
 extern bool hcn_running(int player_number);
 extern void hcn_set_logger_callback(HCN_logger_callback callback);
 extern void hcn_clear_player(int player_number);
+extern void hcn_set_capabilities(unsigned short capabilities);
+extern unsigned short hcn_get_capabilities(int player_number);
 extern bool hcn_value_bool(char *value);
 extern bool hcn_valid_packet(struct HCN_packet *packet, unsigned int chat_type);
 extern int hcn_encode(struct HCN_packet *packet, struct HCN_packet *source, int packet_length);
 extern int hcn_decode(struct HCN_packet *packet, struct HCN_packet *source);
+extern HCN_chat_class hcn_classify_chat(int chat_type, const wchar_t *chat);
+extern void hcn_get_chat_stats(struct HCN_chat_stats *stats);
+extern void hcn_reset_chat_stats();
+extern HCN_decode_result hcn_decode_packet(struct HCN_packet *packet, const wchar_t *source, int chat_type);
+extern int hcn_encode_scalar(struct HCN_packet *packet, struct HCN_packet *source, int packet_length);
+extern int hcn_decode_scalar(struct HCN_packet *packet, struct HCN_packet *source);
+extern bool hcn_narrow(char *narrow, const wchar_t *text, int count);
+extern void hcn_widen(wchar_t *text, const char *narrow, int count);
+extern bool hcn_narrow_scalar(char *narrow, const wchar_t *text, int count);
+extern void hcn_widen_scalar(wchar_t *text, const char *narrow, int count);
+extern HCN_codec hcn_set_codec(HCN_codec codec);
+extern HCN_codec hcn_get_codec();
 extern void hcn_packet_sender(int player_number, HCN_packet *packet, int packet_length);
 extern char *hcn_enum_to_string(int e_num, HCN_enum_to_string *enum_list);
 extern bool hcn_process_chat(int player_number, int chat_type, wchar_t *our_packet);
+extern int hcn_process_chat_batch(struct HCN_chat_batch_entry *batch, int count);
 extern bool hcn_datapoint_packet_handler(int player_number, HCN_packet *packet);
 extern bool hcn_vector_packet_handler(int player_number, HCN_packet *packet);
 extern bool hcn_text_packet_handler(int player_number, HCN_packet *packet);
+extern void hcn_set_packet_callback(HCN_callback_packet callback);
+extern bool hcn_view_datapoints(const struct HCN_packet_view *view, struct HCN_datapoint_view *dps);
+extern bool hcn_view_vectors(const struct HCN_packet_view *view, struct HCN_vector_view *vectors);
+extern bool hcn_view_keyvalue(const struct HCN_packet_view *view, struct HCN_keyvalue_view *kv);
+extern bool hcn_view_text(const struct HCN_packet_view *view, struct HCN_text_view *text);
+extern int hcn_view_copy(const struct HCN_packet_view *view, struct HCN_packet *packet);
+extern bool hcn_dispatch_view(int player_number, const struct HCN_packet_view *view);
+extern bool hcn_datapoint_view_handler(int player_number, const struct HCN_packet_view *view);
+extern bool hcn_vector_view_handler(int player_number, const struct HCN_packet_view *view);
+extern bool hcn_keyvalue_view_handler(int player_number, const struct HCN_packet_view *view);
+extern bool hcn_text_view_handler(int player_number, const struct HCN_packet_view *view);
+extern bool hcn_bundle_view_handler(int player_number, const struct HCN_packet_view *view);
+extern bool hcn_key_define_view_handler(int player_number, const struct HCN_packet_view *view);
+extern bool hcn_key_id_view_handler(int player_number, const struct HCN_packet_view *view);
+extern bool hcn_typed_keyvalue_view_handler(int player_number, const struct HCN_packet_view *view);
+extern bool hcn_packed_datapoint_view_handler(int player_number, const struct HCN_packet_view *view);
+extern bool hcn_compressed_view_handler(int player_number, const struct HCN_packet_view *view);
 extern bool hcn_send_datapoints(int player_number, struct HCN_datapoint *dps, int dp_count);
+extern bool hcn_send_wide_datapoints(int player_number, const struct HCN_wide_datapoint *dps, int dp_count);
 extern bool hcn_send_vectors(int player_number, struct HCN_vector *vectors, int vector_count);
 extern bool hcn_send_keyvalue(int player_number, char *keyvalue);
+extern bool hcn_send_keyvalue_bool(int player_number, const char *key, bool value);
+extern bool hcn_send_keyvalue_int(int player_number, const char *key, int value);
+extern bool hcn_send_keyvalue_float(int player_number, const char *key, float value);
+extern bool hcn_send_typed_keyvalue(int player_number, const char *key, const struct HCN_value *value);
 extern bool hcn_send_text(int player_number, HCN_text_type type, HCN_text_color color, wchar_t *text);
 extern bool hcn_send_text(int player_number, HCN_text_type type, HCN_text_color color, char *text);
+extern bool hcn_bundle_datapoints(int player_number, struct HCN_datapoint *dps, int dp_count);
+extern bool hcn_bundle_vectors(int player_number, struct HCN_vector *vectors, int vector_count);
+extern bool hcn_bundle_keyvalue(int player_number, char *keyvalue);
+extern bool hcn_bundle_text(int player_number, HCN_text_type type, HCN_text_color color, wchar_t *text);
+extern bool hcn_bundle_text(int player_number, HCN_text_type type, HCN_text_color color, char *text);
+extern bool hcn_bundle_flush(int player_number);
+extern void hcn_set_player_team(int player_number, int team);
+extern unsigned int hcn_team_mask(int team);
+extern int hcn_multicast_datapoints(unsigned int player_mask, struct HCN_datapoint *dps, int dp_count);
+extern int hcn_multicast_vectors(unsigned int player_mask, struct HCN_vector *vectors, int vector_count);
+extern int hcn_multicast_keyvalue(unsigned int player_mask, char *keyvalue);
+extern int hcn_multicast_text(unsigned int player_mask, HCN_text_type type, HCN_text_color color, wchar_t *text);
+extern int hcn_multicast_text(unsigned int player_mask, HCN_text_type type, HCN_text_color color, char *text);
+extern int hcn_broadcast_datapoints(struct HCN_datapoint *dps, int dp_count);
+extern int hcn_broadcast_vectors(struct HCN_vector *vectors, int vector_count);
+extern int hcn_broadcast_keyvalue(char *keyvalue);
+extern int hcn_broadcast_text(HCN_text_type type, HCN_text_color color, wchar_t *text);
+extern int hcn_broadcast_text(HCN_text_type type, HCN_text_color color, char *text);
+extern bool hcn_send_subject_vectors(int player_number, struct HCN_subject_vector *vectors, int vector_count);
+extern void hcn_set_vector_bounds(struct HCN_vector_bounds *bounds, int bounds_count);
+extern void hcn_set_subject_vector_callback(HCN_callback_subject_vector callback);
+extern void hcn_set_vector_block_callback(HCN_callback_vector_block callback);
+extern int hcn_view_compact_vectors(const struct HCN_packet_view *view, struct HCN_subject_vector *vectors);
+extern bool hcn_compact_vector_view_handler(int player_number, const struct HCN_packet_view *view);
+extern bool hcn_delta_vector_view_handler(int player_number, const struct HCN_packet_view *view);
+extern bool hcn_delta_ack_view_handler(int player_number, const struct HCN_packet_view *view);
+extern void hcn_set_dead_reckoning(bool enabled, float threshold);
+extern bool hcn_get_predicted_vector(int player_number, HCN_vector_type vector_type, unsigned char subject, struct HCN_vect3d *vector);
+extern void hcn_set_scheduler(bool enabled);
+extern void hcn_set_send_budget(int bytes_per_tick, int packets_per_tick);
+extern void hcn_get_send_stats(int player_number, struct HCN_send_stats *stats);
+extern void hcn_reset_send_stats();
+extern void hcn_set_pipeline(bool enabled);
+extern int hcn_pipeline_work(int max_packets);
+extern void hcn_get_pipeline_stats(struct HCN_pipeline_stats *stats);
+extern struct HCN_context *hcn_context_create();
+extern bool hcn_context_destroy(struct HCN_context *context);
+extern struct HCN_context *hcn_set_context(struct HCN_context *context);
+extern struct HCN_context *hcn_get_context();
+extern void hcn_init(struct HCN_context *context, char *version);
+extern void hcn_what_we_are(struct HCN_context *context, HCN_OUR_SIDE our_side, HCN_CLIENT_TYPE client_type);
+extern void hcn_what_we_are(struct HCN_context *context, HCN_OUR_SIDE our_side, HCN_SERVER_TYPE server_type);
+extern void hcn_on_tick(struct HCN_context *context);
+extern bool hcn_running(struct HCN_context *context, int player_number);
+extern void hcn_clear_player(struct HCN_context *context, int player_number);
+extern bool hcn_process_chat(struct HCN_context *context, int player_number, int chat_type, wchar_t *our_packet);
+extern int hcn_process_chat_batch(struct HCN_context *context, struct HCN_chat_batch_entry *batch, int count);
+extern int hcn_pipeline_work(struct HCN_context *context, int max_packets);
+extern bool hcn_send_datapoints(struct HCN_context *context, int player_number, struct HCN_datapoint *dps, int dp_count);
+extern bool hcn_send_vectors(struct HCN_context *context, int player_number, struct HCN_vector *vectors, int vector_count);
+extern bool hcn_send_subject_vectors(struct HCN_context *context, int player_number, struct HCN_subject_vector *vectors, int vector_count);
+extern bool hcn_send_keyvalue(struct HCN_context *context, int player_number, char *keyvalue);
+extern bool hcn_send_text(struct HCN_context *context, int player_number, HCN_text_type type, HCN_text_color color, wchar_t *text);
+extern bool hcn_send_text(struct HCN_context *context, int player_number, HCN_text_type type, HCN_text_color color, char *text);
+extern void hcn_set_debug_level(struct HCN_context *context, int level);
+extern void hcn_set_logger_callback(struct HCN_context *context, HCN_logger_callback callback);
+extern void hcn_set_packet_sender(struct HCN_context *context, HCN_application_sender application_sender);
+extern void hcn_set_packet_reserve_commit(struct HCN_context *context, HCN_application_reserve reserve, HCN_application_commit commit);
+extern void hcn_set_packet_callback(struct HCN_context *context, HCN_callback_packet callback);
+extern void hcn_set_datapoint_callback_list(struct HCN_context *context, HCN_datapoint_dispatch *datapoint_list, int datapoint_list_length);
+extern void hcn_set_vector_callback_list(struct HCN_context *context, HCN_vector_dispatch *vector_list, int vector_list_length);
+extern void hcn_set_keyvalue_callback_list(struct HCN_context *context, HCN_key_dispatch *key_list);
+extern void hcn_set_text_callback_list(struct HCN_context *context, HCN_text_dispatch *text_list, int text_list_length);
+extern bool hcn_set_datapoint_handler(struct HCN_context *context, HCN_datapoint_type dp_type, HCN_handler_datapoint handler, void *handler_context);
+extern bool hcn_set_wide_datapoint_handler(struct HCN_context *context, HCN_datapoint_type dp_type, HCN_handler_wide_datapoint handler, void *handler_context);
+extern bool hcn_set_vector_handler(struct HCN_context *context, HCN_vector_type vector_type, HCN_handler_vector handler, void *handler_context);
+extern bool hcn_set_text_handler(struct HCN_context *context, HCN_text_type text_type, HCN_handler_text handler, void *handler_context);
+extern void hcn_set_capabilities(struct HCN_context *context, unsigned short capabilities);
+extern void hcn_set_vector_bounds(struct HCN_context *context, struct HCN_vector_bounds *bounds, int bounds_count);
+extern void hcn_set_subject_vector_callback(struct HCN_context *context, HCN_callback_subject_vector callback);
+extern void hcn_set_vector_block_callback(struct HCN_context *context, HCN_callback_vector_block callback);
+extern void hcn_set_dead_reckoning(struct HCN_context *context, bool enabled, float threshold);
+extern void hcn_set_scheduler(struct HCN_context *context, bool enabled);
+extern void hcn_set_send_budget(struct HCN_context *context, int bytes_per_tick, int packets_per_tick);
+extern void hcn_set_pipeline(struct HCN_context *context, bool enabled);
+extern void hcn_set_player_team(struct HCN_context *context, int player_number, int team);
+extern void hcn_client_start(struct HCN_context *context);
+extern bool hcn_send_wide_datapoints(struct HCN_context *context, int player_number, const struct HCN_wide_datapoint *dps, int dp_count);
+extern bool hcn_send_keyvalue_bool(struct HCN_context *context, int player_number, const char *key, bool value);
+extern bool hcn_send_keyvalue_int(struct HCN_context *context, int player_number, const char *key, int value);
+extern bool hcn_send_keyvalue_float(struct HCN_context *context, int player_number, const char *key, float value);
+extern bool hcn_send_typed_keyvalue(struct HCN_context *context, int player_number, const char *key, const struct HCN_value *value);
+extern bool hcn_bundle_datapoints(struct HCN_context *context, int player_number, struct HCN_datapoint *dps, int dp_count);
+extern bool hcn_bundle_vectors(struct HCN_context *context, int player_number, struct HCN_vector *vectors, int vector_count);
+extern bool hcn_bundle_keyvalue(struct HCN_context *context, int player_number, char *keyvalue);
+extern bool hcn_bundle_text(struct HCN_context *context, int player_number, HCN_text_type type, HCN_text_color color, wchar_t *text);
+extern bool hcn_bundle_text(struct HCN_context *context, int player_number, HCN_text_type type, HCN_text_color color, char *text);
+extern bool hcn_bundle_flush(struct HCN_context *context, int player_number);
+extern int hcn_multicast_datapoints(struct HCN_context *context, unsigned int player_mask, struct HCN_datapoint *dps, int dp_count);
+extern int hcn_multicast_vectors(struct HCN_context *context, unsigned int player_mask, struct HCN_vector *vectors, int vector_count);
+extern int hcn_multicast_keyvalue(struct HCN_context *context, unsigned int player_mask, char *keyvalue);
+extern int hcn_multicast_text(struct HCN_context *context, unsigned int player_mask, HCN_text_type type, HCN_text_color color, wchar_t *text);
+extern int hcn_multicast_text(struct HCN_context *context, unsigned int player_mask, HCN_text_type type, HCN_text_color color, char *text);
+extern int hcn_broadcast_datapoints(struct HCN_context *context, struct HCN_datapoint *dps, int dp_count);
+extern int hcn_broadcast_vectors(struct HCN_context *context, struct HCN_vector *vectors, int vector_count);
+extern int hcn_broadcast_keyvalue(struct HCN_context *context, char *keyvalue);
+extern int hcn_broadcast_text(struct HCN_context *context, HCN_text_type type, HCN_text_color color, wchar_t *text);
+extern int hcn_broadcast_text(struct HCN_context *context, HCN_text_type type, HCN_text_color color, char *text);
+extern unsigned short hcn_get_capabilities(struct HCN_context *context, int player_number);
+extern void hcn_get_send_stats(struct HCN_context *context, int player_number, struct HCN_send_stats *stats);
+extern void hcn_reset_send_stats(struct HCN_context *context);
+extern void hcn_get_pipeline_stats(struct HCN_context *context, struct HCN_pipeline_stats *stats);
+extern void hcn_get_chat_stats(struct HCN_context *context, struct HCN_chat_stats *stats);
+extern void hcn_reset_chat_stats(struct HCN_context *context);
+extern bool hcn_get_predicted_vector(struct HCN_context *context, int player_number, HCN_vector_type vector_type, unsigned char subject, struct HCN_vect3d *vector);
+
+// Handlers can be anything callable, a lambda with captures, or an object with an operator(). The call is made right
+//	through a small function generated for each type, so it can be inlined. The callable isn't copied, it has to be
+//	around for as long as it's set.
+template <typename F>
+inline bool hcn_set_datapoint_handler(HCN_datapoint_type dp_type, F &callable) {
+
+	return hcn_set_datapoint_handler(dp_type, [](void *context, int player_number, HCN_datapoint_type dp_type, struct HCN_datapoint *dp) -> bool {
+		return (*(F *)context)(player_number, dp_type, dp);
+	}, (void *)&callable);
+}
+
+template <typename F>
+inline bool hcn_set_wide_datapoint_handler(HCN_datapoint_type dp_type, F &callable) {
+
+	return hcn_set_wide_datapoint_handler(dp_type, [](void *context, int player_number, const struct HCN_wide_datapoint *dp) -> bool {
+		return (*(F *)context)(player_number, dp);
+	}, (void *)&callable);
+}
+
+template <typename F>
+inline bool hcn_set_vector_handler(HCN_vector_type vector_type, F &callable) {
+
+	return hcn_set_vector_handler(vector_type, [](void *context, int player_number, HCN_vector_type vector_type, struct HCN_vect3d *vector) -> bool {
+		return (*(F *)context)(player_number, vector_type, vector);
+	}, (void *)&callable);
+}
+
+template <typename F>
+inline bool hcn_set_text_handler(HCN_text_type text_type, F &callable) {
+
+	return hcn_set_text_handler(text_type, [](void *context, int player_number, HCN_text_type text_type, struct HCN_text_packet *packet) -> bool {
+		return (*(F *)context)(player_number, text_type, packet);
+	}, (void *)&callable);
+}
+
+// The same, on a context.
+template <typename F>
+inline bool hcn_set_datapoint_handler(struct HCN_context *context, HCN_datapoint_type dp_type, F &callable) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool set = hcn_set_datapoint_handler(dp_type, callable);
+
+	hcn_set_context(previous);
+	return set;
+}
+
+template <typename F>
+inline bool hcn_set_wide_datapoint_handler(struct HCN_context *context, HCN_datapoint_type dp_type, F &callable) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool set = hcn_set_wide_datapoint_handler(dp_type, callable);
+
+	hcn_set_context(previous);
+	return set;
+}
+
+template <typename F>
+inline bool hcn_set_vector_handler(struct HCN_context *context, HCN_vector_type vector_type, F &callable) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool set = hcn_set_vector_handler(vector_type, callable);
+
+	hcn_set_context(previous);
+	return set;
+}
+
+template <typename F>
+inline bool hcn_set_text_handler(struct HCN_context *context, HCN_text_type text_type, F &callable) {
+	struct HCN_context *previous = hcn_set_context(context);
+	bool set = hcn_set_text_handler(text_type, callable);
+
+	hcn_set_context(previous);
+	return set;
+}
 
 
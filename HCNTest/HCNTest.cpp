@@ -0,0 +1,575 @@
+// HCNTest - differential test for the HCN zero-encoding kernels.
+//
+// Every codec hcn_set_codec() can select has to produce exactly what hcn_encode_scalar()/hcn_decode_scalar() do, on
+//	random packets, on packets built to be nothing but escapes, and on encoded strings that end right at the edge of
+//	a page, where the SIMD decoders have to stop reading ahead. The text narrow/widen kernels are held to
+//	hcn_narrow_scalar()/hcn_widen_scalar() the same way, at every length and alignment. Then a client and a server
+//	talk to each other in-process, to check text makes it through whole, and that packets full of what the
+//	alternate encoding is for, and what it isn't, come out the same either way. Compression gets random 8-bit and
+//	UTF-16 text with repeats in it, so it's worth compressing, and compressed packets that are cut short, have
+//	bytes changed, are made up, or come out one byte either side of HCN_COMPRESSED_MAX_BODY. Returns 0 if
+//	everything matched.
+//
+
+#include "HCN.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#define HCN_TEST_RANDOM		20000				// Random packets per codec.
+#define HCN_TEST_PAGE		4096
+#define HCN_TEST_ALIGN		16				// Alignments to try, in characters. A whole AVX2 load.
+
+static int failures = 0;
+
+// The client and server for end-to-end checks, and the last packet either of them sent.
+static struct HCN_context *test_server;
+static struct HCN_context *test_client;
+static struct HCN_packet test_sent;
+static int test_sends = 0;
+
+// The last text the client got.
+static wchar_t test_text[HCN_TEXT_LENGTH];
+static int test_text_length = -1;
+
+// The last console text the client got. It's 8-bit.
+static char test_text8[HCN_TEXT_LENGTH];
+static int test_text8_length = -1;
+
+// The datapoint values the client got.
+static unsigned int test_values[HCN_MAX_DATAPOINTS];
+static int test_value_count = 0;
+
+// Two pages, the second one can't be touched. A decoder that reads past the null terminator into it crashes.
+static unsigned char *guarded_pages() {
+#ifdef _WIN32
+	unsigned char *pages = (unsigned char *)VirtualAlloc(NULL, 2 * HCN_TEST_PAGE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	DWORD old;
+
+	if (pages != NULL) VirtualProtect(pages + HCN_TEST_PAGE, HCN_TEST_PAGE, PAGE_NOACCESS, &old);
+	return pages;
+#else
+	unsigned char *pages = (unsigned char *)mmap(NULL, 2 * HCN_TEST_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (pages == MAP_FAILED) return NULL;
+	mprotect(pages + HCN_TEST_PAGE, HCN_TEST_PAGE, PROT_NONE);
+	return pages;
+#endif
+}
+
+// A 16-bit character that's likely to need encoding, or look like it does.
+static wchar_t nasty_unit() {
+
+	switch (rand() % 6) {
+	case 0:
+		return 0;
+	case 1:
+		return HCN_ENCODE_TAG;
+	case 2:
+		return HCN_ENCODE_ZERO;
+	case 3:
+		return (wchar_t)(rand() & 0xFF);
+	}
+	return (wchar_t)(rand() ^ (rand() << 8));
+}
+
+static void fail(const char *what, const char *codec, int bytes) {
+
+	printf("FAIL: %s, codec %s, %d bytes\n", what, codec, bytes);
+	failures++;
+}
+
+// check_packet() - Encode and decode bytes of source with the scalar reference and the current codec, and compare.
+static void check_packet(const char *codec, struct HCN_packet *source, int bytes) {
+	struct HCN_packet reference, encoded, ref_decoded, decoded;
+	const wchar_t *s = (const wchar_t *)source;
+	int ref_length, length, ref_units, units, needed = 0;
+
+	memset(&reference, 0x55, sizeof(reference));
+	memset(&encoded, 0x55, sizeof(encoded));
+	ref_length = hcn_encode_scalar(&reference, source, bytes);
+	length = hcn_encode(&encoded, source, bytes);
+	if (length != ref_length || memcmp(&encoded, &reference, length * sizeof(wchar_t)) != 0) {
+		fail("encode differs", codec, bytes);
+		return;
+	}
+
+	ref_units = hcn_decode_scalar(&ref_decoded, &reference);
+	units = hcn_decode(&decoded, &encoded);
+	if (units != ref_units || memcmp(&decoded, &ref_decoded, units * sizeof(wchar_t)) != 0) {
+		fail("decode differs", codec, bytes);
+		return;
+	}
+
+	// If it all fit, it has to come back exactly as it was.
+	for (int i = 0; i < (bytes + 1) / 2; i++) needed += (s[i] == 0 || s[i] == HCN_ENCODE_TAG) ? 2 : 1;
+	if (needed < HCN_MAX_PACKET_LENGTH / 2 && (units != (bytes + 1) / 2 || memcmp(&decoded, source, bytes) != 0)) {
+		fail("round trip", codec, bytes);
+	}
+}
+
+// check_narrow() - Narrow count characters of text and widen them back, at every alignment, with the scalar reference
+//	and the current codec, and compare. If it narrowed, it has to come back exactly as it was. The source is also put
+//	right up against an untouchable page, so a kernel that reads past count crashes.
+static void check_narrow(const char *codec, unsigned char *pages, const wchar_t *text, int count) {
+	wchar_t source[HCN_TEXT_LENGTH * 2 + HCN_TEST_ALIGN];
+	wchar_t widened[HCN_TEXT_LENGTH * 2 + HCN_TEST_ALIGN], ref_widened[HCN_TEXT_LENGTH * 2 + HCN_TEST_ALIGN];
+	char narrow[HCN_TEXT_LENGTH * 2 + HCN_TEST_ALIGN], ref_narrow[HCN_TEXT_LENGTH * 2 + HCN_TEST_ALIGN];
+	wchar_t *edge = (wchar_t *)(pages + HCN_TEST_PAGE) - count;
+	char *narrow_edge = (char *)(pages + HCN_TEST_PAGE) - count;
+	bool narrowed, ref_narrowed;
+
+	for (int align = 0; align < HCN_TEST_ALIGN; align++) {
+		memcpy(source + align, text, count * sizeof(wchar_t));
+		memset(narrow, 0x55, sizeof(narrow));
+		memset(ref_narrow, 0x55, sizeof(ref_narrow));
+		ref_narrowed = hcn_narrow_scalar(ref_narrow + align, source + align, count);
+		narrowed = hcn_narrow(narrow + align, source + align, count);
+		if (narrowed != ref_narrowed || (narrowed && memcmp(narrow + align, ref_narrow + align, count) != 0)) {
+			fail("narrow differs", codec, count * 2);
+			return;
+		}
+		if (!narrowed) continue;
+
+		memset(widened, 0x55, sizeof(widened));
+		memset(ref_widened, 0x55, sizeof(ref_widened));
+		hcn_widen_scalar(ref_widened + align, narrow + align, count);
+		hcn_widen(widened + align, narrow + align, count);
+		if (memcmp(widened, ref_widened, sizeof(widened)) != 0) {
+			fail("widen differs", codec, count);
+			return;
+		}
+		if (memcmp(widened + align, text, count * sizeof(wchar_t)) != 0) {
+			fail("narrow round trip", codec, count * 2);
+			return;
+		}
+	}
+
+	memcpy(edge, text, count * sizeof(wchar_t));
+	narrowed = hcn_narrow(narrow, edge, count);
+	if (narrowed != hcn_narrow_scalar(ref_narrow, text, count)) fail("narrow at page edge differs", codec, count * 2);
+	if (!narrowed) return;
+	memcpy(narrow_edge, narrow, count);
+	hcn_widen(widened, narrow_edge, count);
+	if (memcmp(widened, text, count * sizeof(wchar_t)) != 0) fail("widen at page edge differs", codec, count);
+}
+
+static void test_sender(int player_number, struct HCN_packet *packet) {
+
+	memcpy(&test_sent, packet, sizeof(test_sent));
+	test_sends++;
+}
+
+static bool test_text_handler(void *context, int player_number, HCN_text_type text_type, struct HCN_text_packet *packet) {
+
+	test_text_length = packet->text_length;
+	memcpy(test_text, packet->text, packet->text_length * sizeof(wchar_t));
+	return true;
+}
+
+static bool test_text8_handler(void *context, int player_number, HCN_text_type text_type, struct HCN_text_packet *packet) {
+
+	test_text8_length = packet->text_length;
+	memcpy(test_text8, packet->text8, packet->text_length);
+	return true;
+}
+
+static bool test_datapoint_handler(void *context, int player_number, HCN_datapoint_type dp_type, struct HCN_datapoint *dp) {
+
+	if (test_value_count < HCN_MAX_DATAPOINTS) test_values[test_value_count++] = dp->dp_uint;
+	return true;
+}
+
+// test_handshake() - Shake hands again, with the client offering only capabilities. Neither side turns on dead
+//	reckoning, so that's never on.
+static bool test_handshake(unsigned short capabilities) {
+	struct HCN_packet packet;
+
+	hcn_set_capabilities(test_client, capabilities);
+	hcn_client_start(test_client);
+	memcpy(&packet, &test_sent, sizeof(packet));
+	if (!hcn_process_chat(test_server, 1, HCN_CHAT_TYPE, (wchar_t *)&packet)) return false;
+	memcpy(&packet, &test_sent, sizeof(packet));
+	if (!hcn_process_chat(test_client, 0, HCN_CHAT_TYPE, (wchar_t *)&packet)) return false;
+	return hcn_running(test_client, 0) && hcn_running(test_server, 1) && hcn_get_capabilities(test_server, 1) == (capabilities & ~HCN_CAP_DEAD_RECKONING);
+}
+
+// test_connect() - Set up a client and a server, and shake hands. The server has the client as player 1.
+static bool test_connect() {
+
+	test_server = hcn_context_create();
+	test_client = hcn_context_create();
+	hcn_init(test_server, (char *)"HCNTest");
+	hcn_init(test_client, (char *)"HCNTest");
+	hcn_set_packet_sender(test_server, test_sender);
+	hcn_set_packet_sender(test_client, test_sender);
+	hcn_what_we_are(test_server, HCN_SERVER, HCN_SERVER_HSE);
+	hcn_what_we_are(test_client, HCN_CLIENT, HCN_CLIENT_CHIMERA);
+	hcn_set_text_handler(test_client, HCN_TEXT_CHAT, test_text_handler, NULL);
+	hcn_set_text_handler(test_client, HCN_TEXT_CONSOLE, test_text8_handler, NULL);
+	hcn_set_datapoint_handler(test_client, HCN_DATAPOINT_TICKRATE, test_datapoint_handler, NULL);
+	hcn_set_vector_bounds(test_server, NULL, 0);
+	hcn_set_vector_bounds(test_client, NULL, 0);
+	return test_handshake(HCN_CAP_ALL);
+}
+
+// test_to_client() - Hand whatever the server just sent to the client.
+static bool test_to_client() {
+	struct HCN_packet packet;
+
+	memcpy(&packet, &test_sent, sizeof(packet));
+	return hcn_process_chat(test_client, 0, HCN_CHAT_TYPE, (wchar_t *)&packet);
+}
+
+// check_text() - Send text from the server to the client, and make sure it comes out the same. narrowed is whether
+//	it should have gone as 8-bit characters, which can only be seen if it wasn't compressed.
+static void check_text(const char *codec, const wchar_t *text, bool narrowed) {
+	struct HCN_packet decoded;
+	int length = 0;
+
+	while (text[length] != 0) length++;
+	test_text_length = -1;
+	if (!hcn_send_text(test_server, 1, HCN_TEXT_CHAT, HCN_COLOR_WHITE, (wchar_t *)text) || !test_to_client()) {
+		fail("text didn't go through", codec, length * 2);
+		return;
+	}
+	hcn_decode_packet(&decoded, (const wchar_t *)&test_sent, HCN_CHAT_TYPE);
+	if (((struct HCN_preamble *)&decoded)->packet_type == HCN_PACKET_TEXT && ((((struct HCN_text_packet *)&decoded)->text_type & HCN_TEXT_NARROWED) != 0) != narrowed) {
+		fail(narrowed ? "text wasn't narrowed" : "text was narrowed", codec, length * 2);
+	}
+	if (test_text_length != length + 1 || memcmp(test_text, text, (length + 1) * sizeof(wchar_t)) != 0) {
+		fail("text round trip", codec, length * 2);
+	}
+}
+
+// test_sent_alternate() - Did the last packet sent go with the alternate encoding? The packet type is never encoded.
+static bool test_sent_alternate() {
+
+	return (((struct HCN_preamble *)&test_sent)->packet_type & HCN_PACKET_ALTERNATE) != 0;
+}
+
+// check_alternate_text() - Send length characters of nothing but unit as text, and make sure it comes out the same.
+//	Only 0xFFFF is better off with the alternate encoding, the terminator aside.
+static void check_alternate_text(const char *codec, wchar_t unit, int length) {
+	wchar_t text[HCN_TEXT_LENGTH];
+
+	for (int i = 0; i < length; i++) text[i] = unit;
+	text[length] = 0;
+	check_text(codec, text, false);
+	if (length > 1 && test_sent_alternate() != (unit == HCN_ENCODE_TAG)) {
+		fail(test_sent_alternate() ? "text went alternate when it's longer" : "text didn't go alternate when it's shorter", codec, length * 2);
+	}
+}
+
+// check_alternate_datapoints() - Send count datapoints all holding value, and make sure they come out the same. The
+//	type's high bytes are zeroes, so with 0 or 0xFFFFFFFF the alternate encoding is shorter, with the XOR patterns
+//	it's longer.
+static void check_alternate_datapoints(const char *codec, unsigned int value, int count) {
+	struct HCN_datapoint dps[HCN_MAX_DATAPOINTS];
+	bool shorter = (value == 0 || value == 0xFFFFFFFF);
+	int i;
+
+	for (i = 0; i < count; i++) {
+		dps[i].dp_type = HCN_DATAPOINT_TICKRATE;
+		dps[i].dp_uint = value;
+	}
+	test_value_count = 0;
+	if (!hcn_send_datapoints(test_server, 1, dps, count) || !test_to_client()) {
+		fail("datapoints didn't go through", codec, count * (int)sizeof(struct HCN_datapoint));
+		return;
+	}
+	if (test_sent_alternate() != shorter) {
+		fail(shorter ? "datapoints didn't go alternate when it's shorter" : "datapoints went alternate when it's longer", codec, count * (int)sizeof(struct HCN_datapoint));
+	}
+	for (i = 0; i < count && test_value_count == count; i++) {
+		if (test_values[i] != value) break;
+	}
+	if (test_value_count != count || i < count) fail("datapoint round trip", codec, count * (int)sizeof(struct HCN_datapoint));
+}
+
+// test_sent_compressed() - Did the last packet sent go compressed?
+static bool test_sent_compressed() {
+
+	return (((struct HCN_preamble *)&test_sent)->packet_type & ~HCN_PACKET_ALTERNATE) == HCN_PACKET_COMPRESSED;
+}
+
+// compressible() - Fill length characters of text with random ones from low up, with copies of what came before
+//	mixed in, so there's something to compress.
+static void compressible(wchar_t *text, int length, wchar_t low, int range) {
+	int n = 0, from, run;
+
+	while (n < length) {
+		if (n < HCN_COMPRESS_MIN_MATCH || rand() % 2 == 0) {
+			text[n++] = (wchar_t)(low + rand() % range);
+			continue;
+		}
+		from = rand() % n;
+		for (run = HCN_COMPRESS_MIN_MATCH + rand() % 16; run > 0 && n < length; run--) text[n++] = text[from++];
+	}
+	text[length] = 0;
+}
+
+// check_text8() - Send 8-bit text from the server to the client as console text, and make sure it comes out the same.
+static void check_text8(const char *codec, const char *text) {
+	int length = (int)strlen(text);
+
+	test_text8_length = -1;
+	if (!hcn_send_text(test_server, 1, HCN_TEXT_CONSOLE, HCN_COLOR_WHITE, (char *)text) || !test_to_client()) {
+		fail("8-bit text didn't go through", codec, length);
+		return;
+	}
+	if (test_text8_length != length + 1 || memcmp(test_text8, text, length + 1) != 0) fail("8-bit text round trip", codec, length);
+}
+
+// test_decompress() - Hand the client a compressed packet body, right up against an untouchable page so reading past
+//	the end of it crashes.
+static bool test_decompress(unsigned char *pages, const unsigned char *body, int length) {
+	struct HCN_packet_view view;
+	struct HCN_context *previous;
+	unsigned char *edge = pages + HCN_TEST_PAGE - length;
+	bool handled;
+
+	memmove(edge, body, length);
+	view.packet_type = HCN_PACKET_COMPRESSED;
+	view.preamble = NULL;
+	view.body = edge;
+	view.body_length = length;
+	previous = hcn_set_context(test_client);
+	handled = hcn_compressed_view_handler(0, &view);
+	hcn_set_context(previous);
+	return handled;
+}
+
+// check_bad_compressed() - The packet the server just sent, compressed, cut short everywhere and with bytes changed.
+//	Cut anywhere but the padding at the end, the text comes out short and has to be turned away. Changed bytes can
+//	come out as anything, as long as nothing is read or written that shouldn't be.
+static void check_bad_compressed(const char *codec, unsigned char *pages) {
+	struct HCN_packet decoded;
+	struct HCN_decode_result result = hcn_decode_packet(&decoded, (const wchar_t *)&test_sent, HCN_CHAT_TYPE);
+	unsigned char body[HCN_MAX_PACKET_LENGTH];
+	int length, i;
+
+	if (result.status != HCN_DECODE_OK) {
+		fail("compressed packet doesn't decode", codec, 0);
+		return;
+	}
+	length = result.length * 2 - (int)sizeof(struct HCN_preamble);
+	memcpy(body, (unsigned char *)&decoded + sizeof(struct HCN_preamble), length);
+
+	if (!test_decompress(pages, body, length)) fail("compressed packet handed over whole was turned away", codec, length);
+	for (i = 0; i < length - 1; i++) {
+		if (test_decompress(pages, body, i)) fail("compressed packet cut short was taken", codec, i);
+	}
+	for (i = 0; i < 200; i++) {
+		memcpy(body, (unsigned char *)&decoded + sizeof(struct HCN_preamble), length);
+		body[rand() % length] ^= (unsigned char)(1 + rand() % 0xFF);
+		test_decompress(pages, body, length);
+	}
+}
+
+// compressed_text() - A compressed packet holding an empty UTF-16 text, padded out with zeroes to length bytes, all
+//	copied from the one before. Returns how long the compressed body is.
+static int compressed_text(unsigned char *body, int length) {
+	int n = 2, out = 5, count;
+
+	body[0] = HCN_PACKET_TEXT;
+	body[1] = 0;
+	body[n++] = 4;								// 5 bytes as-is, the text type, color, length and terminator.
+	body[n++] = HCN_TEXT_CHAT;
+	body[n++] = HCN_COLOR_WHITE;
+	body[n++] = 1;
+	body[n++] = 0;
+	body[n++] = 0;
+	while (out < length) {
+		count = length - out;
+		if (count > HCN_COMPRESS_MAX_MATCH) count = HCN_COMPRESS_MAX_MATCH;
+		if (length - out - count > 0 && length - out - count < HCN_COMPRESS_MIN_MATCH) count -= HCN_COMPRESS_MIN_MATCH;
+		body[n++] = 0x80 | (count - HCN_COMPRESS_MIN_MATCH);
+		body[n++] = 1;								// From right before.
+		body[n++] = 0;
+		out += count;
+	}
+	return n;
+}
+
+// check_page_edge() - Put an encoded string right up against an untouchable page, and make sure every codec decodes
+//	it the same without reading past the terminator.
+static void check_page_edge(const char *codec, unsigned char *pages, const wchar_t *encoded, int units) {
+	struct HCN_packet reference, decoded;
+	wchar_t *edge;
+	int shift, ref_units, got;
+
+	for (shift = 0; shift < 34; shift++) {				// The terminator lands on each position in a SIMD load.
+		edge = (wchar_t *)(pages + HCN_TEST_PAGE) - units - shift;
+		memcpy(edge, encoded, units * sizeof(wchar_t));
+		for (int i = units; i < units + shift; i++) edge[i] = 'x';	// Clean characters after it, up to the edge,
+		edge[units - 1] = 0;						// but the string ends here.
+
+		ref_units = hcn_decode_scalar(&reference, (struct HCN_packet *)edge);
+		got = hcn_decode(&decoded, (struct HCN_packet *)edge);
+		if (got != ref_units || memcmp(&decoded, &reference, got * sizeof(wchar_t)) != 0) {
+			fail("decode at page edge differs", codec, units * 2);
+			return;
+		}
+	}
+}
+
+int main() {
+	HCN_codec codecs[] = { HCN_CODEC_SCALAR, HCN_CODEC_SSE2, HCN_CODEC_AVX2 };
+	struct HCN_packet source, encoded;
+	unsigned char *pages = guarded_pages();
+	wchar_t *s = (wchar_t *)&source;
+	wchar_t text[HCN_TEXT_LENGTH * 2];
+	char narrow_text[HCN_TEXT_LENGTH];
+	unsigned char garbage[HCN_MAX_PACKET_LENGTH];
+	unsigned char inner[] = { HCN_PACKET_KEYVALUE, HCN_PACKET_TEXT, HCN_PACKET_KEY_DEFINE, HCN_PACKET_KEY_ID };
+	wchar_t units[] = { (wchar_t)HCN_ENCODE_XOR, (wchar_t)(HCN_ENCODE_XOR ^ 0xFFFF), 0xFFFF };
+	unsigned int values[] = { 0xA5A5A5A5, 0x5A5A5A5A, 0, 0xFFFFFFFF };
+	wchar_t bad[4];
+	const char *name;
+	int c, i, n, bytes, length;
+
+	if (pages == NULL) {
+		printf("FAIL: couldn't set up a guard page\n");
+		return 1;
+	}
+	if (!test_connect()) {
+		printf("FAIL: client and server couldn't shake hands\n");
+		return 1;
+	}
+
+	for (c = 0; c < (int)(sizeof(codecs) / sizeof(codecs[0])); c++) {
+		if (hcn_set_codec(codecs[c]) != codecs[c]) {
+			printf("SKIP: this CPU can't run codec %d\n", codecs[c]);
+			continue;
+		}
+		name = hcn_enum_to_string(codecs[c], HCN_codec_names);
+		srand(1234);
+
+		// Random packets, every length, with a lot of escapes mixed in.
+		for (i = 0; i < HCN_TEST_RANDOM; i++) {
+			bytes = rand() % (HCN_MAX_PACKET_LENGTH + 1);
+			for (n = 0; n < HCN_MAX_PACKET_LENGTH / 2; n++) s[n] = (rand() % 4 == 0) ? nasty_unit() : (wchar_t)(0x20 + rand() % 0x5F);
+			check_packet(name, &source, bytes);
+		}
+
+		// Nothing but escapes, so the encoded packet is as long as it can be, and gets truncated.
+		for (bytes = 0; bytes <= HCN_MAX_PACKET_LENGTH; bytes += 2) {
+			for (n = 0; n < HCN_MAX_PACKET_LENGTH / 2; n++) s[n] = 0;
+			check_packet(name, &source, bytes);
+			for (n = 0; n < HCN_MAX_PACKET_LENGTH / 2; n++) s[n] = HCN_ENCODE_TAG;
+			check_packet(name, &source, bytes);
+		}
+
+		// Clean packets with a single escape as the very last character, and at every position in a SIMD block.
+		for (bytes = 2; bytes <= 128; bytes += 2) {
+			for (n = 0; n < bytes / 2; n++) s[n] = 'a';
+			s[bytes / 2 - 1] = (bytes & 2) ? 0 : HCN_ENCODE_TAG;
+			check_packet(name, &source, bytes);
+		}
+
+		// Encoded strings that end at the edge of a page, with escapes right before the terminator and spread through.
+		for (i = 0; i < 200; i++) {
+			bytes = 2 + (rand() % 120) * 2;
+			for (n = 0; n < bytes / 2; n++) s[n] = (rand() % 3 == 0) ? nasty_unit() : 'a';
+			s[bytes / 2 - 1] = (i & 1) ? 0 : HCN_ENCODE_TAG;
+			length = hcn_encode_scalar(&encoded, &source, bytes);
+			check_page_edge(name, pages, (const wchar_t *)&encoded, length);
+		}
+
+		// Garbage after a tag has to be rejected the same way.
+		bad[0] = 'a';
+		bad[1] = HCN_ENCODE_TAG;
+		bad[2] = 'b';
+		bad[3] = 0;
+		check_page_edge(name, pages, bad, 4);
+		if (hcn_decode(&encoded, (struct HCN_packet *)bad) != hcn_decode_scalar(&encoded, (struct HCN_packet *)bad)) fail("bad escape", name, 8);
+
+		// Narrowing, every length from nothing up, with characters from all over Latin-1, then with one that isn't
+		//	at each spot.
+		for (length = 0; length <= HCN_TEXT_LENGTH * 2; length++) {
+			for (n = 0; n < length; n++) text[n] = (wchar_t)(1 + rand() % 0xFF);
+			check_narrow(name, pages, text, length);
+			if (length == 0) continue;
+			text[rand() % length] = (wchar_t)(0x100 + rand() % 0xFF00);
+			check_narrow(name, pages, text, length);
+			for (n = 0; n < length && length <= 2 * HCN_TEST_ALIGN + 1; n++) {
+				for (i = 0; i < length; i++) text[i] = (i == n) ? 0x100 : 'a';
+				check_narrow(name, pages, text, length);
+			}
+		}
+
+		// The empty string, narrowed, is still a string.
+		text[0] = 0;
+		check_narrow(name, pages, text, 1);
+		check_text(name, text, true);
+
+		// Text that narrows goes narrowed, text that doesn't goes as it is, right up to the longest there can be.
+		for (length = 1; length < HCN_TEXT_LENGTH; length++) {
+			for (n = 0; n < length; n++) text[n] = (wchar_t)(1 + rand() % 0xFF);
+			text[length] = 0;
+			check_text(name, text, true);
+			text[rand() % length] = 0x263A;
+			check_text(name, text, false);
+		}
+
+		// The alternate encoding, with nothing else in the way. Text of every length up to the longest, which with
+		//	0xFFFF only fits alternate, and datapoints, which start right after the characters that aren't encoded.
+		if (!test_handshake(HCN_CAP_ALTERNATE_ENCODING)) fail("handshake for the alternate encoding", name, 0);
+		for (i = 0; i < (int)(sizeof(units) / sizeof(units[0])); i++) {
+			for (length = 1; length < HCN_TEXT_LENGTH; length++) check_alternate_text(name, units[i], length);
+		}
+		for (i = 0; i < (int)(sizeof(values) / sizeof(values[0])); i++) {
+			for (n = 1; n <= HCN_MAX_DATAPOINTS; n++) check_alternate_datapoints(name, values[i], n);
+		}
+		if (!test_handshake(HCN_CAP_ALL)) fail("handshake", name, 0);
+
+		// Compression, 8-bit and UTF-16 text of every length up to the longest, with enough repeats in it that a lot
+		//	of it goes compressed. Every so often one that did is cut short and has bytes changed.
+		for (i = 0, n = 0; i < 2; i++) {
+			for (length = 1; length < HCN_TEXT_LENGTH; length++) {
+				compressible(text, length, i ? 0x3041 : 1, i ? 0x5F : 0xFF);
+				if (i) {
+					check_text(name, text, false);
+				}
+				else {
+					for (bytes = 0; bytes <= length; bytes++) narrow_text[bytes] = (char)text[bytes];
+					check_text8(name, narrow_text);
+				}
+				if (!test_sent_compressed()) continue;
+				n++;
+				if (length % 16 == 0) check_bad_compressed(name, pages);
+			}
+			if (n < HCN_TEXT_LENGTH / 2) fail(i ? "UTF-16 text didn't go compressed" : "8-bit text didn't go compressed", name, n);
+			n = 0;
+		}
+
+		// Made up compressed packets, of every type, and what they come out as exactly fitting, and one byte over.
+		for (i = 0; i < HCN_TEST_RANDOM; i++) {
+			bytes = rand() % (HCN_COMPRESSED_BODY + 1);
+			for (n = 0; n < bytes; n++) garbage[n] = (unsigned char)rand();
+			if (bytes > 0 && i % 8 != 0) garbage[0] = inner[rand() % (sizeof(inner) / sizeof(inner[0]))];	// Mostly types that get through.
+			if (bytes > 1) garbage[1] &= HCN_COMPRESS_WIDE;
+			test_decompress(pages, garbage, bytes);
+		}
+		test_text_length = -1;
+		if (!test_decompress(pages, garbage, compressed_text(garbage, HCN_COMPRESSED_MAX_BODY)) || test_text_length != 1) {
+			fail("compressed packet that just fits was turned away", name, HCN_COMPRESSED_MAX_BODY);
+		}
+		if (test_decompress(pages, garbage, compressed_text(garbage, HCN_COMPRESSED_MAX_BODY + 1))) {
+			fail("compressed packet that doesn't fit was taken", name, HCN_COMPRESSED_MAX_BODY + 1);
+		}
+
+		printf("%s: done\n", name);
+	}
+
+	hcn_set_codec(HCN_CODEC_AUTO);
+	printf("%s\n", failures == 0 ? "PASS" : "FAILED");
+	return failures == 0 ? 0 : 1;
+}